@@ -0,0 +1,23 @@
+#include "AllocationCounter.h"
+
+std::atomic_uint64_t	AllocationCounter::_allocations					{ 0 };
+std::atomic_uint64_t	AllocationCounter::_hotPathAllocations			{ 0 };
+std::atomic_size_t		AllocationCounter::_lastHotPathAllocationSize	{ 0 };
+thread_local int		AllocationCounter::_hotPathDepth				= 0;
+
+void AllocationCounter::recordAllocation(size_t size)
+{
+	_allocations.fetch_add(1, std::memory_order_relaxed);
+
+	if (_hotPathDepth) {
+		_hotPathAllocations.fetch_add(1, std::memory_order_relaxed);
+		_lastHotPathAllocationSize.store(size, std::memory_order_relaxed);
+	}
+}
+
+void AllocationCounter::reset()
+{
+	_allocations				= 0;
+	_hotPathAllocations			= 0;
+	_lastHotPathAllocationSize	= 0;
+}
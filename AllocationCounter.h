@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Counts heap allocations made on the pulse hot path (transport receive -> enrich -> encode -> enqueue -> send on the
+// connection), which should be none once the pipeline has warmed up. The code on the hot path marks itself with a
+// HotPathScope. Allocations are only counted by a program which replaces the global operator new with one that calls
+// recordAllocation, such as benchmarks/PulseAllocationCheck. The controller itself doesn't, so a HotPathScope only
+// costs a thread local increment.
+class AllocationCounter
+{
+public:
+	// Called by a counting operator new, must not allocate
+	static void recordAllocation(size_t size);
+
+	static uint64_t	allocations					() { return _allocations.load(std::memory_order_relaxed); }			// All threads
+	static uint64_t	hotPathAllocations			() { return _hotPathAllocations.load(std::memory_order_relaxed); }	// Inside a HotPathScope
+	static size_t	lastHotPathAllocationSize	() { return _lastHotPathAllocationSize.load(std::memory_order_relaxed); }
+	static void		reset						();
+
+private:
+	static std::atomic_uint64_t	_allocations;
+	static std::atomic_uint64_t	_hotPathAllocations;
+	static std::atomic_size_t	_lastHotPathAllocationSize;
+	static thread_local int		_hotPathDepth;
+
+	friend class HotPathScope;
+};
+
+// Marks the calling thread as being on the hot path from construction to destruction:
+//	HotPathScope hotPath;
+class HotPathScope
+{
+public:
+	HotPathScope()	{ AllocationCounter::_hotPathDepth++; }
+	~HotPathScope()	{ AllocationCounter::_hotPathDepth--; }
+
+	HotPathScope(const HotPathScope&) = delete;
+	HotPathScope& operator=(const HotPathScope&) = delete;
+};
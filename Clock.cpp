@@ -0,0 +1,184 @@
+#include "Clock.h"
+#include "log.h"
+
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+static uint64_t steadyNSecs()
+{
+	return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+static uint64_t systemNSecs()
+{
+	return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+static SystemClock			systemClock;
+std::atomic<Clock*>			Clock::_instance { &systemClock };
+
+Clock* Clock::instance()
+{
+	return _instance.load(std::memory_order_acquire);
+}
+
+void Clock::setInstance(Clock* clock)
+{
+	logInfo() << "Using" << clock->name() << "clock";
+
+	_instance.store(clock, std::memory_order_release);
+}
+
+Clock* Clock::create(const std::string& spec)
+{
+	std::string simulatedPrefix = "simulated";
+
+	if (spec == "system") {
+		return new SystemClock();
+	} else if (spec == "monotonic") {
+		return new MonotonicClock();
+	} else if (spec.starts_with(simulatedPrefix)) {
+		double rate = 1.0;
+
+		if (spec.length() > simulatedPrefix.length()) {
+			if (spec[simulatedPrefix.length()] != ':') {
+				return nullptr;
+			}
+			try {
+				std::string	rateStr = spec.substr(simulatedPrefix.length() + 1);
+				size_t		rateLength;
+
+				rate = std::stod(rateStr, &rateLength);
+				if (rateLength != rateStr.length()) {
+					return nullptr;
+				}
+			} catch (const std::exception&) {
+				return nullptr;
+			}
+		}
+
+		// Nothing on the command line advances a stopped clock, everything waiting on it would hang
+		if (!std::isfinite(rate) || rate <= 0) {
+			return nullptr;
+		}
+		return new SimulatedClock(rate);
+	}
+
+	return nullptr;
+}
+
+void Clock::sleepUntilMonotonicNSecs(uint64_t monotonicNSecs)
+{
+	uint64_t nowNSecs = this->monotonicNSecs();
+
+	if (monotonicNSecs > nowNSecs) {
+		sleepForNSecs(monotonicNSecs - nowNSecs);
+	}
+}
+
+uint64_t SystemClock::realtimeNSecs()
+{
+	return systemNSecs();
+}
+
+uint64_t SystemClock::monotonicNSecs()
+{
+	return steadyNSecs();
+}
+
+void SystemClock::sleepForNSecs(uint64_t nsecs)
+{
+	std::this_thread::sleep_for(std::chrono::nanoseconds(nsecs));
+}
+
+MonotonicClock::MonotonicClock()
+	: _realtimeAnchorNSecs	(systemNSecs())
+	, _monotonicAnchorNSecs	(steadyNSecs())
+{
+
+}
+
+uint64_t MonotonicClock::realtimeNSecs()
+{
+	return _realtimeAnchorNSecs + (steadyNSecs() - _monotonicAnchorNSecs);
+}
+
+SimulatedClock::SimulatedClock(double rate)
+	: _rate					(rate)
+	, _realtimeStartNSecs	(systemNSecs())
+	, _steadyAnchorNSecs	(steadyNSecs())
+{
+
+}
+
+uint64_t SimulatedClock::_nowNSecs(void)
+{
+	return _simulatedAnchorNSecs + uint64_t((steadyNSecs() - _steadyAnchorNSecs) * _rate);
+}
+
+uint64_t SimulatedClock::realtimeNSecs()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	return _realtimeStartNSecs + _nowNSecs();
+}
+
+uint64_t SimulatedClock::monotonicNSecs()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	return _nowNSecs();
+}
+
+void SimulatedClock::sleepForNSecs(uint64_t nsecs)
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	uint64_t deadlineNSecs = _nowNSecs() + nsecs;
+
+	while (true) {
+		uint64_t nowNSecs = _nowNSecs();
+
+		if (nowNSecs >= deadlineNSecs) {
+			return;
+		}
+
+		if (_rate > 0) {
+			uint64_t realNSecs = uint64_t((deadlineNSecs - nowNSecs) / _rate) + 1;
+			_advancedCondition.wait_for(lock, std::chrono::nanoseconds(realNSecs));
+		} else {
+			_advancedCondition.wait(lock);
+		}
+	}
+}
+
+void SimulatedClock::advance(uint64_t nsecs)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_simulatedAnchorNSecs += nsecs;
+	}
+	_advancedCondition.notify_all();
+}
+
+void SimulatedClock::setRate(double rate)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		// Re-anchor so time is continuous across the rate change
+		_simulatedAnchorNSecs	= _nowNSecs();
+		_steadyAnchorNSecs		= steadyNSecs();
+		_rate					= rate;
+	}
+	_advancedCondition.notify_all();
+}
+
+void SimulatedClock::setRealtime(uint64_t realtimeNSecs)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_realtimeStartNSecs = realtimeNSecs - _nowNSecs();
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// Time source used by all timed code paths, normally through the timeHelpers functions. The clock is selected once
+// at startup with --clock: and defaults to SystemClock.
+class Clock
+{
+public:
+	virtual ~Clock() = default;
+
+	static Clock*	instance	();
+	static void		setInstance	(Clock* clock);		// Call before other threads start using the clock
+
+	// Creates a clock from a --clock: value: system, monotonic, simulated[:<rate > 0>]. Returns nullptr if invalid.
+	static Clock*	create		(const std::string& spec);
+
+	virtual uint64_t	realtimeNSecs	() = 0;		// Nanoseconds since epoch
+	virtual uint64_t	monotonicNSecs	() = 0;		// Never goes backwards
+	virtual void		sleepForNSecs	(uint64_t nsecs) = 0;
+	virtual bool		isRealTime		() const { return true; }	// false if time does not track the kernel clocks
+	virtual const char*	name			() const = 0;
+
+	void sleepUntilMonotonicNSecs(uint64_t monotonicNSecs);
+
+private:
+	static std::atomic<Clock*> _instance;
+};
+
+// Wall clock from the system, which can jump when the time is set (for example the first time sync after boot on a
+// board without an RTC).
+class SystemClock : public Clock
+{
+public:
+	uint64_t	realtimeNSecs	() override;
+	uint64_t	monotonicNSecs	() override;
+	void		sleepForNSecs	(uint64_t nsecs) override;
+	const char*	name			() const override { return "system"; }
+};
+
+// Wall clock which is anchored to the system time at startup and then only advances with the monotonic clock,
+// so time never jumps during a flight.
+class MonotonicClock : public SystemClock
+{
+public:
+	MonotonicClock();
+
+	uint64_t	realtimeNSecs	() override;
+	const char*	name			() const override { return "monotonic"; }
+
+private:
+	uint64_t _realtimeAnchorNSecs;
+	uint64_t _monotonicAnchorNSecs;
+};
+
+// Controllable clock for running faster than real time and for testing timing behavior. With a rate > 0 time
+// advances at rate times real time, with rate 0 time only moves when advance() is called. Sleepers wake up as soon as
+// simulated time reaches their deadline.
+class SimulatedClock : public Clock
+{
+public:
+	SimulatedClock(double rate);
+
+	uint64_t	realtimeNSecs	() override;
+	uint64_t	monotonicNSecs	() override;
+	void		sleepForNSecs	(uint64_t nsecs) override;
+	bool		isRealTime		() const override { return false; }
+	const char*	name			() const override { return "simulated"; }
+
+	void		advance			(uint64_t nsecs);
+	void		setRate			(double rate);
+	void		setRealtime		(uint64_t realtimeNSecs);	// Moves the wall clock only, monotonic time carries on
+	double		rate			() const { return _rate; }
+
+private:
+	uint64_t _nowNSecs(void);		// Simulated nanoseconds since start, _mutex must be held
+
+	std::mutex				_mutex;
+	std::condition_variable	_advancedCondition;
+	double					_rate;
+	uint64_t				_realtimeStartNSecs;		// Simulated wall clock starts at the real wall clock time, see setRealtime
+	uint64_t				_simulatedAnchorNSecs	= 0;
+	uint64_t				_steadyAnchorNSecs;
+};
@@ -12,25 +12,43 @@
 
 #include <stdio.h>
 #include <filesystem>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 #include "CommandHandler.h"
 #include "TunnelProtocol.h"
 #include "MonitoredProcess.h"
+#include "ProcessSupervisor.h"
 #include "formatString.h"
 #include "log.h"
 #include "channelizerTuner.h"
 #include "MavlinkSystem.h"
 #include "LogFileManager.h"
+#include "PulseLatencyStats.h"
+#include "DetectorHealth.h"
+#include "FlightRecorder.h"
+#include "Trace.h"
+#include "timeHelpers.h"
+#include "ControllerTunnelProtocol.h"
 
 using namespace TunnelProtocol;
+using namespace ControllerTunnelProtocol;
 
-CommandHandler::CommandHandler(MavlinkSystem* mavlink)
+CommandHandler::CommandHandler(MavlinkSystem* mavlink, DetectorHealth* detectorHealth)
     : _mavlink              (mavlink)
+    , _detectorHealth       (detectorHealth)
     , _homePath             (getenv("HOME"))
     , _airspyCmdLine        ("-h 21 -t 0")
 {
     using namespace std::placeholders;
     _mavlink->subscribeToMessage(MAVLINK_MSG_ID_TUNNEL, std::bind(&CommandHandler::_handleTunnelMessage, this, _1));
+    ProcessSupervisor::instance()->setResourceCallback(std::bind(&CommandHandler::_sendProcessResources, this, _1));
 
     namespace fs = std::filesystem;
 
@@ -45,6 +63,23 @@ CommandHandler::CommandHandler(MavlinkSystem* mavlink)
     } else {
         logInfo() << "CommandHandler::CommandHandler - Using default airspy command line:" << _airspyCmdLine;
     }
+
+    std::string cgroupsFileName = formatString("%s/cgroups.txt", _homePath);
+    if (fs::exists(fs::path(cgroupsFileName))) {
+        ProcessCgroups::instance()->setup(cgroupsFileName);
+    }
+
+    // The default cpu layout needs four cores
+    if (std::thread::hardware_concurrency() < 4) {
+        for (auto& schedulingProfile: _schedulingProfiles) {
+            schedulingProfile.cpuMask = 0;
+        }
+    }
+}
+
+void CommandHandler::setSchedulingProfile(SchedulingRole schedulingRole, const SchedulingProfile_t& schedulingProfile)
+{
+    _schedulingProfiles[schedulingRole] = schedulingProfile;
 }
 
 void CommandHandler::_sendCommandAck(uint32_t command, uint32_t result, std::string& ackMessage)
@@ -71,8 +106,10 @@ bool CommandHandler::_handleStartTags(const mavlink_tunnel_t& tunnel)
         return false;
     }
 
-    if (_mavlink->heartbeatStatus() != HEARTBEAT_STATUS_IDLE && _mavlink->heartbeatStatus() != HEARTBEAT_STATUS_HAS_TAGS) {
-        logError() << "CommandHandler::_handleStartTags ERROR - Controller in incorrect state for start tags - heartbeatStatus:" << _mavlink->heartbeatStatus();
+    std::lock_guard<std::mutex> lock(_detectionStateMutex);
+
+    if ((_mavlink->heartbeatStatus() != HEARTBEAT_STATUS_IDLE && _mavlink->heartbeatStatus() != HEARTBEAT_STATUS_HAS_TAGS) || _detectionTransition) {
+        logError() << "CommandHandler::_handleStartTags ERROR - Controller in incorrect state for start tags - heartbeatStatus:detectionTransition" << _mavlink->heartbeatStatus() << _detectionTransition.load();
         return false;
     }
 
@@ -80,6 +117,9 @@ bool CommandHandler::_handleStartTags(const mavlink_tunnel_t& tunnel)
 
     logDebug() << "_handleStartTags sdr_type" << startTagsInfo.sdr_type;
 
+    // Pooled detectors were configured for the old tags
+    _stopDetectorPool();
+
     _tagDatabase.clear();
     _receivingTags = true;
     _receivingTagsSdrType = startTagsInfo.sdr_type;
@@ -123,13 +163,210 @@ bool CommandHandler::_handleEndTags(void)
 
     _receivingTags = false;
     if (_tagDatabase.size() != 0) {
+        std::lock_guard<std::mutex> lock(_detectionStateMutex);
+
+        _startDetectorPool();
         _mavlink->setHeartbeatStatus(HEARTBEAT_STATUS_HAS_TAGS);
     }
 
     return true;
 }
 
-void CommandHandler::_startDetector(LogFileManager* logFileManager, const TunnelProtocol::TagInfo_t& tagInfo, bool secondaryChannel)
+// The command line a process is started with, a stand-in if processes are simulated
+std::string CommandHandler::_processCommand(const char* name, const std::string& commandStr)
+{
+    if (!_simulateProcesses) {
+        return commandStr;
+    }
+
+    return formatString("sh -c \"echo simulated %s; exec sleep 2147483647\"", name);
+}
+
+// Detection processes are restarted if they die, see _restartPolicy
+std::shared_ptr<MonitoredProcess> CommandHandler::_createProcess(
+                                        const char*                             name,
+                                        const std::string&                      commandStr,
+                                        const std::string&                      logPath,
+                                        MonitoredProcess::ReadyCheck            readyCheck,
+                                        MonitoredProcess::IntermediatePipeType  intermediatePipeType,
+                                        bp::pipe*                               intermediatePipe,
+                                        SchedulingRole                          schedulingRole)
+{
+    auto process = std::make_shared<MonitoredProcess>(
+                                                _mavlink, 
+                                                name, 
+                                                _processCommand(name, commandStr).c_str(), 
+                                                logPath.c_str(), 
+                                                intermediatePipeType,
+                                                intermediatePipe);
+    process->setReadyCheck(readyCheck);
+    process->setSchedulingProfile(_schedulingProfiles[schedulingRole]);
+    process->setCgroup(_cgroups[schedulingRole]);
+    process->setRestartPolicy(_restartPolicy);
+    process->setRestartCallback([this](MonitoredProcess&) { _sendProcessRestarts(); });
+
+    std::lock_guard<std::mutex> lock(_processesMutex);
+    _processes.push_back(process);
+
+    return process;
+}
+
+std::shared_ptr<MonitoredProcess> CommandHandler::_startProcess(
+                                        const char*                             name,
+                                        const std::string&                      commandStr,
+                                        const std::string&                      logPath,
+                                        MonitoredProcess::ReadyCheck            readyCheck,
+                                        MonitoredProcess::IntermediatePipeType  intermediatePipeType,
+                                        bp::pipe*                               intermediatePipe,
+                                        SchedulingRole                          schedulingRole)
+{
+    auto process = _createProcess(name, commandStr, logPath, readyCheck, intermediatePipeType, intermediatePipe, schedulingRole);
+    process->start();
+
+    return process;
+}
+
+// Lists every process which has failed at least once, so the GCS can see how much detection time was lost
+void CommandHandler::_sendProcessRestarts(void)
+{
+    std::vector<std::shared_ptr<MonitoredProcess>> processes;
+
+    {
+        std::lock_guard<std::mutex> lock(_processesMutex);
+
+        std::copy_if(_processes.begin(), _processes.end(), std::back_inserter(processes), [](const std::shared_ptr<MonitoredProcess>& process) {
+            return process->restarts() != 0 || process->restarting() || process->gaveUp();
+        });
+    }
+
+    int processCount    = processes.size();
+    int messageCount    = (processCount + ProcessRestartEntriesPerMessage - 1) / ProcessRestartEntriesPerMessage;
+    auto it             = processes.begin();
+
+    for (int messageIndex=0; messageIndex<messageCount; messageIndex++) {
+        ProcessRestarts_t restarts;
+
+        memset(&restarts, 0, sizeof(restarts));
+
+        restarts.header.command = COMMAND_ID_PROCESS_RESTARTS;
+        restarts.message_index  = messageIndex;
+        restarts.message_count  = messageCount;
+
+        while (it != processes.end() && restarts.process_count < ProcessRestartEntriesPerMessage) {
+            const auto&             process = *it;
+            ProcessRestartEntry_t&  entry   = restarts.processes[restarts.process_count++];
+
+            strncpy(entry.name, process->name().c_str(), sizeof(entry.name));
+            entry.tag_id        = process->tagId();
+            entry.down_msecs    = (uint32_t)std::min(process->downNSecs() / 1000000, (uint64_t)UINT32_MAX);
+            entry.restarts      = (uint16_t)std::min(process->restarts(), (uint32_t)UINT16_MAX);
+            entry.state         = process->gaveUp() ? PROCESS_STATE_GAVE_UP : (process->restarting() ? PROCESS_STATE_RESTARTING : PROCESS_STATE_RUNNING);
+
+            logInfo() << formatString("Process restarts: %s tag: %u restarts: %u down: %.1fs state: %u",
+                                        process->name().c_str(), entry.tag_id, entry.restarts, entry.down_msecs / 1000.0, entry.state);
+
+            it++;
+        }
+
+        _mavlink->sendTunnelMessage(&restarts, sizeof(restarts));
+    }
+}
+
+// Logs the resource use of each process and sends it to the GCS, busiest first after the controller
+void CommandHandler::_sendProcessResources(const std::vector<ProcessSupervisor::ProcessResources_t>& resources)
+{
+    std::vector<ProcessSupervisor::ProcessResources_t> sortedResources = resources;
+
+    if (sortedResources.size() > 1) {
+        std::stable_sort(sortedResources.begin() + 1, sortedResources.end(), [](const auto& a, const auto& b) {
+            return a.cpuPercent > b.cpuPercent;
+        });
+    }
+
+    for (const auto& processResources: sortedResources) {
+        logInfo() << formatString("Process resources: %s tag: %u pid: %d cpu: %.1f%% rss: %.1fMB read: %.1fKB/s write: %.1fKB/s",
+                                    processResources.name.c_str(), processResources.tagId, processResources.pid, processResources.cpuPercent,
+                                    processResources.rssBytes / (1024.0 * 1024.0), processResources.readBytesPerSec / 1024.0, processResources.writeBytesPerSec / 1024.0);
+    }
+
+    _sendCgroupStats();
+
+    if (!_mavlink->gcsSystemId().has_value()) {
+        return;
+    }
+
+    int processCount    = sortedResources.size();
+    int messageCount    = (processCount + ProcessResourceEntriesPerMessage - 1) / ProcessResourceEntriesPerMessage;
+    auto it             = sortedResources.begin();
+
+    for (int messageIndex=0; messageIndex<messageCount; messageIndex++) {
+        ProcessResources_t message;
+
+        memset(&message, 0, sizeof(message));
+
+        message.header.command  = COMMAND_ID_PROCESS_RESOURCES;
+        message.message_index   = messageIndex;
+        message.message_count   = messageCount;
+
+        while (it != sortedResources.end() && message.process_count < ProcessResourceEntriesPerMessage) {
+            ProcessResourceEntry_t& entry = message.processes[message.process_count++];
+
+            strncpy(entry.name, it->name.c_str(), sizeof(entry.name));
+            entry.tag_id            = it->tagId;
+            entry.rss_kb            = (uint32_t)std::min(it->rssBytes / 1024, (uint64_t)UINT32_MAX);
+            entry.cpu_permille      = (uint16_t)std::min(std::lround(it->cpuPercent * 10), (long)UINT16_MAX);
+            entry.read_kb_per_sec   = (uint16_t)std::min(it->readBytesPerSec / 1024, (uint64_t)UINT16_MAX);
+            entry.write_kb_per_sec  = (uint16_t)std::min(it->writeBytesPerSec / 1024, (uint64_t)UINT16_MAX);
+
+            it++;
+        }
+
+        _mavlink->sendTunnelMessage(&message, sizeof(message));
+    }
+}
+
+void CommandHandler::_sendCgroupStats(void)
+{
+    auto cgroupStats = ProcessCgroups::instance()->stats();
+
+    if (cgroupStats.empty()) {
+        return;
+    }
+
+    for (const auto& groupStats: cgroupStats) {
+        logInfo() << formatString("Cgroup stats: %s cpu: %.1fs throttled: %llu of %llu periods %.1fs memory: %.1fMB",
+                                    groupStats.name.c_str(), groupStats.usageUSecs / 1e6,
+                                    (unsigned long long)groupStats.throttledPeriods, (unsigned long long)groupStats.periods,
+                                    groupStats.throttledUSecs / 1e6, groupStats.memoryBytes / (1024.0 * 1024.0));
+    }
+
+    if (!_mavlink->gcsSystemId().has_value()) {
+        return;
+    }
+
+    CgroupStats_t message;
+
+    memset(&message, 0, sizeof(message));
+
+    message.header.command  = COMMAND_ID_CGROUP_STATS;
+    message.group_count     = std::min(cgroupStats.size(), (size_t)CgroupStatsEntryCount);
+
+    for (int i=0; i<message.group_count; i++) {
+        CgroupStatsEntry_t& entry = message.groups[i];
+
+        entry.group             = i;
+        entry.usage_msecs       = (uint32_t)(cgroupStats[i].usageUSecs / 1000);
+        entry.periods           = (uint32_t)cgroupStats[i].periods;
+        entry.throttled_periods = (uint32_t)cgroupStats[i].throttledPeriods;
+        entry.throttled_msecs   = (uint32_t)(cgroupStats[i].throttledUSecs / 1000);
+        entry.memory_kb         = (uint32_t)std::min(cgroupStats[i].memoryBytes / 1024, (uint64_t)UINT32_MAX);
+    }
+
+    _mavlink->sendTunnelMessage(&message, sizeof(message));
+}
+
+// Detectors are ready once their first heartbeat or pulse comes in on the pulse transport
+std::shared_ptr<MonitoredProcess> CommandHandler::_startDetector(LogFileManager* logFileManager, const TunnelProtocol::TagInfo_t& tagInfo, bool secondaryChannel)
 {
     std::string commandStr  = formatString("%s/repos/uavrt_detection/uavrt_detection %s",
                                 _homePath,
@@ -137,15 +374,213 @@ void CommandHandler::_startDetector(LogFileManager* logFileManager, const Tunnel
     std::string root        = formatString("detector_%d", tagInfo.id + (secondaryChannel ? 1 : 0));
     std::string logPath     = logFileManager->filename(root.c_str(), "log");
 
-    MonitoredProcess* detectorProc = new MonitoredProcess(
-                                                _mavlink, 
-                                                "uavrt_detection", 
-                                                commandStr.c_str(), 
-                                                logPath.c_str(), 
-                                                MonitoredProcess::NoPipe,
-                                                NULL);
-    detectorProc->start();  
-    _processes.push_back(detectorProc);
+    auto process = _createProcess("uavrt_detection", commandStr, logPath, MonitoredProcess::ReadyWhenMarked, MonitoredProcess::NoPipe, NULL, SchedulingDetector);
+    process->setTagId(tagInfo.id + (secondaryChannel ? 1 : 0));
+    process->start();
+
+    return process;
+}
+
+// Waits for the processes of a startup stage to become ready. Returns false if one of them exits first, is still not
+// ready at the timeout or STOP_DETECTION cancels the start. readyProbe is called on each poll to mark processes ready
+// from outside.
+bool CommandHandler::_waitForReady(const std::vector<std::shared_ptr<MonitoredProcess>>& stage, uint32_t timeoutMSecs, const std::function<void()>& readyProbe)
+{
+    TraceSpan   span            ("waitForReady");
+    uint64_t    deadlineNSecs   = nsecsMonotonic() + uint64_t(timeoutMSecs) * 1000000;
+
+    while (!_cancelStart) {
+        bool allReady = true;
+
+        if (readyProbe) {
+            readyProbe();
+        }
+
+        for (const auto& process: stage) {
+            switch (process->state()) {
+            case MonitoredProcess::Starting:
+                allReady = false;
+                break;
+            case MonitoredProcess::Ready:
+                break;
+            case MonitoredProcess::Exited:
+                logError() << "Process exited during startup:" << process->name();
+                _mavlink->sendStatusText(formatString("Process exited during startup: %s", process->name().c_str()), MAV_SEVERITY_ERROR);
+                return false;
+            }
+        }
+
+        if (allReady) {
+            return true;
+        }
+
+        if (nsecsMonotonic() >= deadlineNSecs) {
+            for (const auto& process: stage) {
+                if (process->state() == MonitoredProcess::Starting) {
+                    logError() << "Process not ready after" << timeoutMSecs << "msecs:" << process->name();
+                    _mavlink->sendStatusText(formatString("Process not ready: %s", process->name().c_str()), MAV_SEVERITY_ERROR);
+                }
+            }
+            return false;
+        }
+
+        sleepForMSecs(_readyPollMSecs);
+    }
+
+    return false;
+}
+
+// Runs on its own thread. Each stage is started once the stage it depends on is ready, the processes within a stage
+// start in parallel:
+//  sdr         - airspy_rx and csdr-uavrt, or airspyhf_rx_udp: ready on their first output. airspy_rx writes its
+//                samples into the pipe so it is ready once spawned, csdr-uavrt's first output shows data is flowing.
+//  channelizer - airspy_channelize: ready on its first output
+//  detectors   - uavrt_detection per tag channel: ready on their first heartbeat
+// The controller only moves to HEARTBEAT_STATUS_DETECTING once everything is ready.
+void CommandHandler::_startDetectionProcesses(const StartDetectionInfo_t& startDetection)
+{
+    TraceSpan                                       span("startDetectionProcesses");
+    auto                                            logFileManager = LogFileManager::instance();
+    uint64_t                                        startNSecs = nsecsMonotonic();
+    std::vector<std::shared_ptr<MonitoredProcess>>  sdrStage;
+    std::vector<std::shared_ptr<MonitoredProcess>>  detectorStage;
+    std::vector<uint32_t>                           detectorTagIds;
+    std::string                                     commandStr;
+    std::string                                     logPath;
+    std::string                                     airspyChannelizeDir;
+
+    logInfo() << "COMMAND_ID_START_DETECTION:";
+    logInfo() << "\tradio_center_frequency_hz:" << startDetection.radio_center_frequency_hz; 
+    logInfo() << "\tsdr_type:"                  << startDetection.sdr_type; 
+
+    switch (startDetection.sdr_type) {
+    case SDR_TYPE_AIRSPY_MINI:
+        _airspyPipe         = new bp::pipe();
+        airspyChannelizeDir = "airspy_channelize_mini";
+
+        commandStr  = formatString("airspy_rx -f %f -a 3000000 -r /dev/stdout %s", (double)startDetection.radio_center_frequency_hz / 1000000.0, _airspyCmdLine.c_str());
+        logPath     = logFileManager->filename("airspy_rx", "log");
+        sdrStage.push_back(_createProcess("airspy_rx", commandStr, logPath, MonitoredProcess::ReadyWhenSpawned, MonitoredProcess::OutputPipe, _airspyPipe, SchedulingSdr));
+
+        logPath = logFileManager->filename("csdr-uavrt", "log");
+        sdrStage.push_back(_createProcess("csdr-uavrt", "csdr-uavrt fir_decimate_cc 8 0.05 HAMMING", logPath, MonitoredProcess::ReadyOnOutput, MonitoredProcess::InputPipe, _airspyPipe, SchedulingSdr));
+
+        // A sample stream cut off part way through the pipe can't be resumed, if either one dies both are restarted
+        sdrStage[0]->addDependent(sdrStage[1]);
+        sdrStage[1]->addDependent(sdrStage[0]);
+        for (const auto& process: sdrStage) {
+            process->start();
+        }
+        break;
+
+    case SDR_TYPE_AIRSPY_HF:
+        airspyChannelizeDir = "airspy_channelize_hf";
+
+        commandStr  = formatString("airspyhf_rx_udp -u 10000 -f %f -a 192000 -g on -l low", (double)startDetection.radio_center_frequency_hz / 1000000.0);
+        logPath     = logFileManager->filename("airspyhf_rx_udp", "log");
+        sdrStage.push_back(_startProcess("airspyhf_rx_udp", commandStr, logPath, MonitoredProcess::ReadyOnOutput, MonitoredProcess::NoPipe, NULL, SchedulingSdr));
+        break;
+
+    default:
+        logError() << "_handleStartDetection - Unknown sdr type:" << startDetection.sdr_type;
+        _mavlink->sendStatusText("Command failed. Unknown sdr type.", MAV_SEVERITY_ERROR);
+        _stopDetection(NULL);
+        return;
+    }
+
+    bool        ready           = _waitForReady(sdrStage, _processReadyTimeoutMSecs);
+    uint64_t    sdrReadyNSecs   = nsecsMonotonic();
+    uint64_t    channelizerReadyNSecs = sdrReadyNSecs;
+
+    if (ready) {
+        commandStr  = formatString("%s/repos/%s/airspy_channelize %s", _homePath, airspyChannelizeDir.c_str(), _tagDatabase.channelizerCommandLine().c_str());
+        logPath     = logFileManager->filename("airspy_channelize", "log");
+
+        ready                   = _waitForReady({ _startProcess("airspy_channelize", commandStr, logPath, MonitoredProcess::ReadyOnOutput, MonitoredProcess::NoPipe, NULL, SchedulingChannelizer) }, _processReadyTimeoutMSecs);
+        channelizerReadyNSecs   = nsecsMonotonic();
+    }
+
+    if (ready) {
+        if (_detectorPool.empty()) {
+            for (const TunnelProtocol::TagInfo_t& tagInfo: _tagDatabase) {
+                detectorStage.push_back(_startDetector(logFileManager, tagInfo, false /* secondaryChannel */));
+                detectorTagIds.push_back(tagInfo.id);
+                if (tagInfo.intra_pulse2_msecs != 0) {
+                    detectorStage.push_back(_startDetector(logFileManager, tagInfo, true /* secondaryChannel */));
+                    detectorTagIds.push_back(tagInfo.id + 1);
+                }
+            }
+        } else {
+            // From here on a detector which is started again, by a restart or to replace a pooled detector which has
+            // died, has to start running
+            if (!_tagDatabase.writeDetectorConfigs(_receivingTagsSdrType, true /* startInRunState */)) {
+                logError() << "CommandHandler::_startDetectionProcesses: writeDetectorConfigs failed";
+            }
+
+            for (PooledDetector_t& pooledDetector: _detectorPool) {
+                if (pooledDetector.process->state() == MonitoredProcess::Exited) {
+                    logWarn() << "Pooled detector exited, starting a new one:" << pooledDetector.tagInfo.id + (pooledDetector.secondaryChannel ? 1 : 0);
+                    pooledDetector.process->stop();     // Drops a pending restart
+                    pooledDetector.process = _startDetector(logFileManager, pooledDetector.tagInfo, pooledDetector.secondaryChannel);
+                } else {
+                    _sendDetectorRunCommand(pooledDetector);
+                }
+                detectorStage.push_back(pooledDetector.process);
+                detectorTagIds.push_back(pooledDetector.tagInfo.id + (pooledDetector.secondaryChannel ? 1 : 0));
+            }
+        }
+
+        ready = _waitForReady(detectorStage, _detectorReadyTimeoutMSecs, [this, &detectorStage, &detectorTagIds]() {
+            for (size_t i=0; i<detectorStage.size(); i++) {
+                if (_detectorHealth->heardFrom(detectorTagIds[i])) {
+                    detectorStage[i]->markReady();
+                }
+            }
+
+            // The run command is a single datagram, a detector which was still initializing when it was sent missed it
+            uint64_t nowNSecs = nsecsMonotonic();
+            for (PooledDetector_t& pooledDetector: _detectorPool) {
+                if (pooledDetector.process->state() == MonitoredProcess::Starting &&
+                        nowNSecs - pooledDetector.lastRunCommandNSecs >= uint64_t(_runCommandRetryMSecs) * 1000000) {
+                    _sendDetectorRunCommand(pooledDetector);
+                }
+            }
+        });
+        _detectorPool.clear();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_detectionStateMutex);
+
+        // A stop which came in during startup is handled here, once nothing else is being started
+        if (ready && !_cancelStart) {
+            _mavlink->setHeartbeatStatus(HEARTBEAT_STATUS_DETECTING);
+            _detectionTransition = false;
+        } else {
+            ready = false;
+        }
+    }
+
+    if (!ready) {
+        _stopDetection(_cancelStart ? "#Detectors stopped" : "#Detector start failed");
+        return;
+    }
+
+    uint64_t readyNSecs = nsecsMonotonic();
+
+    std::string startedStr = formatString("#All processes started at center hz: %.3f", (double)startDetection.radio_center_frequency_hz / 1000000.0);
+    _mavlink->sendStatusText(startedStr.c_str(), MAV_SEVERITY_INFO);
+
+    std::string startupStr = formatString("Startup %.1fs sdr %.1fs channelizer %.1fs detectors %.1fs",
+                                            (readyNSecs - startNSecs) / 1e9,
+                                            (sdrReadyNSecs - startNSecs) / 1e9,
+                                            (channelizerReadyNSecs - sdrReadyNSecs) / 1e9,
+                                            (readyNSecs - channelizerReadyNSecs) / 1e9);
+    logInfo() << startupStr;
+    _mavlink->sendStatusText(startupStr.c_str(), MAV_SEVERITY_INFO);
+
+    // Write the trace now as well so a slow start can be looked at without stopping detection
+    Trace::instance()->writeTrace();
 }
 
 bool CommandHandler::_handleStartDetection(const mavlink_tunnel_t& tunnel)
@@ -155,137 +590,194 @@ bool CommandHandler::_handleStartDetection(const mavlink_tunnel_t& tunnel)
         return false;
     }
 
-    if (_mavlink->heartbeatStatus() != HEARTBEAT_STATUS_HAS_TAGS) {
-        logError() << "COMMAND_ID_START_DETECTION - ERROR: Start detection failed. Controller in incorrect state - heartbeatStatus" << _mavlink->heartbeatStatus();
-        return false;
+    // A detector pool already set up the session directory and the detector configs
+    bool pooled;
+
+    {
+        std::lock_guard<std::mutex> lock(_detectionStateMutex);
+
+        if (_mavlink->heartbeatStatus() != HEARTBEAT_STATUS_HAS_TAGS || _detectionTransition) {
+            logError() << "COMMAND_ID_START_DETECTION - ERROR: Start detection failed. Controller in incorrect state - heartbeatStatus:detectionTransition" << _mavlink->heartbeatStatus() << _detectionTransition.load();
+            return false;
+        }
+
+        _detectionTransition  = true;
+        _cancelStart        = false;
+        pooled              = !_detectorPool.empty();
     }
 
     auto logFileManager = LogFileManager::instance();
-    logFileManager->detectorsStarted();
-    if (!_tagDatabase.writeDetectorConfigs(_receivingTagsSdrType)) {
-        logError() << "CommandHandler::_handleEndTags: writeDetectorConfigs failed";
-        _mavlink->sendStatusText("Write Detector Configs failed", MAV_SEVERITY_ALERT);
+    if (!pooled) {
+        logFileManager->detectorsStarted();
+    }
+    PulseLatencyStats::instance()->sessionStarted();
+    FlightRecorder::instance()->sessionStarted();
+    Trace::instance()->sessionStarted();
+    _detectorHealth->startMonitoring(_tagDatabase);
+    if (!pooled) {
+        TraceSpan span("writeDetectorConfigs");
+        if (!_tagDatabase.writeDetectorConfigs(_receivingTagsSdrType)) {
+            logError() << "CommandHandler::_handleEndTags: writeDetectorConfigs failed";
+            _mavlink->sendStatusText("Write Detector Configs failed", MAV_SEVERITY_ALERT);
+        }
     }
 
-    std::thread([this, tunnel, logFileManager]() {
-        StartDetectionInfo_t    startDetection;
-        std::string             commandStr;
-        std::string             logPath;
-        std::string             airspyChannelizeDir;
+    StartDetectionInfo_t startDetection;
+
+    memcpy(&startDetection, tunnel.payload, sizeof(startDetection));
+    std::thread(&CommandHandler::_startDetectionProcesses, this, startDetection).detach();
 
-        memcpy(&startDetection, tunnel.payload, sizeof(startDetection));
+    return true;
+}
 
-        logInfo() << "COMMAND_ID_START_DETECTION:";
-        logInfo() << "\tradio_center_frequency_hz:" << startDetection.radio_center_frequency_hz; 
-        logInfo() << "\tsdr_type:"                  << startDetection.sdr_type; 
+// Stops all detection processes and ends the session. Status text is sent at the end if not NULL.
+void CommandHandler::_stopDetection(const char* statusText)
+{
+    {
+        TraceSpan                                       span("stopDetectionProcesses");
+        std::vector<std::shared_ptr<MonitoredProcess>>  processes;
 
-        switch (startDetection.sdr_type) {
-        case SDR_TYPE_AIRSPY_MINI:
+        // Not held while waiting, restart callbacks on the supervisor thread need it
         {
-            _airspyPipe         = new bp::pipe();
-            airspyChannelizeDir = "airspy_channelize_mini";
+            std::lock_guard<std::mutex> lock(_processesMutex);
+            processes = _processes;
+        }
 
-            commandStr  = formatString("airspy_rx -f %f -a 3000000 -r /dev/stdout %s", (double)startDetection.radio_center_frequency_hz / 1000000.0, _airspyCmdLine.c_str());
-            logPath     = logFileManager->filename("airspy_rx", "log");
-            MonitoredProcess* airspyProc = new MonitoredProcess(
-                                                    _mavlink, 
-                                                    "airspy_rx", 
-                                                    commandStr.c_str(), 
-                                                    logPath.c_str(), 
-                                                    MonitoredProcess::OutputPipe,
-                                                    _airspyPipe);
-            airspyProc->start();
-            _processes.push_back(airspyProc);
+        for (const auto& process: processes) {
+            process->stop();
+        }
 
-            logPath = logFileManager->filename("csdr-uavrt", "log");
-            MonitoredProcess* csdrProc = new MonitoredProcess(
-                                                    _mavlink, 
-                                                    "csdr-uavrt", 
-                                                    "csdr-uavrt fir_decimate_cc 8 0.05 HAMMING", 
-                                                    logPath.c_str(), 
-                                                    MonitoredProcess::InputPipe,
-                                                    _airspyPipe);
-            csdrProc->start();
-            _processes.push_back(csdrProc);
+        // Processes which were still being spawned use the airspy pipe
+        uint64_t deadlineNSecs = nsecsMonotonic() + uint64_t(_processExitTimeoutMSecs) * 1000000;
+        for (const auto& process: processes) {
+            while (process->state() != MonitoredProcess::Exited && nsecsMonotonic() < deadlineNSecs) {
+                sleepForMSecs(_readyPollMSecs);
+            }
         }
-            break;
 
-        case SDR_TYPE_AIRSPY_HF:
-        {
-            airspyChannelizeDir = "airspy_channelize_hf";
+        std::lock_guard<std::mutex> lock(_processesMutex);
+        _processes.clear();
+    }
 
-            commandStr  = formatString("airspyhf_rx_udp -u 10000 -f %f -a 192000 -g on -l low", (double)startDetection.radio_center_frequency_hz / 1000000.0);
-            logPath     = logFileManager->filename("airspyhf_rx_udp", "log");
-            MonitoredProcess* airspyProc = new MonitoredProcess(
-                                                    _mavlink, 
-                                                    "airspyhf_rx_udp", 
-                                                    commandStr.c_str(), 
-                                                    logPath.c_str(), 
-                                                    MonitoredProcess::NoPipe,
-                                                    NULL);
-            airspyProc->start();
-            _processes.push_back(airspyProc);
-        }
-            break;
+    delete _airspyPipe;
+    _airspyPipe = NULL;
 
-        default:
-            logError() << "_handleStartDetection - Unknown sdr type:" << startDetection.sdr_type;
-            _mavlink->sendStatusText("Command failed. Unknown sdr type.", MAV_SEVERITY_ERROR);
-            return;
-        }
+    _detectorHealth->stopMonitoring();
 
-        commandStr  = formatString("%s/repos/%s/airspy_channelize %s", _homePath, airspyChannelizeDir.c_str(), _tagDatabase.channelizerCommandLine().c_str());
-        logPath = logFileManager->filename("airspy_channelize", "log");
-        MonitoredProcess* channelizeProc = new MonitoredProcess(
-                                                    _mavlink, 
-                                                    "airspy_channelize", 
-                                                    commandStr.c_str(), 
-                                                    logPath.c_str(), 
-                                                    MonitoredProcess::NoPipe,
-                                                    NULL);
-        channelizeProc->start();
-        _processes.push_back(channelizeProc);
-
-        for (const TunnelProtocol::TagInfo_t& tagInfo: _tagDatabase) {
-            _startDetector(logFileManager, tagInfo, false /* secondaryChannel */);
-            if (tagInfo.intra_pulse2_msecs != 0) {
-                _startDetector(logFileManager, tagInfo, true /* secondaryChannel */);
-            }
+    PulseLatencyStats::instance()->sessionEnded();
+    FlightRecorder::instance()->sessionEnded();
+    Trace::instance()->sessionEnded();
+
+    auto logFileManager = LogFileManager::instance();
+    logFileManager->detectorsStopped();
+
+    {
+        std::lock_guard<std::mutex> lock(_detectionStateMutex);
+
+        // Detectors which have been running are not reused, the pool for the next session starts fresh
+        _detectorPool.clear();
+        _startDetectorPool();
+
+        _mavlink->setHeartbeatStatus(HEARTBEAT_STATUS_HAS_TAGS);
+        _detectionTransition = false;
+    }
+    if (statusText) {
+        _mavlink->sendStatusText(statusText, MAV_SEVERITY_INFO);
+    }
+}
+
+// Starts a paused detector for each tag channel, so START_DETECTION only has to tell them to run. The session log
+// directory is created here because the detector configs and logs go in it. Called with _detectionStateMutex held.
+void CommandHandler::_startDetectorPool(void)
+{
+    if (!_detectorPoolEnabled || _tagDatabase.size() == 0) {
+        return;
+    }
+
+    auto logFileManager = LogFileManager::instance();
+    logFileManager->detectorsStarted();
+
+    if (!_tagDatabase.writeDetectorConfigs(_receivingTagsSdrType, false /* startInRunState */)) {
+        logError() << "CommandHandler::_startDetectorPool: writeDetectorConfigs failed";
+        _mavlink->sendStatusText("Write Detector Configs failed", MAV_SEVERITY_ALERT);
+    }
+
+    for (const TunnelProtocol::TagInfo_t& tagInfo: _tagDatabase) {
+        _detectorPool.push_back({ _startDetector(logFileManager, tagInfo, false /* secondaryChannel */), tagInfo, false, 0 });
+        if (tagInfo.intra_pulse2_msecs != 0) {
+            _detectorPool.push_back({ _startDetector(logFileManager, tagInfo, true /* secondaryChannel */), tagInfo, true, 0 });
         }
+    }
 
-        std::string startedStr = formatString("#All processes started at center hz: %.3f", (double)startDetection.radio_center_frequency_hz / 1000000.0);
-        _mavlink->sendStatusText(startedStr.c_str(), MAV_SEVERITY_INFO);
+    logInfo() << "Detector pool started:" << _detectorPool.size() << "detectors";
+}
 
-        _mavlink->setHeartbeatStatus(HEARTBEAT_STATUS_DETECTING);
-    }).detach();
+// Called with _detectionStateMutex held, while the only processes running are the pooled detectors
+void CommandHandler::_stopDetectorPool(void)
+{
+    if (_detectorPool.empty()) {
+        return;
+    }
 
-    return true;
+    logInfo() << "Detector pool stopped";
+
+    for (const PooledDetector_t& pooledDetector: _detectorPool) {
+        pooledDetector.process->stop();
+    }
+    _detectorPool.clear();
+
+    std::lock_guard<std::mutex> lock(_processesMutex);
+    _processes.clear();
+
+    LogFileManager::instance()->detectorsStopped();
+}
+
+void CommandHandler::_sendDetectorRunCommand(PooledDetector_t& pooledDetector)
+{
+    uint16_t            controlPort = _tagDatabase.detectorControlPort(pooledDetector.tagInfo, pooledDetector.secondaryChannel);
+    int8_t              command     = _detectorRunCommand;
+    struct sockaddr_in  addr        {};
+
+    addr.sin_family         = AF_INET;
+    addr.sin_addr.s_addr    = inet_addr("127.0.0.1");
+    addr.sin_port           = htons(controlPort);
+
+    int fdSocket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fdSocket < 0) {
+        logError() << "CommandHandler::_sendDetectorRunCommand socket failed -" << strerror(errno);
+        return;
+    }
+    if (sendto(fdSocket, &command, sizeof(command), 0, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0) {
+        logError() << "CommandHandler::_sendDetectorRunCommand sendto failed - port:error" << controlPort << strerror(errno);
+    }
+    close(fdSocket);
+
+    pooledDetector.lastRunCommandNSecs = nsecsMonotonic();
 }
 
 bool CommandHandler::_handleStopDetection(void)
 {
     logDebug() << "COMMAND_ID_STOP_DETECTION heartbeatStatus" << _mavlink->heartbeatStatus();
 
+    std::lock_guard<std::mutex> lock(_detectionStateMutex);
+
+    // The startup thread stops everything it has started, a stop already in progress needs nothing more
+    if (_detectionTransition) {
+        logInfo() << "COMMAND_ID_STOP_DETECTION while detectors are starting or stopping";
+        _cancelStart = true;
+        return true;
+    }
+
     if (_mavlink->heartbeatStatus() != HEARTBEAT_STATUS_DETECTING) {
         logError() << "COMMAND_ID_STOP_DETECTION called when not detecting";
         return false;
     }
 
-    std::thread([this]() {
-        for (MonitoredProcess* process: _processes) {
-            process->stop();
-        }
-        _processes.clear();
-
-        delete _airspyPipe;
-        _airspyPipe = NULL;
+    // Keeps a new start out until the stop has finished
+    _detectionTransition = true;
+    _cancelStart = false;
 
-        _mavlink->setHeartbeatStatus(HEARTBEAT_STATUS_HAS_TAGS);
-        _mavlink->sendStatusText("#Detectors stopped", MAV_SEVERITY_INFO);
-
-        auto logFileManager = LogFileManager::instance();
-        logFileManager->detectorsStopped();
-    }).detach();
+    std::thread(&CommandHandler::_stopDetection, this, "#Detectors stopped").detach();
 
     return true;
 }
@@ -327,14 +819,16 @@ bool CommandHandler::_handleRawCapture(const mavlink_tunnel_t& tunnel)
             return;
         }
 
-        MonitoredProcess* airspyProcess = new MonitoredProcess(
+        auto airspyProcess = std::make_shared<MonitoredProcess>(
                                                     _mavlink, 
                                                     "airspy-capture", 
-                                                    commandStr.c_str(), 
+                                                    _processCommand("airspy-capture", commandStr).c_str(), 
                                                     logPath.c_str(), 
                                                     MonitoredProcess::NoPipe,
-                                                    NULL,
+                                                    nullptr,
                                                     true /* rawCaptureProcess */);
+        airspyProcess->setSchedulingProfile(_schedulingProfiles[SchedulingSdr]);
+        airspyProcess->setCgroup(_cgroups[SchedulingSdr]);
         airspyProcess->start();
 
         _mavlink->setHeartbeatStatus(HEARTBEAT_STATUS_CAPTURE);
@@ -358,6 +852,8 @@ void CommandHandler::_handleTunnelMessage(const mavlink_message_t& message)
 
     memcpy(&headerInfo, tunnel.payload, sizeof(headerInfo));
 
+    TraceSpan span("command " + _tunnelCommandIdToString(headerInfo.command));
+
     bool success = false;
     std::string ackMessage;
 
@@ -385,7 +881,10 @@ void CommandHandler::_handleTunnelMessage(const mavlink_message_t& message)
         break;
     }
 
-    _sendCommandAck(headerInfo.command, success ? COMMAND_RESULT_SUCCESS : COMMAND_RESULT_FAILURE, ackMessage);
+    uint32_t result = success ? COMMAND_RESULT_SUCCESS : COMMAND_RESULT_FAILURE;
+
+    FlightRecorder::instance()->recordCommand(headerInfo.command, result, tunnel.payload, tunnel.payload_length);
+    _sendCommandAck(headerInfo.command, result, ackMessage);
 }
 
 std::string CommandHandler::_tunnelCommandIdToString(uint32_t command)
@@ -2,24 +2,60 @@
 
 #include "TunnelProtocol.h"
 #include "TagDatabase.h"
+#include "MonitoredProcess.h"
+#include "ProcessSupervisor.h"
+#include "ProcessCgroups.h"
+#include "SchedulingProfile.h"
 
 #include <boost/process.hpp>
 
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include <mavlink.h>
 
 namespace bp = boost::process;
 
 class MavlinkSystem;
-class MonitoredProcess;
 class LogFileManager;
+class DetectorHealth;
 
 class CommandHandler {
 public:
-    CommandHandler(MavlinkSystem* mavlink);
+    // Which SchedulingProfile_t a detection process is started with
+    enum SchedulingRole {
+        SchedulingSdr,          // airspy_rx and csdr-uavrt, airspyhf_rx_udp, raw captures
+        SchedulingChannelizer,  // airspy_channelize
+        SchedulingDetector,     // uavrt_detection
+        SchedulingRoleCount
+    };
+
+    CommandHandler(MavlinkSystem* mavlink, DetectorHealth* detectorHealth);
+
+    // Detectors are pre-started paused once tags are loaded and only told to run on START_DETECTION
+    void setDetectorPool(bool detectorPool) { _detectorPoolEnabled = detectorPool; }
+
+    // Replaces the default profile, used by processes started from then on
+    void setSchedulingProfile(SchedulingRole schedulingRole, const SchedulingProfile_t& schedulingProfile);
+
+    // Starts stand-ins instead of the SDR, channelizer and detector processes, for running without radio hardware. A
+    // stand-in prints a line and then sleeps until it is stopped, so stages which are ready on output still come up.
+    // Detectors are still only ready once their heartbeats come in, from the load generator for example.
+    void setSimulateProcesses(bool simulateProcesses) { _simulateProcesses = simulateProcesses; }
 
 private:
+    typedef struct {
+        std::shared_ptr<MonitoredProcess>   process;
+        TunnelProtocol::TagInfo_t           tagInfo;
+        bool                                secondaryChannel;
+        uint64_t                            lastRunCommandNSecs;
+    } PooledDetector_t;
+
+
     void _sendCommandAck        (uint32_t command, uint32_t result, std::string& ackMessage);
     bool _handleStartTags       (const mavlink_tunnel_t& tunnel);
     bool _handleEndTags         (void);
@@ -28,18 +64,77 @@ private:
     bool _handleStopDetection   (void);
     bool _handleRawCapture      (const mavlink_tunnel_t& tunnel);
     void _handleTunnelMessage   (const mavlink_message_t& message);
-    void _startDetector         (LogFileManager* logFileManager, const TunnelProtocol::TagInfo_t& tagInfo, bool secondaryChannel);
+    void _startDetectionProcesses(const TunnelProtocol::StartDetectionInfo_t& startDetection);
+    void _stopDetection         (const char* statusText);
+    bool _waitForReady          (const std::vector<std::shared_ptr<MonitoredProcess>>& stage, uint32_t timeoutMSecs, const std::function<void()>& readyProbe = nullptr);
+    void _startDetectorPool     (void);
+    void _stopDetectorPool      (void);
+    void _sendDetectorRunCommand(PooledDetector_t& pooledDetector);
 
+    std::shared_ptr<MonitoredProcess> _startDetector(LogFileManager* logFileManager, const TunnelProtocol::TagInfo_t& tagInfo, bool secondaryChannel);
+    void _sendProcessRestarts   (void);
+    void _sendProcessResources  (const std::vector<ProcessSupervisor::ProcessResources_t>& resources);
+    void _sendCgroupStats       (void);
+
+    std::shared_ptr<MonitoredProcess> _createProcess(const char*                             name,
+                                                     const std::string&                      commandStr,
+                                                     const std::string&                      logPath,
+                                                     MonitoredProcess::ReadyCheck            readyCheck,
+                                                     MonitoredProcess::IntermediatePipeType  intermediatePipeType,
+                                                     bp::pipe*                               intermediatePipe,
+                                                     SchedulingRole                          schedulingRole);
+    std::shared_ptr<MonitoredProcess> _startProcess (const char*                             name,
+                                                     const std::string&                      commandStr,
+                                                     const std::string&                      logPath,
+                                                     MonitoredProcess::ReadyCheck            readyCheck,
+                                                     MonitoredProcess::IntermediatePipeType  intermediatePipeType,
+                                                     bp::pipe*                               intermediatePipe,
+                                                     SchedulingRole                          schedulingRole);
+
+    std::string _processCommand             (const char* name, const std::string& commandStr);
     std::string _tunnelCommandIdToString    (uint32_t command);
     std::string _tunnelCommandResultToString(uint32_t result);
 
 private:
     MavlinkSystem*                  _mavlink;
+    DetectorHealth*                 _detectorHealth;
     TagDatabase                     _tagDatabase;
     bool                            _receivingTags          = false;
     uint32_t                        _receivingTagsSdrType;
     char*                           _homePath               = NULL;
-    std::vector<MonitoredProcess*>  _processes;
+    std::vector<std::shared_ptr<MonitoredProcess>> _processes;              // Protected by _processesMutex
+    std::mutex                      _processesMutex;
     bp::pipe*                       _airspyPipe             = NULL;
     std::string                     _airspyCmdLine;
+    std::mutex                      _detectionStateMutex;                   // Start/stop state changes
+    std::atomic_bool                _detectionTransition    { false };      // Detector processes are being started or stopped
+    std::atomic_bool                _cancelStart            { false };      // STOP_DETECTION came in during startup
+    bool                            _detectorPoolEnabled    = false;
+    bool                            _simulateProcesses      = false;
+    std::vector<PooledDetector_t>   _detectorPool;                          // Paused detectors for the next session
+
+    // The SDR reader and the channelizer each get a core of their own and preempt the detectors, so detector cpu
+    // spikes don't cause sample drops. The detectors share the other two cores with the controller.
+    SchedulingProfile_t             _schedulingProfiles[SchedulingRoleCount] = {
+        { .cpuMask = 0b1000, .policy = SCHED_FIFO,  .priority = 30, .ioClass = SchedulingProfile_t::IoClassBestEffort, .ioLevel = 0 },
+        { .cpuMask = 0b0100, .policy = SCHED_FIFO,  .priority = 20 },
+        { .cpuMask = 0b0011, .policy = SCHED_OTHER, .nice = 5,      .ioClass = SchedulingProfile_t::IoClassBestEffort, .ioLevel = 7 },
+    };
+
+    // Used if ~/cgroups.txt sets up ProcessCgroups
+    static constexpr ProcessCgroups::Group _cgroups[SchedulingRoleCount] = {
+        ProcessCgroups::GroupSdr,
+        ProcessCgroups::GroupChannelizer,
+        ProcessCgroups::GroupDetectors,
+    };
+
+    static constexpr uint32_t _processReadyTimeoutMSecs    = 15000;
+    static constexpr uint32_t _detectorReadyTimeoutMSecs   = 30000;
+    static constexpr uint32_t _processExitTimeoutMSecs     = 5000;
+    static constexpr uint32_t _readyPollMSecs              = 10;
+    static constexpr uint32_t _runCommandRetryMSecs        = 500;
+    static constexpr int8_t   _detectorRunCommand          = 1;        // uavrt_detection control command: 1 run, 0 idle, -1 kill
+
+    // Up to 4 restarts 1, 2, 4 and 8 seconds after a failure, a process which ran for a minute starts counting again
+    static constexpr MonitoredProcess::RestartPolicy_t _restartPolicy = { 5, 1000, 30000, 60 };
 };
@@ -2,6 +2,7 @@
 #include "timeHelpers.h"
 #include "log.h"
 #include "MessageParser.h"
+#include "ReplayCapture.h"
 
 #include <optional>
 
@@ -100,6 +101,7 @@ void Connection::_receiveThreadMain()
 			ssize_t cBytesReceived =_receiveBytes(buffer, sizeof(buffer)); // Note: this blocks when not receiving any data
 
 			if (cBytesReceived > 0) {
+				ReplayCapture::instance()->write(ReplayCapture::SourceMavlink, buffer, cBytesReceived);
 				_parseMavlinkBuffer(buffer, cBytesReceived);
 			}
 #if 0
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "TunnelProtocol.h"
+
+#include <cstdint>
+
+// Tunnel messages sent by the controller which are not part of uavrt_interfaces TunnelProtocol.h.
+// Command ids start at 100 to stay clear of the shared protocol.
+
+#define COMMAND_ID_DETECTOR_HEALTH  100
+#define COMMAND_ID_PROCESS_RESTARTS 101
+#define COMMAND_ID_PROCESS_RESOURCES 102
+#define COMMAND_ID_CGROUP_STATS     103
+
+#define DETECTOR_STATUS_WAITING     0   // Detector has not been heard from yet
+#define DETECTOR_STATUS_OK          1
+#define DETECTOR_STATUS_SILENT      2   // Nothing heard from the detector past its deadline
+
+#define PROCESS_STATE_RUNNING       0
+#define PROCESS_STATE_RESTARTING    1   // Waiting out the restart backoff
+#define PROCESS_STATE_GAVE_UP       2   // Failed too many times in a row, no longer restarted
+
+#define CGROUP_CONTROLLER           0
+#define CGROUP_SDR                  1
+#define CGROUP_CHANNELIZER          2
+#define CGROUP_DETECTORS            3
+
+namespace ControllerTunnelProtocol {
+
+typedef struct {
+    uint32_t    tag_id;
+    float       noise_psd;
+    uint16_t    secs_since_heard;       // 0xFFFF if never heard
+    uint16_t    pulses_per_minute;
+    uint8_t     status;                 // DETECTOR_STATUS_*
+    uint8_t     reserved[3];
+} DetectorHealthEntry_t;
+
+static constexpr int DetectorHealthEntriesPerMessage = 7;
+
+typedef struct {
+    TunnelProtocol::HeaderInfo_t    header;
+    uint8_t                         detector_count;     // Number of valid entries in detectors
+    uint8_t                         message_index;      // Summaries with more detectors are split across messages
+    uint8_t                         message_count;
+    uint8_t                         reserved;
+    DetectorHealthEntry_t           detectors[DetectorHealthEntriesPerMessage];
+} DetectorHealth_t;
+
+static_assert(sizeof(DetectorHealth_t) <= 128, "DetectorHealth_t exceeds tunnel payload size");
+
+// Sent while detecting whenever a process is restarted or given up on. Only processes which have failed at least once
+// are listed.
+typedef struct {
+    char        name[16];               // Not 0 terminated when 16 characters long
+    uint32_t    tag_id;                 // Detector tag id, 0 for the other processes
+    uint32_t    down_msecs;             // Total time spent waiting to be restarted
+    uint16_t    restarts;
+    uint8_t     state;                  // PROCESS_STATE_*
+    uint8_t     reserved;
+} ProcessRestartEntry_t;
+
+static constexpr int ProcessRestartEntriesPerMessage = 4;
+
+typedef struct {
+    TunnelProtocol::HeaderInfo_t    header;
+    uint8_t                         process_count;      // Number of valid entries in processes
+    uint8_t                         message_index;
+    uint8_t                         message_count;
+    uint8_t                         reserved;
+    ProcessRestartEntry_t           processes[ProcessRestartEntriesPerMessage];
+} ProcessRestarts_t;
+
+static_assert(sizeof(ProcessRestarts_t) <= 128, "ProcessRestarts_t exceeds tunnel payload size");
+
+// Sent at the resource sampling interval while detection processes are running. The controller itself is the first
+// entry, the rest are sorted by cpu use.
+typedef struct {
+    char        name[16];               // Not 0 terminated when 16 characters long
+    uint32_t    tag_id;                 // Detector tag id, 0 for the other processes
+    uint32_t    rss_kb;
+    uint16_t    cpu_permille;           // Of one core, so up to 4000 on a four core Pi
+    uint16_t    read_kb_per_sec;        // Storage io
+    uint16_t    write_kb_per_sec;
+    uint16_t    reserved;
+} ProcessResourceEntry_t;
+
+static constexpr int ProcessResourceEntriesPerMessage = 3;
+
+typedef struct {
+    TunnelProtocol::HeaderInfo_t    header;
+    uint8_t                         process_count;      // Number of valid entries in processes
+    uint8_t                         message_index;
+    uint8_t                         message_count;
+    uint8_t                         reserved;
+    ProcessResourceEntry_t          processes[ProcessResourceEntriesPerMessage];
+} ProcessResources_t;
+
+static_assert(sizeof(ProcessResources_t) <= 128, "ProcessResources_t exceeds tunnel payload size");
+
+// Sent along with the process resources when the processes run in cgroups of their own (~/cgroups.txt). The counters
+// are totals since the group was created.
+typedef struct {
+    uint8_t     group;                  // CGROUP_*
+    uint8_t     reserved[3];
+    uint32_t    usage_msecs;
+    uint32_t    periods;                // Only counted while the group has a cpu.max quota
+    uint32_t    throttled_periods;
+    uint32_t    throttled_msecs;
+    uint32_t    memory_kb;
+} CgroupStatsEntry_t;
+
+static constexpr int CgroupStatsEntryCount = 4;
+
+typedef struct {
+    TunnelProtocol::HeaderInfo_t    header;
+    uint8_t                         group_count;        // Number of valid entries in groups
+    uint8_t                         reserved[3];
+    CgroupStatsEntry_t              groups[CgroupStatsEntryCount];
+} CgroupStats_t;
+
+static_assert(sizeof(CgroupStats_t) <= 128, "CgroupStats_t exceeds tunnel payload size");
+
+} // namespace ControllerTunnelProtocol
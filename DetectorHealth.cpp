@@ -0,0 +1,196 @@
+#include "DetectorHealth.h"
+#include "ControllerTunnelProtocol.h"
+#include "MavlinkSystem.h"
+#include "formatString.h"
+#include "timeHelpers.h"
+#include "log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <string.h>
+#include <thread>
+
+using namespace ControllerTunnelProtocol;
+
+DetectorHealth::DetectorHealth(MavlinkSystem* mavlink)
+	: _mavlink(mavlink)
+{
+	std::thread(&DetectorHealth::_summaryThread, this).detach();
+}
+
+double DetectorHealth::_nowSecs() const
+{
+	return nsecsMonotonic() / 1e9;
+}
+
+void DetectorHealth::startMonitoring(const TagDatabase& tagDatabase)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	double nowSecs = _nowSecs();
+
+	_detectors.clear();
+	for (const TunnelProtocol::TagInfo_t& tagInfo: tagDatabase) {
+		_addDetector(tagInfo.id, tagInfo.intra_pulse1_msecs, tagInfo.k, nowSecs);
+		if (tagInfo.intra_pulse2_msecs != 0) {
+			_addDetector(tagInfo.id + 1, tagInfo.intra_pulse2_msecs, tagInfo.k, nowSecs);
+		}
+	}
+}
+
+void DetectorHealth::stopMonitoring()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_detectors.clear();
+}
+
+void DetectorHealth::_addDetector(uint32_t tagId, uint32_t intraPulseMsecs, uint32_t k, double nowSecs)
+{
+	DetectorLiveness_t liveness;
+
+	memset(&liveness, 0, sizeof(liveness));
+
+	// A detector processes K+1 intra pulse intervals of data at a time, so we should hear from it at least that often
+	liveness.deadlineSecs	= std::max(minDeadlineSecs, deadlineFactor * (k + 1) * intraPulseMsecs / 1000.0);
+	liveness.startSecs		= nowSecs;
+	liveness.status			= DETECTOR_STATUS_WAITING;
+
+	logDebug() << "DetectorHealth: monitoring detector" << tagId << "deadline secs" << liveness.deadlineSecs;
+
+	_detectors[tagId] = liveness;
+}
+
+void DetectorHealth::heartbeatReceived(uint32_t tagId, double noisePsd)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto it = _detectors.find(tagId);
+	if (it == _detectors.end()) {
+		return;
+	}
+
+	it->second.lastHeartbeatSecs	= _nowSecs();
+	it->second.noisePsd				= noisePsd;
+}
+
+void DetectorHealth::pulseReceived(uint32_t tagId, double noisePsd)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto it = _detectors.find(tagId);
+	if (it == _detectors.end()) {
+		return;
+	}
+
+	it->second.lastPulseSecs	= _nowSecs();
+	it->second.noisePsd			= noisePsd;
+	it->second.pulseCount++;
+	it->second.intervalPulseCount++;
+}
+
+bool DetectorHealth::heardFrom(uint32_t tagId)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto it = _detectors.find(tagId);
+
+	return it != _detectors.end() && (it->second.lastHeartbeatSecs != 0 || it->second.lastPulseSecs != 0);
+}
+
+void DetectorHealth::_updateLiveness(uint32_t tagId, DetectorLiveness_t& liveness, double nowSecs)
+{
+	double intervalPulsesPerMinute = liveness.intervalPulseCount * 60000.0 / summaryIntervalMSecs;
+
+	liveness.pulsesPerMinute	= pulseRateSmoothing * intervalPulsesPerMinute + (1.0 - pulseRateSmoothing) * liveness.pulsesPerMinute;
+	liveness.intervalPulseCount	= 0;
+
+	double	lastHeardSecs	= std::max(liveness.lastHeartbeatSecs, liveness.lastPulseSecs);
+	uint8_t	newStatus		= liveness.status;
+
+	if (lastHeardSecs == 0) {
+		if (nowSecs - liveness.startSecs > startupGraceSecs + liveness.deadlineSecs) {
+			newStatus = DETECTOR_STATUS_SILENT;
+		}
+	} else if (nowSecs - lastHeardSecs > liveness.deadlineSecs) {
+		newStatus = DETECTOR_STATUS_SILENT;
+	} else {
+		newStatus = DETECTOR_STATUS_OK;
+	}
+
+	if (newStatus == liveness.status) {
+		return;
+	}
+
+	if (newStatus == DETECTOR_STATUS_SILENT) {
+		logWarn() << "DetectorHealth: detector" << tagId << "silent past deadline secs" << liveness.deadlineSecs;
+		_mavlink->sendStatusText(formatString("Detector %u silent", tagId), MAV_SEVERITY_WARNING);
+	} else if (liveness.status == DETECTOR_STATUS_SILENT) {
+		logInfo() << "DetectorHealth: detector" << tagId << "recovered";
+		_mavlink->sendStatusText(formatString("Detector %u recovered", tagId), MAV_SEVERITY_INFO);
+	} else {
+		logInfo() << "DetectorHealth: detector" << tagId << "up";
+	}
+
+	liveness.status = newStatus;
+}
+
+void DetectorHealth::_sendSummary(double nowSecs)
+{
+	int detectorCount	= _detectors.size();
+	int messageCount	= (detectorCount + DetectorHealthEntriesPerMessage - 1) / DetectorHealthEntriesPerMessage;
+	auto it				= _detectors.begin();
+
+	for (int messageIndex=0; messageIndex<messageCount; messageIndex++) {
+		DetectorHealth_t health;
+
+		memset(&health, 0, sizeof(health));
+
+		health.header.command	= COMMAND_ID_DETECTOR_HEALTH;
+		health.message_index	= messageIndex;
+		health.message_count	= messageCount;
+
+		while (it != _detectors.end() && health.detector_count < DetectorHealthEntriesPerMessage) {
+			const DetectorLiveness_t&	liveness		= it->second;
+			DetectorHealthEntry_t&		entry			= health.detectors[health.detector_count++];
+			double						lastHeardSecs	= std::max(liveness.lastHeartbeatSecs, liveness.lastPulseSecs);
+
+			entry.tag_id			= it->first;
+			entry.noise_psd			= liveness.noisePsd;
+			entry.secs_since_heard	= lastHeardSecs == 0 ? UINT16_MAX : (uint16_t)std::min(nowSecs - lastHeardSecs, (double)UINT16_MAX - 1);
+			entry.pulses_per_minute	= (uint16_t)std::lround(std::min(liveness.pulsesPerMinute, (double)UINT16_MAX));
+			entry.status			= liveness.status;
+
+			logDebug() << formatString("DetectorHealth: id: %2u status: %u since heard: %5u ppm: %4u noise_psd: %5.1g",
+										entry.tag_id, entry.status, entry.secs_since_heard, entry.pulses_per_minute, entry.noise_psd);
+
+			it++;
+		}
+
+		_mavlink->sendTunnelMessage(&health, sizeof(health));
+	}
+}
+
+void DetectorHealth::_summaryThread()
+{
+	while (true) {
+		sleepForMSecs(summaryIntervalMSecs);
+
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (_detectors.empty()) {
+			continue;
+		}
+
+		double nowSecs = _nowSecs();
+
+		for (auto& [tagId, liveness]: _detectors) {
+			_updateLiveness(tagId, liveness, nowSecs);
+		}
+
+		if (_mavlink->gcsSystemId().has_value()) {
+			_sendSummary(nowSecs);
+		}
+	}
+}
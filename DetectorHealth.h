@@ -0,0 +1,57 @@
+#pragma once
+
+#include "TagDatabase.h"
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+class MavlinkSystem;
+
+// Liveness table for the running detectors, keyed by detector tag id. Detector heartbeats and pulses are
+// tracked here instead of being forwarded to the GCS one by one. A single aggregated health summary
+// is sent to the GCS at a fixed rate while detectors are running.
+class DetectorHealth
+{
+public:
+	DetectorHealth(MavlinkSystem* mavlink);
+
+	void startMonitoring	(const TagDatabase& tagDatabase);
+	void stopMonitoring		();
+
+	// Thread safe, called from the pulse pipeline
+	void heartbeatReceived	(uint32_t tagId, double noisePsd);
+	void pulseReceived		(uint32_t tagId, double noisePsd);
+
+	// Thread safe. True once a heartbeat or pulse has come in from the detector since monitoring started.
+	bool heardFrom			(uint32_t tagId);
+
+	static constexpr uint64_t	summaryIntervalMSecs	= 2000;
+	static constexpr double		deadlineFactor			= 3.0;	// Silent once nothing heard for this many pulse group windows
+	static constexpr double		minDeadlineSecs			= 10.0;
+	static constexpr double		startupGraceSecs		= 60.0;	// Detectors can take a while to come up after start detection
+	static constexpr double		pulseRateSmoothing		= 0.2;
+
+private:
+	typedef struct {
+		double		deadlineSecs;
+		double		startSecs;
+		double		lastHeartbeatSecs;		// 0 if never
+		double		lastPulseSecs;			// 0 if never
+		double		noisePsd;
+		uint32_t	pulseCount;
+		uint32_t	intervalPulseCount;		// Pulses since the last summary
+		double		pulsesPerMinute;		// Smoothed over summary intervals
+		uint8_t		status;
+	} DetectorLiveness_t;
+
+	void _addDetector		(uint32_t tagId, uint32_t intraPulseMsecs, uint32_t k, double nowSecs);
+	void _summaryThread		();
+	void _updateLiveness	(uint32_t tagId, DetectorLiveness_t& liveness, double nowSecs);
+	void _sendSummary		(double nowSecs);
+	double _nowSecs			() const;
+
+	MavlinkSystem*							_mavlink;
+	std::map<uint32_t, DetectorLiveness_t>	_detectors;
+	std::mutex								_mutex;
+};
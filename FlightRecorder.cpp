@@ -0,0 +1,237 @@
+#include "FlightRecorder.h"
+#include "LogFileManager.h"
+#include "timeHelpers.h"
+#include "log.h"
+
+#include <algorithm>
+#include <mutex>
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+static_assert(sizeof(FlightRecorderHeader_t) == FLIGHT_RECORDER_HEADER_SIZE, "FlightRecorderHeader_t size is part of the file format");
+static_assert(sizeof(FlightRecord_t) == FLIGHT_RECORDER_RECORD_SIZE, "FlightRecord_t size is part of the file format");
+
+FlightRecorder* FlightRecorder::_instance = nullptr;
+
+FlightRecorder* FlightRecorder::instance()
+{
+	static std::once_flag once;
+
+	std::call_once(once, []() { _instance = new FlightRecorder(); });
+
+	return _instance;
+}
+
+void FlightRecorder::sessionStarted()
+{
+	std::unique_lock<std::shared_mutex> lock(_mappingMutex);
+
+	_close();
+
+	_filename = LogFileManager::instance()->filename("flight_recorder", "bin");
+
+	_fd = open(_filename.c_str(), O_CREAT | O_RDWR | O_TRUNC | O_CLOEXEC, 0644);
+	if (_fd < 0) {
+		logError() << "FlightRecorder::sessionStarted open failed" << _filename << strerror(errno);
+		return;
+	}
+
+	// Allocate the blocks up front so appending never has to wait on the file system
+	int error = posix_fallocate(_fd, 0, _fileSize);
+	if (error != 0) {
+		logError() << "FlightRecorder::sessionStarted posix_fallocate failed" << strerror(error);
+		::close(_fd);
+		_fd = -1;
+		return;
+	}
+
+	void* mapping = mmap(nullptr, _fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+	if (mapping == MAP_FAILED) {
+		logError() << "FlightRecorder::sessionStarted mmap failed" << strerror(errno);
+		::close(_fd);
+		_fd = -1;
+		return;
+	}
+
+	_header			= static_cast<FlightRecorderHeader_t*>(mapping);
+	_records		= reinterpret_cast<FlightRecord_t*>(static_cast<uint8_t*>(mapping) + FLIGHT_RECORDER_HEADER_SIZE);
+	_fullReported	= false;
+
+	FlightRecorderHeaderFields_t& fields = _header->fields;
+
+	fields.magic			= FLIGHT_RECORDER_MAGIC;
+	fields.version			= FLIGHT_RECORDER_VERSION;
+	fields.headerSize		= FLIGHT_RECORDER_HEADER_SIZE;
+	fields.recordSize		= FLIGHT_RECORDER_RECORD_SIZE;
+	fields.capacity			= FLIGHT_RECORDER_CAPACITY;
+	fields.indexBlock		= FLIGHT_RECORDER_INDEX_BLOCK;
+	fields.recordCount		= 0;
+	fields.startTimeSeconds	= secondsSinceEpoch();
+
+	logInfo() << "FlightRecorder recording to" << _filename;
+}
+
+void FlightRecorder::sessionEnded()
+{
+	std::unique_lock<std::shared_mutex> lock(_mappingMutex);
+
+	_close();
+}
+
+void FlightRecorder::_close()
+{
+	if (!_header) {
+		return;
+	}
+
+	uint64_t recordCount = std::min<uint64_t>(_header->fields.recordCount, FLIGHT_RECORDER_CAPACITY);
+
+	_header->fields.recordCount = recordCount;
+
+	msync(_header, _fileSize, MS_SYNC);
+	munmap(_header, _fileSize);
+
+	// Give back the unused part of the preallocation
+	if (ftruncate(_fd, FLIGHT_RECORDER_HEADER_SIZE + recordCount * FLIGHT_RECORDER_RECORD_SIZE) != 0) {
+		logWarn() << "FlightRecorder ftruncate failed" << strerror(errno);
+	}
+	::close(_fd);
+
+	logInfo() << "FlightRecorder closed" << _filename << "records:" << recordCount;
+
+	_fd			= -1;
+	_header		= nullptr;
+	_records	= nullptr;
+}
+
+FlightRecord_t* FlightRecorder::_reserveRecord(void)
+{
+	uint64_t recordIndex = __atomic_fetch_add(&_header->fields.recordCount, 1, __ATOMIC_RELAXED);
+
+	if (recordIndex >= FLIGHT_RECORDER_CAPACITY) {
+		if (!_fullReported.exchange(true)) {
+			logWarn() << "FlightRecorder full, further records dropped:" << _filename;
+		}
+		return nullptr;
+	}
+
+	FlightRecord_t* record = &_records[recordIndex];
+
+	record->timeSeconds = secondsSinceEpoch();
+	if (recordIndex % FLIGHT_RECORDER_INDEX_BLOCK == 0) {
+		_header->fields.indexTimeSeconds[recordIndex / FLIGHT_RECORDER_INDEX_BLOCK] = record->timeSeconds;
+	}
+
+	return record;
+}
+
+void FlightRecorder::_commitRecord(FlightRecord_t* record, uint8_t type)
+{
+	__atomic_store_n(&record->type, type, __ATOMIC_RELEASE);
+}
+
+void FlightRecorder::recordPulse(const TunnelProtocol::PulseInfo_t& pulseInfo)
+{
+	std::shared_lock<std::shared_mutex> lock(_mappingMutex);
+
+	if (!_header) {
+		return;
+	}
+
+	FlightRecord_t* record = _reserveRecord();
+	if (!record) {
+		return;
+	}
+
+	FlightPulseRecord_t& pulse = record->u.pulse;
+
+	pulse.tagId						= pulseInfo.tag_id;
+	pulse.frequencyHz				= pulseInfo.frequency_hz;
+	pulse.startTimeSeconds			= pulseInfo.start_time_seconds;
+	pulse.predictNextStartSeconds	= pulseInfo.predict_next_start_seconds;
+	pulse.snr						= pulseInfo.snr;
+	pulse.stftScore					= pulseInfo.stft_score;
+	pulse.groupSnr					= pulseInfo.group_snr;
+	pulse.noisePsd					= pulseInfo.noise_psd;
+	pulse.groupSeqCounter			= pulseInfo.group_seq_counter;
+	pulse.groupInd					= pulseInfo.group_ind;
+	pulse.detectionStatus			= pulseInfo.detection_status;
+	pulse.confirmedStatus			= pulseInfo.confirmed_status;
+	pulse.latitude					= pulseInfo.position_x;
+	pulse.longitude					= pulseInfo.position_y;
+	pulse.relativeAltitude			= pulseInfo.position_z;
+	pulse.rollDegrees				= pulseInfo.orientation_x;
+	pulse.pitchDegrees				= pulseInfo.orientation_y;
+	pulse.yawDegrees				= pulseInfo.orientation_z;
+
+	_commitRecord(record, FLIGHT_RECORD_PULSE);
+}
+
+void FlightRecorder::recordPosition(const Telemetry::Position_t& position, uint32_t timeBootMs)
+{
+	std::shared_lock<std::shared_mutex> lock(_mappingMutex);
+
+	if (!_header) {
+		return;
+	}
+
+	FlightRecord_t* record = _reserveRecord();
+	if (!record) {
+		return;
+	}
+
+	record->u.position.latitude			= position.latitude;
+	record->u.position.longitude		= position.longitude;
+	record->u.position.relativeAltitude	= position.relativeAltitude;
+	record->u.position.timeBootMs		= timeBootMs;
+
+	_commitRecord(record, FLIGHT_RECORD_POSITION);
+}
+
+void FlightRecorder::recordAttitude(const Telemetry::EulerAngle_t& attitude, uint32_t timeBootMs)
+{
+	std::shared_lock<std::shared_mutex> lock(_mappingMutex);
+
+	if (!_header) {
+		return;
+	}
+
+	FlightRecord_t* record = _reserveRecord();
+	if (!record) {
+		return;
+	}
+
+	record->u.attitude.rollDegrees	= attitude.rollDegrees;
+	record->u.attitude.pitchDegrees	= attitude.pitchDegrees;
+	record->u.attitude.yawDegrees	= attitude.yawDegrees;
+	record->u.attitude.timeBootMs	= timeBootMs;
+
+	_commitRecord(record, FLIGHT_RECORD_ATTITUDE);
+}
+
+void FlightRecorder::recordCommand(uint32_t command, uint32_t result, const uint8_t* payload, uint32_t payloadLength)
+{
+	std::shared_lock<std::shared_mutex> lock(_mappingMutex);
+
+	if (!_header) {
+		return;
+	}
+
+	FlightRecord_t* record = _reserveRecord();
+	if (!record) {
+		return;
+	}
+
+	FlightCommandRecord_t& commandRecord = record->u.command;
+
+	commandRecord.command		= command;
+	commandRecord.result		= result;
+	commandRecord.payloadLength	= payloadLength;
+	memcpy(commandRecord.payload, payload, std::min<size_t>(payloadLength, sizeof(commandRecord.payload)));
+
+	_commitRecord(record, FLIGHT_RECORD_COMMAND);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "FlightRecorderFormat.h"
+#include "Telemetry.h"
+#include "TunnelProtocol.h"
+
+#include <atomic>
+#include <shared_mutex>
+#include <string>
+
+// Appends pulses, telemetry samples and commands as fixed size binary records to a preallocated, memory
+// mapped file in the session log directory (see FlightRecorderFormat.h). Writers only reserve a slot and
+// copy a record into the mapping, so recording is cheap enough to do from the pulse pipeline. Use
+// FlightRecorderDecode to export a recording to CSV.
+class FlightRecorder
+{
+public:
+	static FlightRecorder* instance();
+
+	void sessionStarted		();
+	void sessionEnded		();
+
+	// Thread safe. Records are dropped while no session is running.
+	void recordPulse		(const TunnelProtocol::PulseInfo_t& pulseInfo);
+	void recordPosition		(const Telemetry::Position_t& position, uint32_t timeBootMs);
+	void recordAttitude		(const Telemetry::EulerAngle_t& attitude, uint32_t timeBootMs);
+	void recordCommand		(uint32_t command, uint32_t result, const uint8_t* payload, uint32_t payloadLength);
+
+private:
+	FlightRecorder() = default;
+
+	FlightRecord_t*	_reserveRecord	(void);
+	void			_commitRecord	(FlightRecord_t* record, uint8_t type);
+	void			_close			(void);
+
+	std::shared_mutex		_mappingMutex;		// Shared by writers, exclusive while opening/closing the file
+	int						_fd					= -1;
+	std::string				_filename;
+	FlightRecorderHeader_t*	_header				= nullptr;
+	FlightRecord_t*			_records			= nullptr;
+	std::atomic_bool		_fullReported		{ false };
+
+	static FlightRecorder*	_instance;
+	static constexpr size_t	_fileSize			= FLIGHT_RECORDER_HEADER_SIZE + (size_t)FLIGHT_RECORDER_CAPACITY * FLIGHT_RECORDER_RECORD_SIZE;
+};
@@ -0,0 +1,122 @@
+/*
+ * Binary flight recorder file written by MavlinkTagController2 into each session log directory.
+ *
+ * This header is plain C so offline tools can read recordings without the controller sources:
+ *
+ *     [FlightRecorderHeader_t - FLIGHT_RECORDER_HEADER_SIZE bytes]
+ *     [FlightRecord_t 0]
+ *     [FlightRecord_t 1]
+ *     ...
+ *
+ * The file is preallocated for FLIGHT_RECORDER_CAPACITY records and truncated to the records actually
+ * used when the session ends. A record's type is written last, so a record with type FLIGHT_RECORD_NONE
+ * was never completed (for example the controller died mid write) and should be skipped.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#define FLIGHT_RECORDER_MAGIC           0x52564155u    /* "UAVR" */
+#define FLIGHT_RECORDER_VERSION         1u
+#define FLIGHT_RECORDER_HEADER_SIZE     4096u
+#define FLIGHT_RECORDER_RECORD_SIZE     128u
+#define FLIGHT_RECORDER_CAPACITY        262144u        /* 32 MB of records */
+#define FLIGHT_RECORDER_INDEX_BLOCK     1024u          /* Records per index entry */
+#define FLIGHT_RECORDER_INDEX_CAPACITY  (FLIGHT_RECORDER_CAPACITY / FLIGHT_RECORDER_INDEX_BLOCK)
+
+#define FLIGHT_RECORD_NONE      0
+#define FLIGHT_RECORD_PULSE     1
+#define FLIGHT_RECORD_POSITION  2
+#define FLIGHT_RECORD_ATTITUDE  3
+#define FLIGHT_RECORD_COMMAND   4
+
+typedef struct {
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    headerSize;
+    uint32_t    recordSize;
+    uint32_t    capacity;
+    uint32_t    indexBlock;
+    uint64_t    recordCount;        /* Records reserved by writers, may include a trailing incomplete record */
+    double      startTimeSeconds;   /* Seconds since epoch the recording was started */
+    uint8_t     reserved[24];
+    double      indexTimeSeconds[FLIGHT_RECORDER_INDEX_CAPACITY];  /* Time of the first record in each index block */
+} FlightRecorderHeaderFields_t;
+
+typedef union {
+    FlightRecorderHeaderFields_t    fields;
+    uint8_t                         raw[FLIGHT_RECORDER_HEADER_SIZE];
+} FlightRecorderHeader_t;
+
+typedef struct {
+    uint32_t    tagId;
+    uint32_t    frequencyHz;
+    double      startTimeSeconds;
+    double      predictNextStartSeconds;
+    double      snr;
+    double      stftScore;
+    double      groupSnr;
+    double      noisePsd;
+    uint16_t    groupSeqCounter;
+    uint16_t    groupInd;
+    uint8_t     detectionStatus;
+    uint8_t     confirmedStatus;
+    uint16_t    reserved;
+    double      latitude;
+    double      longitude;
+    double      relativeAltitude;
+    float       rollDegrees;
+    float       pitchDegrees;
+    float       yawDegrees;
+    float       reserved2;
+} FlightPulseRecord_t;
+
+typedef struct {
+    double      latitude;
+    double      longitude;
+    double      relativeAltitude;
+    uint32_t    timeBootMs;
+} FlightPositionRecord_t;
+
+typedef struct {
+    float       rollDegrees;
+    float       pitchDegrees;
+    float       yawDegrees;
+    uint32_t    timeBootMs;
+} FlightAttitudeRecord_t;
+
+typedef struct {
+    uint32_t    command;            /* Tunnel COMMAND_ID_* */
+    uint32_t    result;             /* COMMAND_RESULT_* sent back in the ack */
+    uint32_t    payloadLength;      /* Full tunnel payload length, payload below may be truncated */
+    uint32_t    reserved;
+    uint8_t     payload[96];
+} FlightCommandRecord_t;
+
+typedef struct {
+    uint8_t     type;               /* FLIGHT_RECORD_*, written last */
+    uint8_t     reserved[7];
+    double      timeSeconds;        /* Seconds since epoch the record was written */
+    union {
+        FlightPulseRecord_t     pulse;
+        FlightPositionRecord_t  position;
+        FlightAttitudeRecord_t  attitude;
+        FlightCommandRecord_t   command;
+        uint8_t                 raw[FLIGHT_RECORDER_RECORD_SIZE - 16];
+    } u;
+} FlightRecord_t;
+
+/* Returns the index of the first record block which may contain records at or after timeSeconds */
+static inline uint64_t flightRecorderFirstRecordForTime(const FlightRecorderHeader_t* header, double timeSeconds)
+{
+    uint64_t recordCount    = header->fields.recordCount < header->fields.capacity ? header->fields.recordCount : header->fields.capacity;
+    uint64_t blockCount     = (recordCount + header->fields.indexBlock - 1) / header->fields.indexBlock;
+    uint64_t block          = 0;
+
+    /* Records from different sources are not strictly time ordered, so step back one block for safety */
+    while (block + 1 < blockCount && header->fields.indexTimeSeconds[block + 1] <= timeSeconds) {
+        block++;
+    }
+
+    return block == 0 ? 0 : (block - 1) * header->fields.indexBlock;
+}
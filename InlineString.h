@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// String with Capacity bytes of storage inside the object. It only touches the heap once it grows past that, so log
+// records and other per pulse text can be built and passed between threads without allocating. Moving an inline
+// string copies its bytes, moving an overflowed one hands over the heap buffer.
+template<size_t Capacity>
+class InlineString
+{
+public:
+	InlineString() = default;
+
+	InlineString(const InlineString& other)
+	{
+		append(other.data(), other.size());
+	}
+
+	InlineString(InlineString&& other) noexcept
+	{
+		*this = std::move(other);
+	}
+
+	InlineString& operator=(const InlineString& other)
+	{
+		if (this != &other) {
+			clear();
+			append(other.data(), other.size());
+		}
+		return *this;
+	}
+
+	InlineString& operator=(InlineString&& other) noexcept
+	{
+		if (this != &other) {
+			if (other._overflowed) {
+				_overflow	= std::move(other._overflow);
+				_overflowed	= true;
+			} else {
+				// An overflow buffer left from earlier is kept, clear() doesn't release it either
+				memcpy(_inline, other._inline, other._size);
+				_size		= other._size;
+				_overflowed	= false;
+			}
+			other.clear();
+		}
+		return *this;
+	}
+
+	void append(const char* data, size_t length)
+	{
+		if (!_overflowed) {
+			if (_size + length <= Capacity) {
+				memcpy(_inline + _size, data, length);
+				_size += length;
+				return;
+			}
+			_overflow.assign(_inline, _size);
+			_overflowed = true;
+		}
+		_overflow.append(data, length);
+	}
+
+	void push_back	(char c)				{ append(&c, 1); }
+	void append		(std::string_view text)	{ append(text.data(), text.length()); }
+
+	void clear()
+	{
+		_size		= 0;
+		_overflowed	= false;
+		_overflow.clear();
+	}
+
+	const char*			data		() const { return _overflowed ? _overflow.data() : _inline; }
+	size_t				size		() const { return _overflowed ? _overflow.size() : _size; }
+	bool				empty		() const { return size() == 0; }
+	bool				overflowed	() const { return _overflowed; }
+	std::string_view	view		() const { return std::string_view(data(), size()); }
+
+	static constexpr size_t capacity() { return Capacity; }
+
+private:
+	char		_inline[Capacity];
+	uint32_t	_size		= 0;
+	bool		_overflowed	= false;
+	std::string	_overflow;
+};
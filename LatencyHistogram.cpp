@@ -0,0 +1,85 @@
+#include "LatencyHistogram.h"
+#include "formatString.h"
+
+#include <algorithm>
+
+int LatencyHistogram::_bucketIndex(uint64_t valueUSecs)
+{
+	if (valueUSecs < _subBucketCount) {
+		return int(valueUSecs);
+	}
+
+	int msb		= 63 - __builtin_clzll(valueUSecs);
+	int shift	= msb - (_subBucketBits - 1);
+
+	if (shift > _maxShift) {
+		return _bucketCount - 1;
+	}
+
+	return shift * _subBucketHalf + int(valueUSecs >> shift);
+}
+
+uint64_t LatencyHistogram::_bucketUpperValue(int index)
+{
+	if (index < _subBucketCount) {
+		return uint64_t(index);
+	}
+
+	int shift = index / _subBucketHalf - 1;
+
+	return ((uint64_t(index - shift * _subBucketHalf) + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t valueUSecs)
+{
+	_counts[_bucketIndex(valueUSecs)]++;
+	_count++;
+	_sumUSecs += valueUSecs;
+	if (valueUSecs < _minUSecs) {
+		_minUSecs = valueUSecs;
+	}
+	if (valueUSecs > _maxUSecs) {
+		_maxUSecs = valueUSecs;
+	}
+}
+
+void LatencyHistogram::reset()
+{
+	*this = LatencyHistogram();
+}
+
+uint64_t LatencyHistogram::percentile(double percentile) const
+{
+	if (_count == 0) {
+		return 0;
+	}
+
+	uint64_t countAtPercentile	= uint64_t(percentile / 100.0 * _count + 0.5);
+	uint64_t cumulativeCount	= 0;
+
+	if (countAtPercentile == 0) {
+		countAtPercentile = 1;
+	}
+
+	for (int i=0; i<_bucketCount; i++) {
+		cumulativeCount += _counts[i];
+		if (cumulativeCount >= countAtPercentile) {
+			// Clamp to the exact max so high percentiles never report more than was actually seen
+			return std::min(_bucketUpperValue(i), _maxUSecs);
+		}
+	}
+
+	return _maxUSecs;
+}
+
+std::string LatencyHistogram::summary() const
+{
+	return formatString("count: %7llu min: %9.3f p50: %9.3f p90: %9.3f p99: %9.3f p99.9: %9.3f max: %9.3f ms",
+						(unsigned long long)_count,
+						minUSecs() / 1000.0,
+						percentile(50) / 1000.0,
+						percentile(90) / 1000.0,
+						percentile(99) / 1000.0,
+						percentile(99.9) / 1000.0,
+						maxUSecs() / 1000.0);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+// HDR style histogram of latencies in microseconds. Buckets are log-linear: each power of two range is split
+// into 16 linear sub-buckets, giving ~6% worst case precision from 1 usec up to ~25 days with a fixed 5KB footprint.
+class LatencyHistogram
+{
+public:
+	LatencyHistogram() = default;
+
+	void		record		(uint64_t valueUSecs);
+	void		reset		();
+	uint64_t	count		() const { return _count; }
+	uint64_t	minUSecs	() const { return _count ? _minUSecs : 0; }
+	uint64_t	maxUSecs	() const { return _maxUSecs; }
+	double		meanUSecs	() const { return _count ? double(_sumUSecs) / _count : 0; }
+	uint64_t	percentile	(double percentile) const;	// percentile in 0-100
+
+	// One line summary: count, min, p50, p90, p99, p99.9 and max in msecs
+	std::string summary() const;
+
+private:
+	static constexpr int _subBucketBits		= 5;
+	static constexpr int _subBucketCount	= 1 << _subBucketBits;
+	static constexpr int _subBucketHalf		= _subBucketCount / 2;
+	static constexpr int _maxShift			= 36;
+	static constexpr int _bucketCount		= (_maxShift + 1) * _subBucketHalf + _subBucketHalf;
+
+	static int		_bucketIndex		(uint64_t valueUSecs);
+	static uint64_t	_bucketUpperValue	(int index);
+
+	std::array<uint64_t, _bucketCount>	_counts		{};
+	uint64_t							_count		{ 0 };
+	uint64_t							_sumUSecs	{ 0 };
+	uint64_t							_minUSecs	{ UINT64_MAX };
+	uint64_t							_maxUSecs	{ 0 };
+};
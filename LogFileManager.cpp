@@ -1,9 +1,17 @@
 #include "LogFileManager.h"
 #include "formatString.h"
 #include "log.h"
+#include "timeHelpers.h"
+#include "SchedulingProfile.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iomanip>
+#include <thread>
+#include <tuple>
+#include <vector>
 
 #include <boost/filesystem.hpp>
 #include <boost/system/error_code.hpp>
@@ -16,34 +24,76 @@ const char* 	LogFileManager::_logDirPrefix   = "Logs";
 
 LogFileManager* LogFileManager::instance()
 {
-    if (_instance == nullptr) {
-        _instance = new LogFileManager();
-    }
+    static std::once_flag once;
+
+    std::call_once(once, []() { _instance = new LogFileManager(); });
+
     return _instance;
 }
 
 LogFileManager::LogFileManager()
 {
     _homeDir = std::string(getenv("HOME"));
+
+    std::thread(&LogFileManager::_diskBudgetThread, this).detach();
 }
 
-void LogFileManager::detectorsStarted()
+// Walking the log directories and deleting a session can take a while on the SD card, so it stays off the log writer
+// and out of the way of everything else
+void LogFileManager::_diskBudgetThread()
 {
-    _detectorsRunning = true;
+    SchedulingProfile_t backgroundProfile;
+
+    backgroundProfile.policy    = SCHED_OTHER;
+    backgroundProfile.nice      = 19;
+    backgroundProfile.ioClass   = SchedulingProfile_t::IoClassIdle;
+    applySchedulingProfile(backgroundProfile);
+
+    while (true) {
+        // Real time since a simulated clock may be stopped
+        std::this_thread::sleep_for(std::chrono::milliseconds(diskBudgetIntervalMSecs));
+
+        // Older sessions are removed as this one grows
+        if (_detectorsRunning) {
+            enforceDiskBudget();
+        }
+    }
+}
 
-    auto now_time_t = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+void LogFileManager::detectorsStarted()
+{
+    time_t now_time_t = msecsSinceEpoch() / 1000;
     auto now_utc    = *std::gmtime(&now_time_t);
 
     char buffer[80];
     std::strftime(buffer, sizeof(buffer), "%Y-%m-%d_%H-%M", &now_utc);
 
-    _logDir = formatString("%s/%s-%s", _homeDir.c_str(), _logDirPrefix, buffer);
+    // Make room for the new session before it starts writing
+    enforceDiskBudget();
+
+    std::string logDir = formatString("%s/%s-%s", _homeDir.c_str(), _logDirPrefix, buffer);
 
+    // A session started within the same minute as the last one gets its own directory. This is common with a detector
+    // pool, which sets up the next session straight after a stop.
     bs::error_code errorCode;
-    bf::create_directory(_logDir.c_str(), errorCode);
+    for (uint32_t suffix=2; bf::exists(logDir, errorCode); suffix++) {
+        logDir = formatString("%s/%s-%s-%u", _homeDir.c_str(), _logDirPrefix, buffer, suffix);
+    }
+
+    bf::create_directory(logDir.c_str(), errorCode);
     if (errorCode) {
-        logDebug() << "Failed to create directory " << _logDir << ": " << errorCode.message();
+        logDebug() << "Failed to create directory " << logDir << ": " << errorCode.message();
     }
+
+    {
+        std::lock_guard<std::mutex> lock(_logDirMutex);
+        _logDir = logDir;
+    }
+
+    // Set last so log records flagged for the session file only see the new directory. The session changes even if
+    // detectorsStopped() wasn't seen by any log record in between, so the log writer still moves to the new directory.
+    _session++;
+    _detectorsRunning = true;
 }
 
 void LogFileManager::detectorsStopped()
@@ -51,7 +101,82 @@ void LogFileManager::detectorsStopped()
     _detectorsRunning = false;
 }
 
+std::string LogFileManager::logDir()
+{
+    std::lock_guard<std::mutex> lock(_logDirMutex);
+
+    return _logDir;
+}
+
 std::string LogFileManager::filename(const char* root, const char* extension)
 {
-    return formatString("%s/%s.%s", _logDir.c_str(), root, extension);
+    return formatString("%s/%s.%s", logDir().c_str(), root, extension);
+}
+
+void LogFileManager::enforceDiskBudget()
+{
+    uint64_t diskBudgetBytes = _diskBudgetBytes;
+
+    if (diskBudgetBytes == 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_budgetMutex);
+
+    typedef struct {
+        bf::path    path;
+        std::string date;       // Directory name up to the minute the session started
+        uint32_t    suffix;     // Sessions started within the same minute, the first one has none
+        uint64_t    bytes;
+    } SessionDir_t;
+
+    std::vector<SessionDir_t>   sessionDirs;
+    uint64_t                    totalBytes = 0;
+    bs::error_code              errorCode;
+    std::string                 prefix = std::string(_logDirPrefix) + "-";
+    bf::path                    currentLogDir(logDir());
+    size_t                      dateLength = prefix.length() + std::strlen("YYYY-MM-DD_HH-MM");
+
+    for (bf::directory_iterator it(_homeDir, errorCode), end; !errorCode && it != end; it.increment(errorCode)) {
+        if (!it->path().filename().string().starts_with(prefix) || !bf::is_directory(it->path(), errorCode)) {
+            continue;
+        }
+
+        std::string     name        = it->path().filename().string();
+        SessionDir_t    sessionDir  { it->path(), name.substr(0, dateLength), 1, 0 };
+
+        if (name.length() > dateLength + 1) {
+            sessionDir.suffix = std::strtoul(name.c_str() + dateLength + 1, nullptr, 10);
+        }
+
+        for (bf::recursive_directory_iterator fileIt(it->path(), errorCode), fileEnd; !errorCode && fileIt != fileEnd; fileIt.increment(errorCode)) {
+            if (bf::is_regular_file(fileIt->path(), errorCode)) {
+                sessionDir.bytes += bf::file_size(fileIt->path(), errorCode);
+            }
+        }
+        totalBytes += sessionDir.bytes;
+        sessionDirs.push_back(sessionDir);
+    }
+
+    // Oldest first. Dates sort as text, but the suffix has to be compared as a number or -10 would come before -2.
+    std::sort(sessionDirs.begin(), sessionDirs.end(), [](const SessionDir_t& a, const SessionDir_t& b) {
+        return std::tie(a.date, a.suffix) < std::tie(b.date, b.suffix);
+    });
+
+    for (const SessionDir_t& sessionDir: sessionDirs) {
+        if (totalBytes <= diskBudgetBytes) {
+            break;
+        }
+        if (_detectorsRunning && sessionDir.path == currentLogDir) {
+            continue;
+        }
+
+        bf::remove_all(sessionDir.path, errorCode);
+        if (errorCode) {
+            logWarn() << "LogFileManager: failed to remove" << sessionDir.path.string() << errorCode.message();
+            continue;
+        }
+        logInfo() << "LogFileManager: removed" << sessionDir.path.string() << "to stay within the log disk budget";
+        totalBytes -= sessionDir.bytes;
+    }
 }
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <mutex>
 #include <string>
 
 class LogFileManager
@@ -10,16 +13,39 @@ public:
 	void 		detectorsStarted();
 	void 		detectorsStopped();
     bool        detectorsRunning() const { return _detectorsRunning; }
+    uint32_t    session() const { return _session; }    // Incremented by each detectorsStarted()
 
 	std::string filename(const char* root, const char* extension);
-	std::string logDir() const { return _logDir; }
+	std::string logDir();
+
+    // Size cap for each log file in a session directory, see RotatingFile
+    void        setMaxFileBytes (uint64_t maxFileBytes) { _maxFileBytes = maxFileBytes; }
+    uint64_t    maxFileBytes    () const { return _maxFileBytes; }
+    uint32_t    maxRotations    () const { return _maxRotations; }
+
+    // Oldest session directories are deleted once all Logs-* directories together go over the budget. 0 for no limit.
+    // Checked when a session starts and, from a low priority thread of its own, every diskBudgetIntervalMSecs while it
+    // runs.
+    void        setDiskBudgetBytes  (uint64_t diskBudgetBytes) { _diskBudgetBytes = diskBudgetBytes; }
+    void        enforceDiskBudget   ();
+
+    static constexpr uint32_t diskBudgetIntervalMSecs = 10000;
 
 private:
 	LogFileManager();
+
+    void _diskBudgetThread();
 	
 	std::string _homeDir;
-	std::string _logDir;
-    bool        _detectorsRunning = false;
+	std::string _logDir;                            // Protected by _logDirMutex, read from any thread
+    std::mutex  _logDirMutex;
+    std::atomic_bool _detectorsRunning { false };    // Read by logging threads
+    std::atomic_uint32_t _session { 0 };
+
+    std::atomic_uint64_t    _maxFileBytes       { 16ull * 1024 * 1024 };
+    uint32_t                _maxRotations       = 3;
+    std::atomic_uint64_t    _diskBudgetBytes    { 2048ull * 1024 * 1024 };
+    std::mutex              _budgetMutex;
 
 	static LogFileManager* 	_instance;
 	static const char* 		_logDirPrefix;
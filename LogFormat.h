@@ -0,0 +1,147 @@
+/*
+ * Binary log file written by MavlinkTagController2 into each session log directory when started with
+ * --log-format:binary. Expand it to text with tools/LogDecode.
+ *
+ * This header is plain C so offline tools can read logs without the controller sources:
+ *
+ *     [LogFileHeader_t]
+ *     [entry 0]
+ *     [entry 1]
+ *     ...
+ *
+ * Every entry starts with its LOG_ENTRY_* type byte. Integers are LEB128 varints, signed values are zigzag encoded
+ * first and doubles are 8 little endian bytes.
+ *
+ *     LOG_ENTRY_SITE      varint siteId, uint8 level, varint line, varint length, file name bytes
+ *     LOG_ENTRY_RECORD    varint siteId, zigzag varint microseconds since the previous record (or the file start),
+ *                         varint length, argument bytes
+ *
+ * A call site's entry is written before its first record in the file. Arguments are a sequence of LOG_ARG_* type
+ * bytes each followed by its value. LOG_ARG_REPEAT stands for the same string as the last string argument at the same
+ * position of the same call site, so the literal text of a log call is only stored once per file. A record is text
+ * joined by spaces followed by "(file:line)", the same as the text log. A truncated entry at the end of the file
+ * means the controller stopped mid write and can be ignored.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#define LOG_FILE_MAGIC      0x4c564155u     /* "UAVL" */
+#define LOG_FILE_VERSION    1u
+
+#define LOG_ENTRY_SITE      1
+#define LOG_ENTRY_RECORD    2
+
+#define LOG_ARG_INT         1
+#define LOG_ARG_UINT        2
+#define LOG_ARG_DOUBLE      3
+#define LOG_ARG_STRING      4
+#define LOG_ARG_REPEAT      5
+
+#define LOG_LEVEL_DEBUG     0
+#define LOG_LEVEL_INFO      1
+#define LOG_LEVEL_WARN      2
+#define LOG_LEVEL_ERROR     3
+
+typedef struct {
+    uint32_t    magic;
+    uint32_t    version;
+    uint64_t    startTimeUSecs;     /* Microseconds since epoch, the first record's time is relative to this */
+} LogFileHeader_t;
+
+typedef struct {
+    uint8_t         type;
+    int64_t         intValue;
+    uint64_t        uintValue;
+    double          doubleValue;
+    const char*     string;         /* Points into the argument bytes, not terminated */
+    uint32_t        stringLength;
+} LogArg_t;
+
+/* Appends value to buffer, which must have room for 10 bytes. Returns the number of bytes written. */
+static inline uint32_t logVarintWrite(uint8_t* buffer, uint64_t value)
+{
+    uint32_t cBytes = 0;
+
+    while (value >= 0x80) {
+        buffer[cBytes++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    buffer[cBytes++] = (uint8_t)value;
+
+    return cBytes;
+}
+
+/* Returns the number of bytes read, 0 if the varint runs past end */
+static inline uint32_t logVarintRead(const uint8_t* buffer, const uint8_t* end, uint64_t* value)
+{
+    uint64_t    result  = 0;
+    uint32_t    cBytes  = 0;
+
+    while (buffer + cBytes < end && cBytes < 10) {
+        uint8_t byte = buffer[cBytes];
+
+        result |= (uint64_t)(byte & 0x7f) << (7 * cBytes);
+        cBytes++;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return cBytes;
+        }
+    }
+
+    return 0;
+}
+
+static inline uint64_t logZigzagEncode(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t logZigzagDecode(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+/* Reads one argument. Returns the number of bytes read, 0 if the argument is malformed or runs past end. */
+static inline uint32_t logArgRead(const uint8_t* buffer, const uint8_t* end, LogArg_t* arg)
+{
+    uint32_t    cBytes = 1;
+    uint32_t    cVarint;
+    uint64_t    value;
+
+    if (buffer >= end) {
+        return 0;
+    }
+
+    arg->type = buffer[0];
+    switch (arg->type) {
+    case LOG_ARG_INT:
+    case LOG_ARG_UINT:
+        cVarint = logVarintRead(buffer + cBytes, end, &value);
+        if (!cVarint) {
+            return 0;
+        }
+        arg->uintValue  = value;
+        arg->intValue   = logZigzagDecode(value);
+        return cBytes + cVarint;
+    case LOG_ARG_DOUBLE:
+        if (end - buffer < 1 + 8) {
+            return 0;
+        }
+        memcpy(&arg->doubleValue, buffer + cBytes, 8);
+        return cBytes + 8;
+    case LOG_ARG_STRING:
+        cVarint = logVarintRead(buffer + cBytes, end, &value);
+        if (!cVarint || value > (uint64_t)(end - buffer - cBytes - cVarint)) {
+            return 0;
+        }
+        arg->string         = (const char*)buffer + cBytes + cVarint;
+        arg->stringLength   = (uint32_t)value;
+        return cBytes + cVarint + (uint32_t)value;
+    case LOG_ARG_REPEAT:
+        return cBytes;
+    default:
+        return 0;
+    }
+}
@@ -0,0 +1,399 @@
+#include "LogWriter.h"
+#include "LogFileManager.h"
+#include "LogFormat.h"
+#include "formatString.h"
+#include "log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+
+#define ANSI_COLOR_RED "\x1b[31m"
+#define ANSI_COLOR_GREEN "\x1b[32m"
+#define ANSI_COLOR_YELLOW "\x1b[33m"
+#define ANSI_COLOR_BLUE "\x1b[34m"
+#define ANSI_COLOR_RESET "\x1b[0m"
+
+LogWriter* LogWriter::_instance = nullptr;
+
+LogWriter* LogWriter::instance()
+{
+	static std::once_flag once;
+
+	std::call_once(once, []() {
+		_instance = new LogWriter();
+
+		// Anything still in the ring when main returns or exit() is called would otherwise be lost
+		std::atexit([]() { _instance->flush(); });
+	});
+
+	return _instance;
+}
+
+LogWriter::LogWriter()
+	: _thread(&LogWriter::_run, this)
+{
+	_thread.detach();
+}
+
+void LogWriter::write(Record_t&& record)
+{
+	bool wakeup = record.level == LogLevel::Err;
+
+	if (!_ring.push(std::move(record))) {
+		_droppedRecords++;
+		return;
+	}
+
+	// Everything else waits for the next batch interval
+	if (wakeup) {
+		_wakeupCondition.notify_one();
+	}
+}
+
+uint32_t LogWriter::registerSite(const char* filename, int line, LogLevel level)
+{
+	std::lock_guard<std::mutex> lock(_sitesMutex);
+
+	_sites.push_back({ filename, line, level });
+	_siteCount = _sites.size();
+
+	return _sites.size() - 1;
+}
+
+// Real time is used for the writer's intervals since a simulated clock may be stopped
+static uint64_t steadyMSecs()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool LogWriter::suppress(uint32_t siteId)
+{
+	uint32_t rateLimit = _rateLimit.load(std::memory_order_relaxed);
+
+	if (rateLimit == 0 || siteId >= maxRateLimitedSites) {
+		return false;
+	}
+
+	// Racing threads may let a few extra records through when a new second starts, which doesn't matter
+	SiteRate_t&	siteRate	= _siteRates[siteId];
+	uint64_t	nowSecs		= steadyMSecs() / 1000;
+	uint64_t	windowSecs	= siteRate.windowSecs.load(std::memory_order_relaxed);
+
+	if (windowSecs != nowSecs && siteRate.windowSecs.compare_exchange_strong(windowSecs, nowSecs, std::memory_order_relaxed)) {
+		siteRate.count.store(0, std::memory_order_relaxed);
+	}
+	if (siteRate.count.fetch_add(1, std::memory_order_relaxed) < rateLimit) {
+		return false;
+	}
+	siteRate.suppressed.fetch_add(1, std::memory_order_relaxed);
+
+	return true;
+}
+
+const LogWriter::Site_t& LogWriter::_site(uint32_t siteId)
+{
+	if (siteId >= _writerSites.size()) {
+		std::lock_guard<std::mutex> lock(_sitesMutex);
+		_writerSites = _sites;
+	}
+
+	return _writerSites[siteId];
+}
+
+void LogWriter::flush()
+{
+	_drain(true /* flushFile */);
+}
+
+void LogWriter::_run(void)
+{
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(_wakeupMutex);
+			_wakeupCondition.wait_for(lock, std::chrono::milliseconds(batchIntervalMSecs));
+		}
+		_drain(false /* flushFile */);
+	}
+}
+
+void LogWriter::_format(const Record_t& record, std::string_view text, std::string& line)
+{
+	static const char* levelColors[]	= { ANSI_COLOR_GREEN, ANSI_COLOR_BLUE, ANSI_COLOR_YELLOW, ANSI_COLOR_RED };
+	static const char* levelTags[]		= { "|D] ", "|I] ", "|W] ", "|E] " };
+
+	time_t recordTime = record.timeUSecs / 1000000;
+
+	// localtime is only called once a second
+	if (recordTime != _formattedTime) {
+		struct tm timeinfo;
+
+		localtime_r(&recordTime, &timeinfo);
+		strftime(_formattedTimeStr, sizeof(_formattedTimeStr), "%I:%M:%S", &timeinfo);
+		_formattedTime = recordTime;
+	}
+
+	int level = static_cast<int>(record.level);
+
+	line += levelColors[level];
+	line += "[";
+	line += _formattedTimeStr;
+	line += levelTags[level];
+	line += ANSI_COLOR_RESET " ";
+	line += text;
+	line += "\n";
+}
+
+// Same text as a text record: arguments separated by spaces followed by (file:line)
+void LogWriter::_renderBinary(const Record_t& record, std::string& text)
+{
+	const uint8_t*	args	= reinterpret_cast<const uint8_t*>(record.text.data());
+	const uint8_t*	end		= args + record.text.size();
+	const Site_t&	site	= _site(record.siteId);
+	LogArg_t		arg;
+	uint32_t		cBytes;
+	char			number[32];
+
+	text.clear();
+	while ((cBytes = logArgRead(args, end, &arg))) {
+		switch (arg.type) {
+		case LOG_ARG_INT:
+			snprintf(number, sizeof(number), "%lld", (long long)arg.intValue);
+			text += number;
+			break;
+		case LOG_ARG_UINT:
+			snprintf(number, sizeof(number), "%llu", (unsigned long long)arg.uintValue);
+			text += number;
+			break;
+		case LOG_ARG_DOUBLE:
+			snprintf(number, sizeof(number), "%g", arg.doubleValue);
+			text += number;
+			break;
+		case LOG_ARG_STRING:
+			text.append(arg.string, arg.stringLength);
+			break;
+		}
+		text += " ";
+		args += cBytes;
+	}
+
+	text += "(";
+	text += site.filename;
+	text += ":";
+	text += std::to_string(site.line);
+	text += ")";
+}
+
+static void appendVarint(std::string& buffer, uint64_t value)
+{
+	uint8_t bytes[10];
+
+	buffer.append(reinterpret_cast<const char*>(bytes), logVarintWrite(bytes, value));
+}
+
+void LogWriter::_appendBinary(const Record_t& record, std::string& batch)
+{
+	uint32_t siteId = record.siteId;
+
+	if (siteId >= _fileSitesWritten.size()) {
+		_fileSitesWritten.resize(siteId + 1, false);
+		_fileSiteStrings.resize(siteId + 1);
+	}
+
+	if (!_fileSitesWritten[siteId]) {
+		const Site_t& site = _site(siteId);
+
+		batch.push_back(LOG_ENTRY_SITE);
+		appendVarint(batch, siteId);
+		batch.push_back(static_cast<char>(site.level));
+		appendVarint(batch, site.line);
+		appendVarint(batch, strlen(site.filename));
+		batch += site.filename;
+		_fileSitesWritten[siteId] = true;
+	}
+
+	// Strings which are the same as in the site's previous record, which includes all of the literal text, are
+	// replaced by a repeat marker
+	std::vector<std::string>&	siteStrings	= _fileSiteStrings[siteId];
+	const uint8_t*				args		= reinterpret_cast<const uint8_t*>(record.text.data());
+	const uint8_t*				end			= args + record.text.size();
+	size_t						position	= 0;
+	LogArg_t					arg;
+	uint32_t					cBytes;
+
+	_args.clear();
+	while ((cBytes = logArgRead(args, end, &arg))) {
+		if (arg.type == LOG_ARG_STRING) {
+			if (position >= siteStrings.size()) {
+				siteStrings.resize(position + 1);
+			}
+			std::string& lastString = siteStrings[position];
+			if (lastString.size() == arg.stringLength && memcmp(lastString.data(), arg.string, arg.stringLength) == 0) {
+				_args.push_back(LOG_ARG_REPEAT);
+			} else {
+				_args.append(reinterpret_cast<const char*>(args), cBytes);
+				lastString.assign(arg.string, arg.stringLength);
+			}
+		} else {
+			_args.append(reinterpret_cast<const char*>(args), cBytes);
+		}
+		args += cBytes;
+		position++;
+	}
+
+	batch.push_back(LOG_ENTRY_RECORD);
+	appendVarint(batch, siteId);
+	appendVarint(batch, logZigzagEncode(static_cast<int64_t>(record.timeUSecs - _fileLastTimeUSecs)));
+	appendVarint(batch, _args.size());
+	batch += _args;
+
+	_fileLastTimeUSecs = record.timeUSecs;
+}
+
+void LogWriter::_openFile(const Record_t& record)
+{
+	LogFileManager* logFileManager = LogFileManager::instance();
+
+	_fileBinary		= record.binary;
+	_fileSession	= record.session;
+	_filePath		= logFileManager->filename("MavLinkController", _fileBinary ? "bin" : "txt");
+
+	if (_file.open(_filePath, logFileManager->maxFileBytes(), logFileManager->maxRotations())) {
+		_startFile(record);
+	}
+}
+
+// Every file starts with its own header and site entries so it can be decoded on its own
+void LogWriter::_startFile(const Record_t& record)
+{
+	if (_fileBinary) {
+		LogFileHeader_t header = { LOG_FILE_MAGIC, LOG_FILE_VERSION, record.timeUSecs };
+
+		_fileBatch.append(reinterpret_cast<const char*>(&header), sizeof(header));
+		_fileLastTimeUSecs = record.timeUSecs;
+		_fileSitesWritten.clear();
+		_fileSiteStrings.clear();
+	}
+}
+
+void LogWriter::_rotateFileIfFull(const Record_t& record)
+{
+	if (_file.wouldExceed(_fileBatch.size())) {
+		_file.write(_fileBatch.data(), _fileBatch.size());
+		_fileBatch.clear();
+		_file.rotate();
+		_startFile(record);
+	}
+}
+
+void LogWriter::_closeFile(void)
+{
+	_file.write(_fileBatch.data(), _fileBatch.size());
+	_file.close();
+	_fileBatch.clear();
+}
+
+void LogWriter::_logSuppressed(void)
+{
+	uint32_t siteCount = std::min<uint32_t>(_siteCount, maxRateLimitedSites);
+
+	for (uint32_t siteId=0; siteId<siteCount; siteId++) {
+		uint64_t suppressed = _siteRates[siteId].suppressed.exchange(0, std::memory_order_relaxed);
+
+		if (suppressed) {
+			const Site_t& site = _site(siteId);
+			logWarn() << "LogWriter: suppressed" << suppressed << "messages from" << formatString("%s:%d", site.filename, site.line);
+		}
+	}
+}
+
+void LogWriter::_drain(bool flushFile)
+{
+	std::lock_guard<std::mutex> lock(_drainMutex);
+
+	Record_t	record;
+	bool		errorLogged = false;
+
+	_consoleBatch.clear();
+	_fileBatch.clear();
+
+	while (_ring.pop(record)) {
+		errorLogged |= record.level == LogLevel::Err;
+
+		// The file follows the detector sessions: opened for the first record logged while detectors are running and
+		// closed at the first one after they stop, or the first one from the next session if none was logged in between
+		if (_file.isOpen() && (!record.toFile || record.binary != _fileBinary || record.session != _fileSession)) {
+			_closeFile();
+		}
+		if (record.toFile && !_file.isOpen()) {
+			_openFile(record);
+		}
+		bool toFile = record.toFile && _file.isOpen();
+
+		if (toFile) {
+			_rotateFileIfFull(record);
+		}
+
+		if (record.binary) {
+			// Formatting for the console is what binary logging saves, so while there is a file only warnings and
+			// errors are formatted
+			if (toFile) {
+				_appendBinary(record, _fileBatch);
+			}
+			if (!toFile || record.level >= LogLevel::Warn) {
+				_renderBinary(record, _text);
+				_format(record, _text, _consoleBatch);
+			}
+		} else {
+			size_t lineStart = _consoleBatch.size();
+
+			_format(record, record.text.view(), _consoleBatch);
+			if (toFile) {
+				_fileBatch.append(_consoleBatch, lineStart, std::string::npos);
+			}
+		}
+	}
+
+	// Logged like any other record, so these show up with the next batch
+	uint64_t droppedRecords = _droppedRecords.exchange(0);
+	if (droppedRecords) {
+		logWarn() << "LogWriter: dropped" << droppedRecords << "records, logging is falling behind";
+	}
+
+	uint64_t nowMSecs = steadyMSecs();
+	if (nowMSecs - _lastSuppressedMSecs >= suppressedIntervalMSecs) {
+		_logSuppressed();
+		_lastSuppressedMSecs = nowMSecs;
+	}
+
+	if (_consoleEnabled && !_consoleBatch.empty()) {
+		const char*	data		= _consoleBatch.data();
+		size_t		remaining	= _consoleBatch.size();
+
+		while (remaining > 0) {
+			ssize_t cBytes = ::write(STDOUT_FILENO, data, remaining);
+			if (cBytes <= 0) {
+				break;
+			}
+			data		+= cBytes;
+			remaining	-= cBytes;
+		}
+	}
+
+	if (_file.isOpen()) {
+		if (!_fileBatch.empty()) {
+			_file.write(_fileBatch.data(), _fileBatch.size());
+			_fileNeedsFlush = true;
+		}
+
+		if (_fileNeedsFlush && (flushFile || errorLogged || nowMSecs - _lastFlushMSecs >= flushIntervalMSecs)) {
+			_file.flush();
+			_fileNeedsFlush	= false;
+			_lastFlushMSecs	= nowMSecs;
+		}
+	}
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "InlineString.h"
+#include "MpscRing.h"
+#include "RotatingFile.h"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+enum class LogLevel : int { Debug = 0, Info = 1, Warn = 2, Err = 3 };
+
+// Writes log records to the console and, while detectors are running, to MavLinkController.txt in the session log
+// directory. Logging threads only push a record into a lock-free ring. A writer thread drains the ring in batches,
+// keeps the log file open and flushes it on a timer or as soon as an error is logged, so the pulse and receive threads
+// never do file I/O.
+//
+// Binary records carry raw argument values instead of text. While detectors are running they go to
+// MavLinkController.bin (see LogFormat.h) and only warnings and errors are formatted for the console.
+//
+// The session file is rotated at LogFileManager::maxFileBytes. Each call site may log rateLimit records a second,
+// anything over that is dropped before its arguments are evaluated and counted in a "suppressed" summary logged once a
+// second.
+//
+// Record text is held inline up to recordTextCapacity bytes, so a typical log call doesn't allocate on the logging
+// thread.
+class LogWriter
+{
+public:
+	static LogWriter* instance();
+
+	static constexpr size_t recordTextCapacity = 256;
+
+	typedef InlineString<recordTextCapacity> RecordText_t;
+
+	typedef struct {
+		LogLevel	level;
+		uint64_t	timeUSecs;	// Microseconds since epoch
+		bool		toFile;		// Detectors were running when the record was logged
+		uint32_t	session;	// LogFileManager::session() when the record was logged
+		bool		binary;
+		uint32_t	siteId;
+		RecordText_t	text;	// Message followed by (file:line), or LOG_ARG_* encoded arguments for a binary record
+	} Record_t;
+
+	// Thread safe. Called once per log call site, returns the site's id.
+	uint32_t registerSite(const char* filename, int line, LogLevel level);
+
+	// Thread safe. Returns true if the call site is over its rate limit and the record should be skipped.
+	bool suppress(uint32_t siteId);
+
+	// Records a second per call site, 0 for no limit
+	void setRateLimit(uint32_t rateLimit) { _rateLimit = rateLimit; }
+
+	// Thread safe and lock free. The record is dropped (and counted) if the writer has fallen behind.
+	void write(Record_t&& record);
+
+	// Writes out everything logged so far from the calling thread
+	void flush();
+
+	void setConsoleEnabled(bool enabled) { _consoleEnabled = enabled; }
+
+	static constexpr uint32_t flushIntervalMSecs		= 1000;
+	static constexpr uint32_t batchIntervalMSecs		= 100;
+	static constexpr uint32_t suppressedIntervalMSecs	= 1000;
+	static constexpr uint32_t maxRateLimitedSites		= 2048;		// Sites registered after this many aren't rate limited
+
+private:
+	LogWriter();
+
+	typedef struct {
+		const char*	filename;
+		int			line;
+		LogLevel	level;
+	} Site_t;
+
+	typedef struct {
+		std::atomic_uint64_t	windowSecs	{ 0 };
+		std::atomic_uint32_t	count		{ 0 };		// Records in the current second
+		std::atomic_uint64_t	suppressed	{ 0 };		// Since the last summary
+	} SiteRate_t;
+
+	void _run				(void);
+	void _drain				(bool flushFile);
+	void _openFile			(const Record_t& record);
+	void _startFile			(const Record_t& record);
+	void _rotateFileIfFull	(const Record_t& record);
+	void _closeFile			(void);
+	void _logSuppressed		(void);
+	void _format			(const Record_t& record, std::string_view text, std::string& line);
+	void _renderBinary		(const Record_t& record, std::string& text);
+	void _appendBinary		(const Record_t& record, std::string& batch);
+	const Site_t& _site		(uint32_t siteId);
+
+	MpscRing<Record_t, 4096>	_ring;
+	std::atomic_uint64_t		_droppedRecords		{ 0 };
+	std::atomic_bool			_consoleEnabled		{ true };
+	std::mutex					_sitesMutex;
+	std::vector<Site_t>			_sites;
+	std::atomic_uint32_t		_siteCount			{ 0 };
+	std::atomic_uint32_t		_rateLimit			{ 20 };
+	std::array<SiteRate_t, maxRateLimitedSites> _siteRates;
+
+	// Consumer side only
+	std::mutex					_drainMutex;		// Serializes the writer thread with flush()
+	RotatingFile				_file;
+	std::string					_filePath;
+	bool						_fileBinary			= false;
+	uint32_t					_fileSession		= 0;
+	bool						_fileNeedsFlush		= false;
+	uint64_t					_lastFlushMSecs		= 0;
+	uint64_t					_lastSuppressedMSecs	= 0;
+	uint64_t					_fileLastTimeUSecs	= 0;
+	std::vector<bool>			_fileSitesWritten;					// Site entry is in the binary file
+	std::vector<std::vector<std::string>> _fileSiteStrings;			// Last string per argument position per site
+	std::vector<Site_t>			_writerSites;						// Copy of _sites, only locked for new sites
+	time_t						_formattedTime		= 0;
+	char						_formattedTimeStr[10] {};
+	std::string					_consoleBatch;
+	std::string					_fileBatch;
+	std::string					_text;
+	std::string					_args;
+
+	std::mutex					_wakeupMutex;
+	std::condition_variable		_wakeupCondition;
+	std::thread					_thread;			// Must be last, the thread starts running during construction
+
+	static LogWriter*			_instance;
+};
@@ -1,36 +1,94 @@
 #include "MavlinkOutgoingMessageQueue.h"
 #include "log.h"
 #include "MavlinkSystem.h"
+#include "timeHelpers.h"
+#include "Trace.h"
+#include "AllocationCounter.h"
 
 MavlinkOutgoingMessageQueue::MavlinkOutgoingMessageQueue(MavlinkSystem* mavlink)
     : _mavlink  (mavlink)
+    , _messages (_initialCapacity)
     , _thread   (&MavlinkOutgoingMessageQueue::_run, this)
 {
     _thread.detach();
 }
 
-void MavlinkOutgoingMessageQueue::addMessage(const mavlink_message_t& message)
+void MavlinkOutgoingMessageQueue::addMessage(const mavlink_message_t& message, const PulseTimestamps_t* pulseTimestamps)
 {
+    OutgoingMessage_t outgoingMessage;
+
+    outgoingMessage.message             = message;
+    outgoingMessage.hasPulseTimestamps  = pulseTimestamps != nullptr;
+    if (pulseTimestamps) {
+        outgoingMessage.pulseTimestamps = *pulseTimestamps;
+    }
+
     {
         std::unique_lock<decltype(_threadWaitMutex)> uLock(_threadWaitMutex);
 
-        _messages.push_back(message);
+        if (_count == _messages.size()) {
+            _grow();
+        }
+        _messages[(_head + _count) % _messages.size()] = outgoingMessage;
+        _count++;
     }
     _threadWaitCondition.notify_all();
 }
 
+bool MavlinkOutgoingMessageQueue::empty()
+{
+    std::unique_lock<decltype(_threadWaitMutex)> uLock(_threadWaitMutex);
+
+    return _count == 0;
+}
+
+size_t MavlinkOutgoingMessageQueue::size()
+{
+    std::unique_lock<decltype(_threadWaitMutex)> uLock(_threadWaitMutex);
+
+    return _count;
+}
+
+// Called with _threadWaitMutex held
+void MavlinkOutgoingMessageQueue::_grow(void)
+{
+    std::vector<OutgoingMessage_t> messages(_messages.size() * 2);
+
+    for (size_t i=0; i<_count; i++) {
+        messages[i] = _messages[(_head + i) % _messages.size()];
+    }
+    _messages.swap(messages);
+    _head = 0;
+
+    logWarn() << "MavlinkOutgoingMessageQueue: grown to" << _messages.size() << "messages, the link is falling behind";
+}
+
 void MavlinkOutgoingMessageQueue::_run(void)
 {
     while (true) {
         // Wait until we have messages to send
         std::unique_lock<decltype(_threadWaitMutex)> l(_threadWaitMutex);
-        _threadWaitCondition.wait(l, [this]{ return _messages.size(); });
+        _threadWaitCondition.wait(l, [this]{ return _count; });
+
+        if (_count > 0) {
+            HotPathScope        hotPath;
+            OutgoingMessage_t   outgoingMessage = _messages[_head];
 
-        if (_messages.size() > 0) {
-            mavlink_message_t message = _messages[0];
-            _messages.erase(_messages.begin());
-            _mavlink->_sendMessageOnConnection(message);
+            _head = (_head + 1) % _messages.size();
+            _count--;
+
+            // Producers aren't held up while the message is sent
+            l.unlock();
+            {
+                TraceSpan span("sendMessage");
+                _mavlink->_sendMessageOnConnection(outgoingMessage.message);
+            }
+            if (outgoingMessage.hasPulseTimestamps) {
+                PulseLatencyStats::instance()->recordTransmitted(outgoingMessage.pulseTimestamps);
+            }
+        }
+        if (_pacing) {
+            sleepForMSecs(100);
         }
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
     }
 }
@@ -2,28 +2,48 @@
 
 #include <mavlink.h>
 
+#include "PulseLatencyStats.h"
+
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
 #include <vector>
 
 class MavlinkSystem;
 
+// Messages are held in a ring which is allocated up front, so queueing a pulse doesn't allocate. The ring only grows
+// (and logs a warning) if more than its capacity is ever waiting, which means the link is far behind.
 class MavlinkOutgoingMessageQueue
 {
 public:
     MavlinkOutgoingMessageQueue(MavlinkSystem* mavlink);
 
     MavlinkSystem*  mavlinkSystem   () const { return _mavlink; }
-    void            addMessage      (const mavlink_message_t& message);
+    void            addMessage      (const mavlink_message_t& message, const PulseTimestamps_t* pulseTimestamps = nullptr);
+    bool            empty           ();
+    size_t          size            ();
+    void            setPacing       (bool pacing) { _pacing = pacing; }   // Pacing keeps us from flooding the telemetry radio
 
 private:
-	void _run(void);
+    typedef struct {
+        mavlink_message_t   message;
+        bool                hasPulseTimestamps;
+        PulseTimestamps_t   pulseTimestamps;
+    } OutgoingMessage_t;
+
+	void _run   (void);
+	void _grow  (void);
+
+    static constexpr size_t _initialCapacity = 1024;
 
 private:
     MavlinkSystem*                  _mavlink;
-    std::vector<mavlink_message_t>  _messages;
-    std::thread				        _thread;
+    std::vector<OutgoingMessage_t>  _messages;      // Ring of _messages.size() slots
+    size_t                          _head           { 0 };  // Oldest message
+    size_t                          _count          { 0 };
     std::mutex                      _threadWaitMutex;
     std::condition_variable         _threadWaitCondition;
+    std::atomic_bool                _pacing { true };
+    std::thread				        _thread;        // Must be last, the thread starts running during construction
 };
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include "log.h"
 #include "UdpConnection.h"
 #include "SerialConnection.h"
+#include "ReplayConnection.h"
 #include "TunnelProtocol.h"
 
 #include <mutex>
@@ -33,11 +34,22 @@ bool MavlinkSystem::start()
 
 		_connection = std::make_unique<UdpConnection>(this);
 
+	} else if (_connectionUrl.find("replay:") != std::string::npos) {
+
+		_connection = std::make_unique<ReplayConnection>(this);
+
 	} else {
 		logError() << "Invalid connection string:", _connectionUrl.c_str();
 	}
 
-	return _connection->start();
+	if (!_connection->start()) {
+		return false;
+	}
+
+	// Telemetry reads the connection from its own thread
+	_telemetry.start();
+
+	return true;
 }
 
 void MavlinkSystem::stop()
@@ -60,6 +72,14 @@ void MavlinkSystem::handleMessage(const mavlink_message_t& message)
 	}
 }
 
+void MavlinkSystem::setHeartbeatStatus(uint16_t heartbeatStatus)
+{
+	_heartbeatStatus = heartbeatStatus;
+
+	// Attitude accuracy only matters for bearings while detectors are running
+	_telemetry.setDetecting(heartbeatStatus == HEARTBEAT_STATUS_DETECTING);
+}
+
 void MavlinkSystem::subscribeToMessage(uint16_t message_id, const MessageCallback& callback)
 {
 	std::scoped_lock<std::mutex> lock(_subscriptions_mutex);
@@ -72,9 +92,9 @@ void MavlinkSystem::subscribeToMessage(uint16_t message_id, const MessageCallbac
 	}
 }
 
-void MavlinkSystem::sendMessage(const mavlink_message_t& message)
+void MavlinkSystem::sendMessage(const mavlink_message_t& message, const PulseTimestamps_t* pulseTimestamps)
 {
-	_outgoingMessageQueue.addMessage(message);
+	_outgoingMessageQueue.addMessage(message, pulseTimestamps);
 }
 
 void MavlinkSystem::sendHeartbeat()
@@ -120,13 +140,21 @@ void MavlinkSystem::sendStatusText(std::string&& text, MAV_SEVERITY severity)
 }
 
 void MavlinkSystem::sendTunnelMessage(void* tunnelPayload, size_t tunnelPayloadSize)
+{
+    mavlink_message_t message;
+
+    if (encodeTunnelMessage(tunnelPayload, tunnelPayloadSize, message)) {
+        sendMessage(message);
+    }
+}
+
+bool MavlinkSystem::encodeTunnelMessage(const void* tunnelPayload, size_t tunnelPayloadSize, mavlink_message_t& message)
 {
     if (!gcsSystemId().has_value()) {
         logError() << "Called before gcs discovered";
-        return;
+        return false;
     }
 
-    mavlink_message_t   message;
     mavlink_tunnel_t    tunnel;
 
     memset(&tunnel, 0, sizeof(tunnel));
@@ -144,7 +172,7 @@ void MavlinkSystem::sendTunnelMessage(void* tunnelPayload, size_t tunnelPayloadS
         &message,
         &tunnel);
 
-    sendMessage(message);
+    return true;
 }
 
 std::optional<uint8_t> MavlinkSystem::ourSystemId() const 
@@ -195,6 +223,8 @@ void MavlinkSystem::startTunnelHeartbeatSender()
         while (true) {
             TunnelProtocol::Heartbeat_t heartbeat;
 
+            memset(&heartbeat, 0, sizeof(heartbeat));
+
             heartbeat.header.command    = COMMAND_ID_HEARTBEAT;
             heartbeat.system_id         = HEARTBEAT_SYSTEM_ID_MAVLINKCONTROLLER;
 			heartbeat.status			= _heartbeatStatus;
@@ -206,7 +236,7 @@ void MavlinkSystem::startTunnelHeartbeatSender()
                 _logCPUTemp();
             }
 
-            std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+            sleepForMSecs(1000);
         }
     });
     heartbeatSenderThread.detach();
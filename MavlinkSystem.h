@@ -40,10 +40,12 @@ public:
 	void 					sendHeartbeat				();
 	void 					sendStatusText				(std::string&& message, MAV_SEVERITY severity = MAV_SEVERITY_INFO);
 	void 					sendTunnelMessage			(void* tunnelPayload, size_t tunnelPayloadSize);
-	void 					sendMessage					(const mavlink_message_t& message);
+	bool 					encodeTunnelMessage			(const void* tunnelPayload, size_t tunnelPayloadSize, mavlink_message_t& message);
+	void 					sendMessage					(const mavlink_message_t& message, const PulseTimestamps_t* pulseTimestamps = nullptr);
 	Telemetry& 				telemetry					() { return _telemetry; }
 	uint16_t 				heartbeatStatus				() const { return _heartbeatStatus; }
-	void					setHeartbeatStatus			(uint16_t heartbeatStatus) { _heartbeatStatus = heartbeatStatus; }
+	void					setHeartbeatStatus			(uint16_t heartbeatStatus);
+	MavlinkOutgoingMessageQueue& outgoingMessageQueue	() { return _outgoingMessageQueue; }
 
 private:
 	void _sendMessageOnConnection(const mavlink_message_t& message);
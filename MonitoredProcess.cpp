@@ -1,12 +1,25 @@
 #include "MonitoredProcess.h"
 #include "log.h"
 #include "MavlinkSystem.h"
+#include "Trace.h"
+#include "LogFileManager.h"
+#include "RotatingFile.h"
+#include "timeHelpers.h"
+#include "formatString.h"
+#include "ProcessSupervisor.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <string>
 #include <iostream>
-#include <thread>
 #include <filesystem>
 
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 MonitoredProcess::MonitoredProcess(
 		MavlinkSystem*					mavlink,
 		const char* 					name, 
@@ -28,25 +41,8 @@ MonitoredProcess::MonitoredProcess(
 
 void MonitoredProcess::start(void)
 {
-	// FIXME: We leak these thread objects
-    _thread = new std::thread(&MonitoredProcess::_run, this);
-    _thread->detach();
-}
-
-void MonitoredProcess::stop(void)
-{
-	logDebug() << "MonitoredProcess::stop _childProcess:_childProcess.running" 
-		<< _childProcess
-		<< (_childProcess ? _childProcess->running() : false);
+	_startNSecs = nsecsMonotonic();
 
-	if (_childProcess) {
-		_terminated = true;
-		_childProcess->terminate();
-	}
-}
-
-void MonitoredProcess::_run(void)
-{
 	std::string statusStr("Process start: ");
 	statusStr.append(_name);
 
@@ -60,35 +56,274 @@ void MonitoredProcess::_run(void)
 
 	std::filesystem::remove(_logPath);
 
+	LogFileManager* logFileManager = LogFileManager::instance();
+	_logFile.open(_logPath, logFileManager->maxFileBytes(), logFileManager->maxRotations());
+
+	// Output comes back through a pipe so the log file can be capped. Both ends are close on exec so processes spawned
+	// from other threads meanwhile don't hold the pipe open, the child gets its end through dup2 which clears the flag.
+	// Our end is non blocking since it is read from the supervisor's epoll loop.
+	int			logPipeFds[2];
+	bp::pipe	logPipe = pipe2(logPipeFds, O_CLOEXEC) == 0 ? bp::pipe(logPipeFds[0], logPipeFds[1]) : bp::pipe();
+
+	pid_t pid = 0;
+
 	try {
+		TraceSpan		span("spawn " + _name);
+		bp::child*		childProcess = NULL;
+
+		// Runs in the child between fork and exec, failures are found by reading the settings and cgroup back below
+		SchedulingProfile_t schedulingProfile	= _schedulingProfile;
+		int					cgroupProcsFd		= _cgroup ? ProcessCgroups::instance()->procsFd(*_cgroup) : -1;
+		auto				childSetup			= bp::extend::on_exec_setup = [schedulingProfile, cgroupProcsFd](auto&) {
+			if (cgroupProcsFd >= 0) {
+				ProcessCgroups::join(cgroupProcsFd);
+			}
+			applySchedulingProfile(schedulingProfile);
+		};
+
 		switch (_intermediatePipeType ) {
 			case NoPipe:
-				_childProcess = new bp::child(_command.c_str(), bp::std_out > _logPath, bp::std_err > _logPath);
+				childProcess = new bp::child(_command.c_str(), (bp::std_out & bp::std_err) > logPipe, childSetup);
 				break;
 			case InputPipe:
-				_childProcess = new bp::child(_command.c_str(), bp::std_in < *_intermediatePipe, bp::std_out > _logPath, bp::std_err > _logPath);
+				childProcess = new bp::child(_command.c_str(), bp::std_in < *_intermediatePipe, (bp::std_out & bp::std_err) > logPipe, childSetup);
 				break;
 			case OutputPipe:
-				_childProcess = new bp::child(_command.c_str(), bp::std_out > *_intermediatePipe, bp::std_err > _logPath);
+				childProcess = new bp::child(_command.c_str(), bp::std_out > *_intermediatePipe, bp::std_err > logPipe, childSetup);
 				break;
 		}
+
+		// boost closes our copy of the child's end of the intermediate pipe once it has been spawned
+		if (_intermediatePipeType == InputPipe) {
+			_intermediatePipe->assign_source(-1);
+		} else if (_intermediatePipeType == OutputPipe) {
+			_intermediatePipe->assign_sink(-1);
+		}
+
+		// The supervisor reaps the child, boost must not wait for or kill it
+		childProcess->detach();
+		pid = childProcess->id();
+		delete childProcess;
 	} catch(bp::process_error& e) {
-		logError() << "MonitoredProcess::run boost::process:child threw process_error exception\n" 
+		logError() << "MonitoredProcess::start boost::process:child threw process_error exception\n" 
             << "\terror: " << e.what() << "\n"
             << "\tcommand: " << _command;
-		_terminated = true;
-//		} catch(...) {
-//			std::cout << "MonitoredProcess::run boost::process:child threw unknown exception" << std::endl;
-//			_terminated = true;
 	}
 
+	// Our write end has to be closed for the read to see end of file once the child exits
+	::close(logPipe.native_sink());
+	logPipe.assign_sink(-1);
+
+	if (pid == 0) {
+		_reportExit(255);
+		return;
+	}
+
+	int pidFd = ProcessSupervisor::pidfdOpen(pid);
+	if (pidFd < 0) {
+		logError() << "MonitoredProcess::start pidfd_open failed" << _name << strerror(errno);
+		kill(pid, SIGKILL);
+		waitpid(pid, NULL, 0);
+		_reportExit(255);
+		return;
+	}
+
+	if (!_schedulingWarned && !schedulingProfileApplied(pid, _schedulingProfile)) {
+		_schedulingWarned = true;
+		logWarn() << "Process scheduling profile not applied:" << _name << schedulingProfileString(_schedulingProfile)
+					<< "- the cpus have to exist, fifo, negative nice and realtime io need CAP_SYS_NICE";
+	}
+
+	if (_cgroup && ProcessCgroups::instance()->enabled() && !_cgroupWarned && !ProcessCgroups::instance()->contains(pid, *_cgroup)) {
+		_cgroupWarned = true;
+		logWarn() << "Process not in its cgroup:" << _name << ProcessCgroups::groupName(*_cgroup);
+	}
+
+	_outputFd = logPipe.native_source();
+	logPipe.assign_source(-1);
+	fcntl(_outputFd, F_SETFL, fcntl(_outputFd, F_GETFL) | O_NONBLOCK);
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_pid	= pid;
+		_pidFd	= pidFd;
+
+		// Stopped while being spawned
+		if (_terminated) {
+			ProcessSupervisor::pidfdSendSignal(_pidFd, SIGKILL);
+		}
+	}
+
+	if (_readyCheck == ReadyWhenSpawned) {
+		_setState(Ready);
+	}
+
+	// The supervisor keeps the process alive until the child has exited
+	if (!ProcessSupervisor::instance()->add(shared_from_this())) {
+		_closeOutput();
+		ProcessSupervisor::pidfdSendSignal(_pidFd, SIGKILL);
+		_reap();
+	}
+}
+
+void MonitoredProcess::stop(void)
+{
+	std::lock_guard<std::mutex> restartLock(_restartMutex);
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	logDebug() << "MonitoredProcess::stop _name:_pid" << _name << _pid;
+
+	// A process which hasn't been spawned yet is terminated as soon as it is, a pending restart is dropped
+	_stopped	= true;
+	_terminated	= true;
+	if (_pidFd >= 0) {
+		ProcessSupervisor::pidfdSendSignal(_pidFd, SIGKILL);
+	}
+}
+
+// Kills the process without stopping it for good, used for the dependents of a process which is being restarted
+void MonitoredProcess::_kill(void)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_terminated = true;
+	if (_pidFd >= 0) {
+		ProcessSupervisor::pidfdSendSignal(_pidFd, SIGKILL);
+	}
+}
+
+void MonitoredProcess::addDependent(std::shared_ptr<MonitoredProcess> dependent)
+{
+	_dependents.push_back(dependent);
+}
+
+uint32_t MonitoredProcess::restarts(void)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	return _restarts;
+}
+
+uint64_t MonitoredProcess::downNSecs(void)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	return _downNSecs + (_restarting ? nsecsMonotonic() - _exitNSecs : 0);
+}
+
+bool MonitoredProcess::restarting(void)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	return _restarting;
+}
+
+bool MonitoredProcess::gaveUp(void)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	return _gaveUp;
+}
+
+void MonitoredProcess::markReady(void)
+{
+	_setState(Ready);
+}
+
+MonitoredProcess::State MonitoredProcess::state(void)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	return _state;
+}
+
+uint64_t MonitoredProcess::readyNSecs(void)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	return _readyNSecs;
+}
+
+// Processes only move forward: Starting -> Ready -> Exited
+void MonitoredProcess::_setState(State state)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (state <= _state) {
+		return;
+	}
+	if (state == Ready) {
+		_readyNSecs = nsecsMonotonic() - _startNSecs;
+		logInfo() << "Process ready:" << _name << formatString("%.1f", _readyNSecs / 1e6) << "msecs";
+	}
+	_state = state;
+}
+
+// Copies whatever output is available to the log file
+bool MonitoredProcess::_readOutput(void)
+{
+	char buffer[16384];
+
+	while (true) {
+		ssize_t cBytes = read(_outputFd, buffer, sizeof(buffer));
+
+		if (cBytes < 0 && errno == EINTR) {
+			continue;
+		}
+		if (cBytes < 0 && errno == EAGAIN) {
+			return true;
+		}
+		if (cBytes <= 0) {
+			return false;
+		}
+		if (_readyCheck == ReadyOnOutput) {
+			_setState(Ready);
+		}
+		if (_logFile.wouldExceed(cBytes)) {
+			_logFile.rotate();
+		}
+		_logFile.write(buffer, cBytes);
+
+		// Process logs are read while the process is still running
+		_logFile.flush();
+	}
+}
+
+void MonitoredProcess::_closeOutput(void)
+{
+	::close(_outputFd);
+	_outputFd = -1;
+}
+
+// The pidfd has reported the exit, so this doesn't block
+void MonitoredProcess::_reap(void)
+{
+	int status = 0;
 	int result = 255;
 
-	if (_childProcess) {
-		_childProcess->wait();
-		result = _childProcess->exit_code();
+	while (waitpid(_pid, &status, 0) < 0 && errno == EINTR) {
+	}
+	if (WIFEXITED(status)) {
+		result = WEXITSTATUS(status);
+	} else if (WIFSIGNALED(status)) {
+		result = WTERMSIG(status);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		::close(_pidFd);
+		_pidFd = -1;
 	}
 
+	_reportExit(result);
+}
+
+void MonitoredProcess::_reportExit(int result)
+{
+	std::string statusStr;
+
 	if (result == 0) {
 		statusStr = "Process end: ";
 	} else if (_terminated) {
@@ -110,10 +345,157 @@ void MonitoredProcess::_run(void)
 		_mavlink->sendStatusText("#Capture complete", MAV_SEVERITY_INFO);
 	}
 
-	delete _childProcess;
-	_childProcess = NULL;
+	if (_logFile.rotations()) {
+		logInfo() << "MonitoredProcess:" << _name << "log rotated" << _logFile.rotations() << "times";
+	}
+	_logFile.close();
 
-	_terminated = false;
+	// Ending on its own counts as a failure too, the tag is lost for the rest of the flight just the same
+	bool		failed		= !_terminated && _restartPolicy.maxFailures != 0;
+	uint64_t	nowNSecs	= nsecsMonotonic();
 
-    delete this;   
-}
\ No newline at end of file
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_exitNSecs = nowNSecs;
+		if (!_stopped) {
+			_terminated = false;
+		}
+	}
+	_setState(Exited);
+
+	if (failed) {
+		_handleFailure(nowNSecs - _startNSecs);
+	}
+}
+
+void MonitoredProcess::_handleFailure(uint64_t ranNSecs)
+{
+	uint32_t	failures;
+	bool		gaveUp;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (ranNSecs >= uint64_t(_restartPolicy.stableSecs) * 1000000000) {
+			_failures = 0;
+		}
+		failures	= ++_failures;
+		gaveUp		= failures >= _restartPolicy.maxFailures;
+		_gaveUp		= gaveUp;
+		_restarting	= !gaveUp;
+	}
+
+	// Dependents can't keep running on their own, they are started again after this process
+	for (const auto& weakDependent: _dependents) {
+		if (auto dependent = weakDependent.lock()) {
+			dependent->_kill();
+		}
+	}
+
+	if (gaveUp) {
+		std::string statusStr = formatString("Process gave up after %u failures: %s", failures, _name.c_str());
+		logError() << statusStr;
+		_mavlink->sendStatusText(statusStr.c_str(), MAV_SEVERITY_ERROR);
+		if (_restartCallback) {
+			_restartCallback(*this);
+		}
+		return;
+	}
+
+	uint32_t backoffMSecs = uint32_t(std::min(uint64_t(_restartPolicy.initialBackoffMSecs) << std::min(failures - 1, 16u), uint64_t(_restartPolicy.maxBackoffMSecs)));
+
+	std::string statusStr = formatString("Process restart in %.1fs: %s", backoffMSecs / 1000.0, _name.c_str());
+	logWarn() << statusStr;
+	_mavlink->sendStatusText(statusStr.c_str(), MAV_SEVERITY_WARNING);
+
+	if (!ProcessSupervisor::instance()->scheduleRestart(shared_from_this(), backoffMSecs)) {
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_restarting	= false;
+		_gaveUp		= true;
+	}
+	if (_restartCallback) {
+		_restartCallback(*this);
+	}
+}
+
+// Runs on the supervisor thread once the backoff has passed
+void MonitoredProcess::_restart(void)
+{
+	std::lock_guard<std::mutex> restartLock(_restartMutex);
+
+	if (_stopped) {
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_restarting = false;
+		return;
+	}
+
+	// The dependents share the intermediate pipe, it can only be cleared once they are gone too
+	for (const auto& weakDependent: _dependents) {
+		auto dependent = weakDependent.lock();
+		if (dependent && dependent->state() != Exited) {
+			ProcessSupervisor::instance()->scheduleRestart(shared_from_this(), _dependentExitPollMSecs);
+			return;
+		}
+	}
+	_resetIntermediatePipe();
+
+	if (!_respawn()) {
+		return;
+	}
+	for (const auto& weakDependent: _dependents) {
+		if (auto dependent = weakDependent.lock()) {
+			dependent->_respawn();
+		}
+	}
+
+	if (_restartCallback) {
+		_restartCallback(*this);
+	}
+}
+
+// Starts an exited process again, counting the time it was down
+bool MonitoredProcess::_respawn(void)
+{
+	uint32_t restarts;
+	uint64_t downNSecs;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (_stopped || _state != Exited) {
+			_restarting = false;
+			return false;
+		}
+
+		_downNSecs		+= nsecsMonotonic() - _exitNSecs;
+		_restarts++;
+		_restarting		= false;
+		_state			= Starting;
+		_readyNSecs		= 0;
+		restarts		= _restarts;
+		downNSecs		= _downNSecs;
+	}
+
+	std::string statusStr = formatString("Process restarted: %s restarts %u down %.1fs", _name.c_str(), restarts, downNSecs / 1e9);
+	logInfo() << statusStr;
+	_mavlink->sendStatusText(statusStr.c_str(), MAV_SEVERITY_INFO);
+
+	start();
+
+	return true;
+}
+
+// The pipe is shared with the other half of the pair, which has exited as well by now. Whatever the killed writer
+// left in it is thrown away with it, so the restarted reader doesn't start on a partial sample.
+void MonitoredProcess::_resetIntermediatePipe(void)
+{
+	if (!_intermediatePipe) {
+		return;
+	}
+
+	_intermediatePipe->close();
+	*_intermediatePipe = bp::pipe();
+}
@@ -4,14 +4,34 @@
 #include <thread>
 #include <chrono>
 #include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <optional>
+#include <vector>
 
 #include <boost/process.hpp>
+#include <boost/process/extend.hpp>
+
+#include <sys/types.h>
+
+#include "RotatingFile.h"
+#include "SchedulingProfile.h"
+#include "ProcessCgroups.h"
 
 namespace bp = boost::process;
 
 class MavlinkSystem;
 
-class MonitoredProcess
+// Runs a child process, copying its output to a log file and reporting its exit to the GCS. The child is watched by
+// ProcessSupervisor, which holds a reference to the process until it has exited, so create it with std::make_shared.
+//
+// A process becomes ready according to its ReadyCheck, which is what detector startup waits for before moving on to
+// the processes which depend on it.
+//
+// With a RestartPolicy a process which exits on its own is started again after an exponential backoff, along with its
+// dependents, until it has failed maxFailures times in a row. Processes shut down with stop() are never restarted.
+class MonitoredProcess : public std::enable_shared_from_this<MonitoredProcess>
 {
 public:
 	enum IntermediatePipeType {
@@ -20,6 +40,28 @@ public:
 		OutputPipe,
 	};
 
+	enum ReadyCheck {
+		ReadyWhenSpawned,
+		ReadyOnOutput,		// First bytes of output on the log pipe
+		ReadyWhenMarked,	// Someone else calls markReady, for example on the first detector heartbeat
+	};
+
+	enum State {
+		Starting,
+		Ready,
+		Exited,				// Includes failing to spawn, which can happen before or after becoming ready
+	};
+
+	typedef struct {
+		uint32_t	maxFailures;			// Failures in a row before giving up, 0 never restarts
+		uint32_t	initialBackoffMSecs;	// Doubled for each failure in a row
+		uint32_t	maxBackoffMSecs;
+		uint32_t	stableSecs;				// A process which ran this long before failing starts counting from zero
+	} RestartPolicy_t;
+
+	// Called on the supervisor thread after a restart or giving up
+	typedef std::function<void(MonitoredProcess& process)> RestartCallback;
+
 	MonitoredProcess(
 		MavlinkSystem*					mavlink,
 		const char* 					name, 
@@ -29,20 +71,81 @@ public:
 		bp::pipe* 						intermediatePipe,
 		bool							rawCaptureProcess = false);
 
-	void start 	(void);
-	void stop	(void);
+	void		start 			(void);	// Spawns the child on the calling thread
+	void		stop			(void);
+	void		setReadyCheck	(ReadyCheck readyCheck) { _readyCheck = readyCheck; }	// Call before start
+	void		markReady		(void);
+	State		state			(void);
+	uint64_t	readyNSecs		(void);		// Time from start to ready, 0 if not ready yet
+	const std::string& name		(void) const { return _name; }
+
+	// Applied in the child before exec, so every thread of the process gets it. Call before start.
+	void		setSchedulingProfile(const SchedulingProfile_t& schedulingProfile) { _schedulingProfile = schedulingProfile; }
+
+	// Joined in the child before exec, if ProcessCgroups is set up. Call before start.
+	void		setCgroup			(ProcessCgroups::Group cgroup) { _cgroup = cgroup; }
+
+	// Restart setup, call before start
+	void		setRestartPolicy	(const RestartPolicy_t& restartPolicy) { _restartPolicy = restartPolicy; }
+	void		setRestartCallback	(RestartCallback restartCallback) { _restartCallback = restartCallback; }
+	void		addDependent		(std::shared_ptr<MonitoredProcess> dependent);	// Killed and restarted along with this process
+	void		setTagId			(uint32_t tagId) { _tagId = tagId; }			// Detector tag id, reported with the restart counts
+	uint32_t	tagId				(void) const { return _tagId; }
+
+	uint32_t	restarts			(void);
+	uint64_t	downNSecs			(void);		// Total time spent waiting to be restarted, including a restart in progress
+	bool		restarting			(void);
+	bool		gaveUp				(void);
 
 private:
-	void _run(void);
+	friend class ProcessSupervisor;
+
+	// Called on the supervisor thread
+	bool _readOutput	(void);		// Returns false at end of file
+	void _closeOutput	(void);
+	void _reap			(void);
+	void _restart		(void);
+	bool _respawn		(void);
+
+	void _reportExit	(int result);
+	void _handleFailure	(uint64_t ranNSecs);
+	void _kill			(void);
+	void _resetIntermediatePipe(void);
+	void _setState		(State state);
 
 	MavlinkSystem*					_mavlink;
 	std::string						_name;
 	std::string 					_command;
 	std::string						_logPath;
-	std::thread*					_thread			= NULL;
-	boost::process::child*			_childProcess 	= NULL;
-	bool							_terminated		= false;
+	pid_t							_pid			= 0;
+	int								_pidFd			= -1;		// Protected by _mutex, closed once the child is reaped
+	int								_outputFd		= -1;
+	RotatingFile					_logFile;
+	std::atomic_bool				_terminated		{ false };		// Killed by stop() or along with the process it depends on
+	std::atomic_bool				_stopped		{ false };		// Shut down for good by stop()
 	IntermediatePipeType			_intermediatePipeType;
 	bp::pipe*						_intermediatePipe;
 	bool							_rawCaptureProcess;
+	ReadyCheck						_readyCheck		= ReadyWhenSpawned;
+	SchedulingProfile_t				_schedulingProfile;
+	bool							_schedulingWarned	= false;
+	std::optional<ProcessCgroups::Group>	_cgroup;
+	bool							_cgroupWarned	= false;
+	State							_state			= Starting;
+	uint64_t						_startNSecs		= 0;
+	uint64_t						_readyNSecs		= 0;
+	uint32_t						_tagId			= 0;
+	RestartPolicy_t					_restartPolicy	{ 0, 0, 0, 0 };
+	RestartCallback					_restartCallback;
+	std::vector<std::weak_ptr<MonitoredProcess>> _dependents;
+	uint32_t						_failures		= 0;		// In a row, protected by _mutex along with the restart counters
+	uint32_t						_restarts		= 0;
+	uint64_t						_downNSecs		= 0;
+	uint64_t						_exitNSecs		= 0;
+	bool							_restarting		= false;
+	bool							_gaveUp			= false;
+	std::mutex						_mutex;
+	std::mutex						_restartMutex;				// Held for a whole restart, so stop() can't interleave with one
+
+	static constexpr uint32_t		_dependentExitPollMSecs = 100;
 };
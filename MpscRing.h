@@ -0,0 +1,83 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// Lock-free bounded ring for any number of producer threads and one consumer thread (Vyukov's bounded queue).
+// Each slot carries a sequence number which tells producers and the consumer whose turn it is to use the slot.
+template<class T, size_t Capacity>
+class MpscRing
+{
+	static_assert(Capacity && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+	MpscRing()
+	{
+		for (size_t i=0; i<Capacity; i++) {
+			_slots[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	// Non-copyable
+	MpscRing(const MpscRing&) = delete;
+	const MpscRing& operator=(const MpscRing&) = delete;
+
+	// Any thread. Returns false if the ring is full.
+	bool push(T&& item)
+	{
+		uint64_t	pos = _enqueuePos.load(std::memory_order_relaxed);
+		Slot_t*		slot;
+
+		while (true) {
+			slot = &_slots[pos & (Capacity - 1)];
+
+			int64_t diff = (int64_t)slot->sequence.load(std::memory_order_acquire) - (int64_t)pos;
+			if (diff == 0) {
+				if (_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = _enqueuePos.load(std::memory_order_relaxed);
+			}
+		}
+
+		slot->item = std::move(item);
+		slot->sequence.store(pos + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	// Consumer only. Returns false if the ring is empty.
+	bool pop(T& item)
+	{
+		Slot_t*	slot	= &_slots[_dequeuePos & (Capacity - 1)];
+		int64_t	diff	= (int64_t)slot->sequence.load(std::memory_order_acquire) - (int64_t)(_dequeuePos + 1);
+
+		if (diff < 0) {
+			return false;
+		}
+
+		item = std::move(slot->item);
+		slot->sequence.store(_dequeuePos + Capacity, std::memory_order_release);
+		_dequeuePos++;
+
+		return true;
+	}
+
+	static constexpr size_t capacity() { return Capacity; }
+
+private:
+	typedef struct {
+		std::atomic<uint64_t>	sequence;
+		T						item;
+	} Slot_t;
+
+	alignas(64) std::atomic<uint64_t>	_enqueuePos { 0 };	// Claimed by producers
+	alignas(64) uint64_t				_dequeuePos { 0 };	// Consumer only
+	std::array<Slot_t, Capacity>		_slots;
+};
@@ -0,0 +1,251 @@
+#include "ProcessCgroups.h"
+#include "log.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+ProcessCgroups* ProcessCgroups::_instance = nullptr;
+
+static const char* _groupNames[ProcessCgroups::GroupCount] = { "controller", "sdr", "channelizer", "detectors" };
+static const char* _settingFiles[] = { "cpu.weight", "cpu.max", "memory.max" };
+static const char* _controllers[] = { "cpu", "memory" };
+
+ProcessCgroups* ProcessCgroups::instance()
+{
+	static std::once_flag once;
+
+	std::call_once(once, []() { _instance = new ProcessCgroups(); });
+
+	return _instance;
+}
+
+const char* ProcessCgroups::groupName(Group group)
+{
+	return _groupNames[group];
+}
+
+bool ProcessCgroups::_readConfig(const std::string& configFileName, std::vector<Setting_t>& settings)
+{
+	std::ifstream	configFile(configFileName);
+	std::string		line;
+	int				lineNumber = 0;
+
+	if (!configFile.is_open()) {
+		logError() << "ProcessCgroups: unable to open" << configFileName;
+		return false;
+	}
+
+	while (std::getline(configFile, line)) {
+		std::istringstream	lineStream(line);
+		std::string			groupName;
+		Setting_t			setting;
+
+		lineNumber++;
+		if (!(lineStream >> groupName) || groupName.starts_with("#")) {
+			continue;
+		}
+
+		int group = 0;
+		while (group < GroupCount && groupName != _groupNames[group]) {
+			group++;
+		}
+		if (group == GroupCount) {
+			logError() << "ProcessCgroups: unknown group" << configFileName << lineNumber << groupName;
+			return false;
+		}
+
+		lineStream >> setting.file >> std::ws;
+		std::getline(lineStream, setting.value);
+
+		bool knownFile = false;
+		for (const char* settingFile: _settingFiles) {
+			knownFile |= setting.file == settingFile;
+		}
+		if (!knownFile || setting.value.empty()) {
+			logError() << "ProcessCgroups: invalid setting" << configFileName << lineNumber << line;
+			return false;
+		}
+
+		setting.group = static_cast<Group>(group);
+		settings.push_back(setting);
+	}
+
+	return true;
+}
+
+// The controller's cgroup is the "0::<path>" line of /proc/self/cgroup, below wherever the cgroup2 hierarchy is mounted:
+// /sys/fs/cgroup, or /sys/fs/cgroup/unified on systems which still have the v1 hierarchies as well.
+bool ProcessCgroups::_findCgroup(std::string& mountPath, std::string& cgroupPath)
+{
+	std::ifstream	cgroupFile("/proc/self/cgroup");
+	std::string		line;
+
+	cgroupPath.clear();
+	while (std::getline(cgroupFile, line)) {
+		if (line.starts_with("0::")) {
+			cgroupPath = line.substr(3);
+		}
+	}
+
+	// Mount point is the fifth field, the filesystem type follows the " - " separator
+	std::ifstream mountInfoFile("/proc/self/mountinfo");
+
+	mountPath.clear();
+	while (std::getline(mountInfoFile, line)) {
+		std::istringstream	fields(line);
+		std::string			field;
+		std::string			path;
+
+		for (int fieldIndex=1; fieldIndex<=5 && fields >> field; fieldIndex++) {
+			path = field;
+		}
+		auto separatorIndex = line.find(" - ");
+		if (separatorIndex != std::string::npos && line.compare(separatorIndex + 3, 8, "cgroup2 ") == 0) {
+			mountPath = path;
+			break;
+		}
+	}
+
+	return !cgroupPath.empty() && !mountPath.empty();
+}
+
+bool ProcessCgroups::_writeFile(const std::string& path, const std::string& value)
+{
+	int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+
+	bool written = write(fd, value.c_str(), value.length()) == static_cast<ssize_t>(value.length());
+	int writeErrno = errno;
+
+	::close(fd);
+	errno = writeErrno;
+
+	return written;
+}
+
+bool ProcessCgroups::setup(const std::string& configFileName)
+{
+	std::vector<Setting_t>	settings;
+	std::string				cgroupPath;
+
+	if (!_readConfig(configFileName, settings)) {
+		return false;
+	}
+
+	if (!_findCgroup(_mountPath, cgroupPath)) {
+		logWarn() << "ProcessCgroups: cgroup v2 is not mounted, processes are not put in groups";
+		return false;
+	}
+
+	std::string parentPath = cgroupPath == "/" ? "" : cgroupPath;
+
+	for (int group=0; group<GroupCount; group++) {
+		_groupPaths[group] = parentPath + "/" + _groupNames[group];
+
+		std::string groupPath = _mountPath + _groupPaths[group];
+		if (mkdir(groupPath.c_str(), 0755) != 0 && errno != EEXIST) {
+			logWarn() << "ProcessCgroups: unable to create" << groupPath << strerror(errno) << "- the controller's cgroup has to be delegated to it";
+			return false;
+		}
+	}
+
+	if (!_writeFile(_mountPath + _groupPaths[GroupController] + "/cgroup.procs", "0")) {
+		logWarn() << "ProcessCgroups: unable to move the controller into its group" << strerror(errno);
+		return false;
+	}
+
+	// Without a controller its limits can't be set, the groups still keep the processes apart in the stats
+	for (const char* controller: _controllers) {
+		if (!_writeFile(_mountPath + parentPath + "/cgroup.subtree_control", std::string("+") + controller)) {
+			logWarn() << "ProcessCgroups: unable to enable the" << controller << "controller" << strerror(errno)
+						<< "- it has to be enabled in the parent cgroup and the controller's cgroup can only hold the controller";
+		}
+	}
+
+	for (const Setting_t& setting: settings) {
+		std::string path = _mountPath + _groupPaths[setting.group] + "/" + setting.file;
+
+		if (_writeFile(path, setting.value)) {
+			logInfo() << "ProcessCgroups:" << _groupNames[setting.group] << setting.file << setting.value;
+		} else {
+			logWarn() << "ProcessCgroups: unable to set" << _groupNames[setting.group] << setting.file << setting.value << strerror(errno);
+		}
+	}
+
+	for (int group=0; group<GroupCount; group++) {
+		_procsFds[group] = open((_mountPath + _groupPaths[group] + "/cgroup.procs").c_str(), O_WRONLY | O_CLOEXEC);
+		if (_procsFds[group] < 0) {
+			logWarn() << "ProcessCgroups: unable to open cgroup.procs of" << _groupNames[group] << strerror(errno);
+			return false;
+		}
+	}
+
+	_enabled = true;
+	logInfo() << "ProcessCgroups: groups created under" << _mountPath + parentPath;
+
+	return true;
+}
+
+int ProcessCgroups::join(int procsFd)
+{
+	return write(procsFd, "0", 1) == 1 ? 0 : errno;
+}
+
+bool ProcessCgroups::contains(pid_t pid, Group group)
+{
+	std::ifstream	cgroupFile("/proc/" + std::to_string(pid) + "/cgroup");
+	std::string		line;
+
+	while (std::getline(cgroupFile, line)) {
+		if (line.starts_with("0::")) {
+			return line.substr(3) == _groupPaths[group];
+		}
+	}
+
+	return false;
+}
+
+std::vector<ProcessCgroups::GroupStats_t> ProcessCgroups::stats(void)
+{
+	std::vector<GroupStats_t> stats;
+
+	if (!_enabled) {
+		return stats;
+	}
+
+	for (int group=0; group<GroupCount; group++) {
+		std::string		groupPath	= _mountPath + _groupPaths[group];
+		std::ifstream	cpuStatFile(groupPath + "/cpu.stat");
+		std::ifstream	memoryFile(groupPath + "/memory.current");
+		std::string		key;
+		uint64_t		value;
+		GroupStats_t	groupStats	{ _groupNames[group], 0, 0, 0, 0, 0 };
+
+		while (cpuStatFile >> key >> value) {
+			if (key == "usage_usec") {
+				groupStats.usageUSecs = value;
+			} else if (key == "nr_periods") {
+				groupStats.periods = value;
+			} else if (key == "nr_throttled") {
+				groupStats.throttledPeriods = value;
+			} else if (key == "throttled_usec") {
+				groupStats.throttledUSecs = value;
+			}
+		}
+		memoryFile >> groupStats.memoryBytes;
+
+		stats.push_back(groupStats);
+	}
+
+	return stats;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+// Runs the controller and each kind of process it starts in a cgroup v2 group of its own, so their cpu and memory can
+// be limited separately and a runaway detector can't take the cpu time airspy_rx and the controller need. The groups
+// are created under the cgroup the controller was started in, which has to be delegated to its user and hold nothing
+// but the controller. The controller moves itself into the controller group, a cgroup with processes of its own can't
+// hand its controllers down to the groups below it.
+//
+// The limits come from a file with one setting per line, blank lines and lines starting with # are skipped:
+//	<controller|sdr|channelizer|detectors> <cpu.weight|cpu.max|memory.max> <value>
+// The value is written to the group's cgroup file as is, see the kernel's cgroup-v2 documentation for the formats.
+class ProcessCgroups
+{
+public:
+	enum Group {
+		GroupController,	// The controller itself. Values match CGROUP_* in ControllerTunnelProtocol.h
+		GroupSdr,
+		GroupChannelizer,
+		GroupDetectors,
+		GroupCount
+	};
+
+	typedef struct {
+		std::string	name;
+		uint64_t	usageUSecs;			// cpu.stat counters are totals since the group was created
+		uint64_t	periods;			// Periods with runnable processes, only counted while cpu.max sets a quota
+		uint64_t	throttledPeriods;
+		uint64_t	throttledUSecs;
+		uint64_t	memoryBytes;		// memory.current, 0 without the memory controller
+	} GroupStats_t;
+
+	static ProcessCgroups* instance();
+
+	// Creates the groups, moves the controller into its group and applies the limits from configFileName. Call before
+	// any process is started. Returns false if the groups can't be used, processes then stay in the controller's cgroup.
+	// Limits which can't be applied are logged and skipped.
+	bool setup(const std::string& configFileName);
+	bool enabled(void) const { return _enabled; }
+
+	// cgroup.procs of the group, -1 if not set up. Close on exec.
+	int procsFd(Group group) const { return _enabled ? _procsFds[group] : -1; }
+
+	// Moves the calling process into the group of procsFd. Only makes system calls, so it can be used in a child between
+	// fork and exec. Returns 0 or errno.
+	static int join(int procsFd);
+
+	// Whether process pid is in the group
+	bool contains(pid_t pid, Group group);
+
+	std::vector<GroupStats_t> stats(void);
+
+	static const char* groupName(Group group);
+
+private:
+	typedef struct {
+		Group		group;
+		std::string	file;
+		std::string	value;
+	} Setting_t;
+
+	ProcessCgroups() = default;
+
+	bool _readConfig	(const std::string& configFileName, std::vector<Setting_t>& settings);
+	bool _findCgroup	(std::string& mountPath, std::string& cgroupPath);
+	bool _writeFile		(const std::string& path, const std::string& value);
+
+	bool		_enabled					= false;
+	std::string	_groupPaths[GroupCount];			// Relative to the cgroup2 mount, as in /proc/<pid>/cgroup
+	std::string	_mountPath;
+	int			_procsFds[GroupCount]		= { -1, -1, -1, -1 };
+
+	static ProcessCgroups* _instance;
+};
@@ -0,0 +1,370 @@
+#include "ProcessSupervisor.h"
+#include "MonitoredProcess.h"
+#include "log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+ProcessSupervisor* ProcessSupervisor::_instance = nullptr;
+
+// Both fds of a process are registered with its pidfd in the upper half of the event data, timers with the timerfd
+static constexpr uint64_t _pidEvent			= 0;
+static constexpr uint64_t _outputEvent		= 1;
+static constexpr uint64_t _restartEvent		= 2;
+static constexpr uint64_t _eventMask		= 3;
+
+ProcessSupervisor* ProcessSupervisor::instance()
+{
+	static std::once_flag once;
+
+	std::call_once(once, []() { _instance = new ProcessSupervisor(); });
+
+	return _instance;
+}
+
+ProcessSupervisor::ProcessSupervisor()
+{
+	_epollFd = epoll_create1(EPOLL_CLOEXEC);
+	if (_epollFd < 0) {
+		logError() << "ProcessSupervisor epoll_create1 failed" << strerror(errno);
+		return;
+	}
+
+	std::thread(&ProcessSupervisor::_run, this).detach();
+
+	// Sampling has a thread of its own, reading /proc and reporting mustn't hold up process output and reaping
+	_resourceTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (_resourceTimerFd < 0) {
+		logError() << "ProcessSupervisor resource timer failed" << strerror(errno);
+	} else {
+		setResourceInterval(_defaultResourceIntervalMSecs);
+		std::thread(&ProcessSupervisor::_resourceThread, this).detach();
+	}
+}
+
+int ProcessSupervisor::pidfdOpen(pid_t pid)
+{
+	return syscall(SYS_pidfd_open, pid, 0);
+}
+
+int ProcessSupervisor::pidfdSendSignal(int pidFd, int signal)
+{
+	return syscall(SYS_pidfd_send_signal, pidFd, signal, NULL, 0);
+}
+
+bool ProcessSupervisor::add(std::shared_ptr<MonitoredProcess> process)
+{
+	// The first cpu and io rates are from the start of the process
+	ResourceSample_t	sample;
+	uint64_t			rssBytes;
+	if (_readResources(process->_pid, sample, rssBytes)) {
+		std::lock_guard<std::mutex> resourceLock(_resourceMutex);
+		_resourceSamples[process->_pid] = sample;
+	}
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	int					pidFd = process->_pidFd;
+	struct epoll_event	event {};
+
+	event.events	= EPOLLIN;
+	event.data.u64	= (uint64_t(pidFd) << 32) | _pidEvent;
+	if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, pidFd, &event) != 0) {
+		logError() << "ProcessSupervisor::add epoll_ctl failed" << process->name() << strerror(errno);
+		return false;
+	}
+
+	event.data.u64 = (uint64_t(pidFd) << 32) | _outputEvent;
+	if (process->_outputFd >= 0 && epoll_ctl(_epollFd, EPOLL_CTL_ADD, process->_outputFd, &event) != 0) {
+		logError() << "ProcessSupervisor::add epoll_ctl failed for output" << process->name() << strerror(errno);
+		process->_closeOutput();
+	}
+
+	_processes[pidFd] = process;
+
+	logDebug() << "ProcessSupervisor: watching" << _processes.size() << "processes";
+
+	return true;
+}
+
+bool ProcessSupervisor::scheduleRestart(std::shared_ptr<MonitoredProcess> process, uint32_t delayMSecs)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	int timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	if (timerFd < 0) {
+		logError() << "ProcessSupervisor::scheduleRestart timerfd_create failed" << process->name() << strerror(errno);
+		return false;
+	}
+
+	// A zero it_value would disarm the timer
+	struct itimerspec	timerSpec	{};
+	uint64_t			delayNSecs	= std::max(uint64_t(delayMSecs) * 1000000, uint64_t(1));
+
+	timerSpec.it_value.tv_sec	= delayNSecs / 1000000000;
+	timerSpec.it_value.tv_nsec	= delayNSecs % 1000000000;
+
+	struct epoll_event event {};
+
+	event.events	= EPOLLIN;
+	event.data.u64	= (uint64_t(timerFd) << 32) | _restartEvent;
+	if (timerfd_settime(timerFd, 0, &timerSpec, NULL) != 0 || epoll_ctl(_epollFd, EPOLL_CTL_ADD, timerFd, &event) != 0) {
+		logError() << "ProcessSupervisor::scheduleRestart failed" << process->name() << strerror(errno);
+		::close(timerFd);
+		return false;
+	}
+
+	_restarts[timerFd] = process;
+
+	return true;
+}
+
+void ProcessSupervisor::_runRestart(int timerFd)
+{
+	std::shared_ptr<MonitoredProcess> process;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		auto it = _restarts.find(timerFd);
+		if (it == _restarts.end()) {
+			return;
+		}
+		process = it->second;
+		_restarts.erase(it);
+
+		epoll_ctl(_epollFd, EPOLL_CTL_DEL, timerFd, NULL);
+		::close(timerFd);
+	}
+
+	process->_restart();
+}
+
+void ProcessSupervisor::setResourceInterval(uint32_t intervalMSecs)
+{
+	struct itimerspec timerSpec {};
+
+	timerSpec.it_value.tv_sec		= intervalMSecs / 1000;
+	timerSpec.it_value.tv_nsec		= (intervalMSecs % 1000) * 1000000;
+	timerSpec.it_interval			= timerSpec.it_value;
+	if (_resourceTimerFd >= 0 && timerfd_settime(_resourceTimerFd, 0, &timerSpec, NULL) != 0) {
+		logError() << "ProcessSupervisor::setResourceInterval timerfd_settime failed" << strerror(errno);
+	}
+}
+
+void ProcessSupervisor::setResourceCallback(ResourceCallback resourceCallback)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_resourceCallback = resourceCallback;
+}
+
+bool ProcessSupervisor::_readResources(pid_t pid, ResourceSample_t& sample, uint64_t& rssBytes)
+{
+	std::string		procPath = "/proc/" + std::to_string(pid);
+	std::ifstream	statFile(procPath + "/stat");
+	std::string		line;
+
+	// The command name in parentheses can contain spaces, the fields after it are counted from 3
+	if (!std::getline(statFile, line) || line.rfind(')') == std::string::npos) {
+		return false;
+	}
+
+	std::istringstream	statFields(line.substr(line.rfind(')') + 1));
+	std::string			field;
+	uint64_t			userTicks	= 0;
+	uint64_t			systemTicks	= 0;
+
+	for (int fieldIndex=3; fieldIndex<=15 && statFields >> field; fieldIndex++) {
+		if (fieldIndex == 14) {
+			userTicks = std::strtoull(field.c_str(), nullptr, 10);
+		} else if (fieldIndex == 15) {
+			systemTicks = std::strtoull(field.c_str(), nullptr, 10);
+		}
+	}
+
+	std::ifstream	statmFile(procPath + "/statm");
+	uint64_t		totalPages		= 0;
+	uint64_t		residentPages	= 0;
+
+	statmFile >> totalPages >> residentPages;
+
+	sample.cpuTicks		= userTicks + systemTicks;
+	sample.readBytes	= 0;
+	sample.writeBytes	= 0;
+	sample.sampleNSecs	= std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	rssBytes			= residentPages * sysconf(_SC_PAGESIZE);
+
+	std::ifstream ioFile(procPath + "/io");
+	while (std::getline(ioFile, line)) {
+		if (line.starts_with("read_bytes: ")) {
+			sample.readBytes = std::strtoull(line.c_str() + 12, nullptr, 10);
+		} else if (line.starts_with("write_bytes: ")) {
+			sample.writeBytes = std::strtoull(line.c_str() + 13, nullptr, 10);
+		}
+	}
+
+	return true;
+}
+
+void ProcessSupervisor::_resourcesSince(const ResourceSample_t& previous, const ResourceSample_t& sample, ProcessResources_t& resources)
+{
+	double secs = (sample.sampleNSecs - previous.sampleNSecs) / 1e9;
+
+	if (secs <= 0) {
+		return;
+	}
+
+	resources.cpuPercent		= (sample.cpuTicks - std::min(previous.cpuTicks, sample.cpuTicks)) * 100.0 / sysconf(_SC_CLK_TCK) / secs;
+	resources.readBytesPerSec	= (sample.readBytes - std::min(previous.readBytes, sample.readBytes)) / secs;
+	resources.writeBytesPerSec	= (sample.writeBytes - std::min(previous.writeBytes, sample.writeBytes)) / secs;
+}
+
+void ProcessSupervisor::_resourceThread(void)
+{
+	while (true) {
+		uint64_t expirations;
+
+		if (read(_resourceTimerFd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+			_sampleResources();
+		} else if (errno != EINTR) {
+			logError() << "ProcessSupervisor resource timer read failed" << strerror(errno);
+			return;
+		}
+	}
+}
+
+// Only the process list is copied under _mutex, /proc is read and the callback called without it
+void ProcessSupervisor::_sampleResources(void)
+{
+	typedef struct {
+		pid_t		pid;
+		std::string	name;
+		uint32_t	tagId;
+	} SampledProcess_t;
+
+	// The controller is sampled while idle too, so its first rates cover the last interval
+	std::vector<SampledProcess_t>	sampledProcesses { { getpid(), "controller", 0 } };
+	ResourceCallback				resourceCallback;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		for (const auto& [pidFd, process]: _processes) {
+			sampledProcesses.push_back({ process->_pid, process->name(), process->tagId() });
+		}
+		resourceCallback = _resourceCallback;
+	}
+
+	std::vector<ProcessResources_t>		resources;
+	std::map<pid_t, ResourceSample_t>	samples;
+
+	for (const SampledProcess_t& sampledProcess: sampledProcesses) {
+		ResourceSample_t	sample;
+		ProcessResources_t	processResources { sampledProcess.name, sampledProcess.pid, sampledProcess.tagId, 0, 0, 0, 0 };
+
+		if (_readResources(sampledProcess.pid, sample, processResources.rssBytes)) {
+			samples[sampledProcess.pid] = sample;
+			resources.push_back(processResources);
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> resourceLock(_resourceMutex);
+
+		for (ProcessResources_t& processResources: resources) {
+			auto it = _resourceSamples.find(processResources.pid);
+			if (it != _resourceSamples.end()) {
+				_resourcesSince(it->second, samples[processResources.pid], processResources);
+			}
+		}
+
+		// Processes which have exited drop out
+		_resourceSamples = std::move(samples);
+	}
+
+	if (sampledProcesses.size() > 1 && resourceCallback) {
+		resourceCallback(resources);
+	}
+}
+
+size_t ProcessSupervisor::processCount(void)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	return _processes.size();
+}
+
+void ProcessSupervisor::_remove(int pidFd)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_processes.erase(pidFd);
+}
+
+void ProcessSupervisor::_run(void)
+{
+	struct epoll_event events[_maxEvents];
+
+	while (true) {
+		int cEvents = epoll_wait(_epollFd, events, _maxEvents, -1);
+		if (cEvents < 0) {
+			if (errno != EINTR) {
+				logError() << "ProcessSupervisor epoll_wait failed" << strerror(errno);
+				return;
+			}
+			continue;
+		}
+
+		for (int i=0; i<cEvents; i++) {
+			int									pidFd	= int(events[i].data.u64 >> 32);
+			bool								output	= (events[i].data.u64 & _eventMask) == _outputEvent;
+			std::shared_ptr<MonitoredProcess>	process;
+
+			if ((events[i].data.u64 & _eventMask) == _restartEvent) {
+				_runRestart(pidFd);
+				continue;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+
+				auto it = _processes.find(pidFd);
+				if (it == _processes.end()) {
+					// Reaped earlier in this batch
+					continue;
+				}
+				process = it->second;
+			}
+
+			if (output) {
+				if (!process->_readOutput()) {
+					epoll_ctl(_epollFd, EPOLL_CTL_DEL, process->_outputFd, NULL);
+					process->_closeOutput();
+				}
+			} else {
+				// Children of the process may still hold the output pipe open, what they wrote so far is kept
+				epoll_ctl(_epollFd, EPOLL_CTL_DEL, pidFd, NULL);
+				if (process->_outputFd >= 0) {
+					process->_readOutput();
+					epoll_ctl(_epollFd, EPOLL_CTL_DEL, process->_outputFd, NULL);
+					process->_closeOutput();
+				}
+				// Removed first, the pidfd number can be reused as soon as it is closed
+				_remove(pidFd);
+				process->_reap();
+			}
+		}
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+class MonitoredProcess;
+
+// Watches all MonitoredProcess children from a single thread. Each child is tracked through a pidfd, which becomes
+// readable once it exits, and its output pipe is copied to the log file from the same epoll loop, so the number of
+// children doesn't change the number of threads. The supervisor holds a reference to each process until it has been
+// reaped and its exit reported. Restart backoffs are timerfds in the same epoll set.
+//
+// While there are processes, their cpu, memory and io use, and that of the controller itself, is sampled from /proc
+// at a fixed interval and handed to the resource callback. Sampling runs on a thread of its own.
+class ProcessSupervisor
+{
+public:
+	typedef struct {
+		std::string	name;
+		pid_t		pid;
+		uint32_t	tagId;				// Detector tag id, 0 for the other processes
+		double		cpuPercent;			// Of one core since the previous sample
+		uint64_t	rssBytes;
+		uint64_t	readBytesPerSec;	// Storage io, pipes and sockets aren't counted
+		uint64_t	writeBytesPerSec;
+	} ProcessResources_t;
+
+	// Called on the resource sampling thread, the controller first unless its /proc entries couldn't be read
+	typedef std::function<void(const std::vector<ProcessResources_t>& resources)> ResourceCallback;
+
+	static ProcessSupervisor* instance();
+
+	// Thread safe. Called by MonitoredProcess::start once the child has been spawned.
+	bool	add				(std::shared_ptr<MonitoredProcess> process);
+	size_t	processCount	(void);
+
+	// Thread safe. The process is kept alive until its restart runs on the supervisor thread.
+	bool	scheduleRestart	(std::shared_ptr<MonitoredProcess> process, uint32_t delayMSecs);
+
+	// Thread safe. 0 stops sampling.
+	void	setResourceInterval	(uint32_t intervalMSecs);
+	void	setResourceCallback	(ResourceCallback resourceCallback);
+
+	// Not available before Linux 5.3, so called through syscall
+	static int pidfdOpen		(pid_t pid);
+	static int pidfdSendSignal	(int pidFd, int signal);
+
+private:
+	typedef struct {
+		uint64_t	cpuTicks;			// User and system time
+		uint64_t	readBytes;
+		uint64_t	writeBytes;
+		uint64_t	sampleNSecs;		// Real time like the /proc counters, not the possibly simulated Clock
+	} ResourceSample_t;
+
+	ProcessSupervisor();
+
+	void _run				(void);
+	void _remove			(int pidFd);
+	void _runRestart		(int timerFd);
+	void _resourceThread	(void);
+	void _sampleResources	(void);
+	bool _readResources		(pid_t pid, ResourceSample_t& sample, uint64_t& rssBytes);
+	void _resourcesSince	(const ResourceSample_t& previous, const ResourceSample_t& sample, ProcessResources_t& resources);
+
+	int													_epollFd = -1;
+	int													_resourceTimerFd = -1;
+	std::mutex											_mutex;
+	std::map<int, std::shared_ptr<MonitoredProcess>>	_processes;			// Keyed by pidfd
+	std::map<int, std::shared_ptr<MonitoredProcess>>	_restarts;			// Keyed by timerfd
+	std::mutex											_resourceMutex;
+	std::map<pid_t, ResourceSample_t>					_resourceSamples;	// Previous sample by pid, the controller included. Protected by _resourceMutex.
+	ResourceCallback									_resourceCallback;
+
+	static ProcessSupervisor*	_instance;
+	static constexpr int		_maxEvents					= 16;
+	static constexpr uint32_t	_defaultResourceIntervalMSecs	= 5000;
+};
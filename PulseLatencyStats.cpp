@@ -0,0 +1,129 @@
+#include "PulseLatencyStats.h"
+#include "LogFileManager.h"
+#include "timeHelpers.h"
+#include "log.h"
+
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <thread>
+
+PulseLatencyStats*	PulseLatencyStats::_instance = nullptr;
+const char*			PulseLatencyStats::_stageNames[StageCount] = { "detector", "enrich", "enqueue", "transmit", "pipeline", "total" };
+
+PulseLatencyStats* PulseLatencyStats::instance()
+{
+	static std::once_flag once;
+
+	std::call_once(once, []() { _instance = new PulseLatencyStats(); });
+
+	return _instance;
+}
+
+PulseLatencyStats::PulseLatencyStats()
+{
+	std::thread([this]() {
+		while (true) {
+			sleepForMSecs(reportIntervalMSecs);
+			if (LogFileManager::instance()->detectorsRunning()) {
+				_writeReport("periodic");
+			}
+		}
+	}).detach();
+}
+
+void PulseLatencyStats::recordTransmitted(const PulseTimestamps_t& timestamps)
+{
+	uint64_t transmittedNSecs			= nsecsMonotonic();
+	uint64_t transmittedRealtimeNSecs	= timestamps.receivedRealtimeNSecs + (transmittedNSecs - timestamps.receivedNSecs);
+	uint64_t startTimeNSecs				= uint64_t(timestamps.startTimeSeconds * 1e9);
+
+	// Clock differences between the detector and us can make the detector stages negative, those are clamped to 0
+	auto usecsBetween = [](uint64_t fromNSecs, uint64_t toNSecs) -> uint64_t {
+		return toNSecs > fromNSecs ? (toNSecs - fromNSecs) / 1000 : 0;
+	};
+
+	uint64_t stageUSecs[StageCount];
+
+	stageUSecs[StageDetector]	= usecsBetween(startTimeNSecs,					timestamps.receivedRealtimeNSecs);
+	stageUSecs[StageEnrich]		= usecsBetween(timestamps.receivedNSecs,		timestamps.enrichedNSecs);
+	stageUSecs[StageEnqueue]	= usecsBetween(timestamps.enrichedNSecs,		timestamps.enqueuedNSecs);
+	stageUSecs[StageTransmit]	= usecsBetween(timestamps.enqueuedNSecs,		transmittedNSecs);
+	stageUSecs[StagePipeline]	= usecsBetween(timestamps.receivedNSecs,		transmittedNSecs);
+	stageUSecs[StageTotal]		= usecsBetween(startTimeNSecs,					transmittedRealtimeNSecs);
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	StageHistograms_t& tagHistograms = _perTag[timestamps.tagId];
+
+	for (int stage=0; stage<StageCount; stage++) {
+		_allTags[stage].record(stageUSecs[stage]);
+		tagHistograms[stage].record(stageUSecs[stage]);
+	}
+}
+
+void PulseLatencyStats::sessionStarted()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	for (auto& histogram : _allTags) {
+		histogram.reset();
+	}
+	_perTag.clear();
+}
+
+void PulseLatencyStats::sessionEnded()
+{
+	_writeReport("session end");
+}
+
+// Works on a copy of the histograms so the pulse send thread never waits on the file write
+void PulseLatencyStats::_writeReport(const char* reason)
+{
+	std::lock_guard<std::mutex> reportLock(_reportMutex);
+
+	StageHistograms_t						allTags;
+	std::map<uint32_t, StageHistograms_t>	perTag;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (_allTags[StageTotal].count() == 0) {
+			return;
+		}
+		allTags	= _allTags;
+		perTag	= _perTag;
+	}
+
+	logInfo() << "Pulse latency pipeline" << allTags[StagePipeline].summary();
+	logInfo() << "Pulse latency total   " << allTags[StageTotal].summary();
+
+	std::string		reportPath	= LogFileManager::instance()->filename("pulse_latency", "txt");
+	std::ofstream	report		(reportPath, std::ios_base::trunc);
+
+	if (!report.is_open()) {
+		logError() << "PulseLatencyStats::_writeReport failed to open" << reportPath;
+		return;
+	}
+
+	time_t now_time_t = msecsSinceEpoch() / 1000;
+	char timeBuffer[80];
+	std::strftime(timeBuffer, sizeof(timeBuffer), "%Y-%m-%d %H:%M:%S", std::gmtime(&now_time_t));
+
+	report << "Pulse latency report (" << reason << ") " << timeBuffer << " UTC\n";
+
+	auto writeHistograms = [&](const char* title, const StageHistograms_t& histograms) {
+		report << "\n" << title << "\n";
+		for (int stage=0; stage<StageCount; stage++) {
+			char stageName[16];
+			snprintf(stageName, sizeof(stageName), "%-9s", _stageNames[stage]);
+			report << "  " << stageName << histograms[stage].summary() << "\n";
+		}
+	};
+
+	writeHistograms("All tags", allTags);
+	for (const auto& [tagId, histograms] : perTag) {
+		std::string title = "Tag " + std::to_string(tagId);
+		writeHistograms(title.c_str(), histograms);
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "LatencyHistogram.h"
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+// Timestamps collected for a single pulse as it moves through the controller
+typedef struct {
+	uint32_t	tagId;
+	double		startTimeSeconds;			// Pulse start time reported by the detector (wall clock)
+	uint64_t	receivedRealtimeNSecs;		// Socket receive time (SO_TIMESTAMPNS, wall clock)
+	uint64_t	receivedNSecs;				// Socket receive time (monotonic)
+	uint64_t	enrichedNSecs;				// Telemetry added (monotonic)
+	uint64_t	enqueuedNSecs;				// Handed to the outgoing message queue (monotonic)
+} PulseTimestamps_t;
+
+// Aggregates per stage, per tag pulse latency histograms. Reports are written to the session log directory
+// periodically while detectors are running and at the end of each session.
+class PulseLatencyStats
+{
+public:
+	static PulseLatencyStats* instance();
+
+	enum Stage {
+		StageDetector,		// Detector pulse start time -> socket receive
+		StageEnrich,		// Socket receive -> telemetry added
+		StageEnqueue,		// Telemetry added -> outgoing queue
+		StageTransmit,		// Outgoing queue -> written to the connection
+		StagePipeline,		// Socket receive -> written to the connection
+		StageTotal,			// Detector pulse start time -> written to the connection
+		StageCount
+	};
+
+	// Called once the pulse's tunnel message has been written to the connection
+	void recordTransmitted	(const PulseTimestamps_t& timestamps);
+
+	void sessionStarted		();
+	void sessionEnded		();
+
+	static constexpr uint64_t reportIntervalMSecs = 60000;
+
+private:
+	PulseLatencyStats();
+
+	typedef std::array<LatencyHistogram, StageCount> StageHistograms_t;
+
+	void _writeReport(const char* reason);
+
+	std::mutex							_mutex;			// Histograms, taken on the pulse send thread
+	std::mutex							_reportMutex;	// One report written at a time
+	StageHistograms_t					_allTags;
+	std::map<uint32_t, StageHistograms_t> _perTag;
+
+	static PulseLatencyStats*	_instance;
+	static const char*			_stageNames[StageCount];
+};
@@ -0,0 +1,161 @@
+/*
+ * Shared memory pulse ring used as an alternative to the UDP pulse port.
+ *
+ * This header is plain C so it can be used by uavrt_detection. Records have exactly the same layout as the
+ * twelve doubles sent over UDP. Any number of detector processes may push, the controller is the single consumer.
+ * After a push the producer bumps the controller's eventfd, whose descriptor number is inherited by processes
+ * started by the controller and published in the PULSE_SHM_EVENTFD_ENV environment variable:
+ *
+ *     PulseShmSegment_t* seg = pulseShmAttach(PULSE_SHM_NAME);
+ *     const char* fdStr = getenv(PULSE_SHM_EVENTFD_ENV);
+ *     pulseShmPush(seg, &record, fdStr ? atoi(fdStr) : -1);
+ *
+ * A producer which dies between claiming a slot and publishing it would leave the consumer waiting on that slot
+ * forever. So the consumer gives up on a slot which stays claimed for too long (pulseShmSkipClaimed) and producers
+ * publish with a compare and swap, a producer which comes back after its slot was given up loses its record.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#define PULSE_SHM_NAME          "/uavrt_pulses"
+#define PULSE_SHM_EVENTFD_ENV   "UAVRT_PULSE_EVENTFD"
+#define PULSE_SHM_MAGIC         0x50564155u    /* "UAVP" */
+#define PULSE_SHM_VERSION       2u
+#define PULSE_SHM_CAPACITY      1024u          /* Must be a power of two */
+
+typedef struct {
+    double tag_id;
+    double frequency_hz;
+    double start_time_seconds;
+    double predict_next_start_seconds;
+    double snr;
+    double stft_score;
+    double group_seq_counter;
+    double group_ind;
+    double group_snr;
+    double detection_status;
+    double confirmed_status;
+    double noise_psd;
+} PulseShmRecord_t;
+
+typedef struct {
+    uint64_t            sequence;   /* Slot state for the bounded multi-producer queue */
+    PulseShmRecord_t    record;
+} PulseShmSlot_t;
+
+typedef struct {
+    uint32_t        magic;
+    uint32_t        version;
+    uint32_t        capacity;
+    uint32_t        recordSize;
+    uint8_t         reserved1[48];
+    uint64_t        enqueuePos;         /* Shared by producers */
+    uint8_t         reserved2[56];
+    uint64_t        dequeuePos;         /* Owned by the controller */
+    uint8_t         reserved3[56];
+    PulseShmSlot_t  slots[PULSE_SHM_CAPACITY];
+} PulseShmSegment_t;
+
+static inline PulseShmSegment_t* pulseShmAttach(const char* name)
+{
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    void* mapping = mmap(NULL, sizeof(PulseShmSegment_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return NULL;
+    }
+    PulseShmSegment_t* segment = (PulseShmSegment_t*)mapping;
+    if (__atomic_load_n(&segment->magic, __ATOMIC_ACQUIRE) != PULSE_SHM_MAGIC || segment->version != PULSE_SHM_VERSION ||
+            segment->capacity != PULSE_SHM_CAPACITY || segment->recordSize != sizeof(PulseShmRecord_t)) {
+        munmap(mapping, sizeof(PulseShmSegment_t));
+        return NULL;
+    }
+    return segment;
+}
+
+/* Producer side. Returns 0 if the ring is full or the consumer gave up on the slot. Pass eventFd < 0 to skip the wakeup. */
+static inline int pulseShmPush(PulseShmSegment_t* segment, const PulseShmRecord_t* record, int eventFd)
+{
+    uint64_t        pos = __atomic_load_n(&segment->enqueuePos, __ATOMIC_RELAXED);
+    PulseShmSlot_t* slot;
+
+    for (;;) {
+        slot = &segment->slots[pos & (PULSE_SHM_CAPACITY - 1)];
+        int64_t diff = (int64_t)__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - (int64_t)pos;
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&segment->enqueuePos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = __atomic_load_n(&segment->enqueuePos, __ATOMIC_RELAXED);
+        }
+    }
+
+    memcpy(&slot->record, record, sizeof(*record));
+
+    uint64_t claimed = pos;
+    if (!__atomic_compare_exchange_n(&slot->sequence, &claimed, pos + 1, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+
+    if (eventFd >= 0) {
+        uint64_t one = 1;
+        ssize_t written = write(eventFd, &one, sizeof(one));
+        (void)written;
+    }
+
+    return 1;
+}
+
+/* Consumer side, controller only. Returns 0 if the ring is empty. */
+static inline int pulseShmPop(PulseShmSegment_t* segment, PulseShmRecord_t* record)
+{
+    uint64_t        pos     = segment->dequeuePos;
+    PulseShmSlot_t* slot    = &segment->slots[pos & (PULSE_SHM_CAPACITY - 1)];
+
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != pos + 1) {
+        return 0;
+    }
+
+    memcpy(record, &slot->record, sizeof(*record));
+    __atomic_store_n(&slot->sequence, pos + PULSE_SHM_CAPACITY, __ATOMIC_RELEASE);
+    segment->dequeuePos = pos + 1;
+
+    return 1;
+}
+
+/* Consumer side. Returns 1 if the next slot has been claimed by a producer but not published yet. */
+static inline int pulseShmHeadClaimed(PulseShmSegment_t* segment)
+{
+    uint64_t        pos     = segment->dequeuePos;
+    PulseShmSlot_t* slot    = &segment->slots[pos & (PULSE_SHM_CAPACITY - 1)];
+
+    return __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) == pos && __atomic_load_n(&segment->enqueuePos, __ATOMIC_ACQUIRE) > pos;
+}
+
+/* Consumer side. Frees the next slot if it is still claimed but unpublished, so the ring moves on without it.
+ * Returns 0 if the producer published it after all, pulseShmPop then returns the record. */
+static inline int pulseShmSkipClaimed(PulseShmSegment_t* segment)
+{
+    uint64_t        pos     = segment->dequeuePos;
+    PulseShmSlot_t* slot    = &segment->slots[pos & (PULSE_SHM_CAPACITY - 1)];
+    uint64_t        claimed = pos;
+
+    if (!__atomic_compare_exchange_n(&slot->sequence, &claimed, pos + PULSE_SHM_CAPACITY, 0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    segment->dequeuePos = pos + 1;
+
+    return 1;
+}
@@ -4,79 +4,107 @@
 #include "TunnelProtocol.h"
 #include "formatString.h"
 #include "log.h"
+#include "Clock.h"
+#include "PulseShm.h"
+
+#include <algorithm>
+#include <queue>
+#include <sstream>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 
 PulseSimulator::PulseSimulator(MavlinkSystem* mavlink, uint32_t antennaOffset)
 	: _mavlink      (mavlink)
     , _antennaOffset(antennaOffset)
 {
-    std::thread([this]()
-    {
-        int     seqCounter = 1;
-        int     intraPulseSeconds = 2.0;
-        int     k = 3;
+    std::thread(&PulseSimulator::_singleTagThread, this).detach();
+}
+
+PulseSimulator::PulseSimulator(MavlinkSystem* mavlink, const LoadConfig_t& loadConfig, UDPPulseReceiver* udpPulseReceiver)
+	: _mavlink          (mavlink)
+    , _loadConfig       (loadConfig)
+    , _udpPulseReceiver (udpPulseReceiver)
+    , _random           (std::random_device{}())
+{
+    if (!_openLoadSender()) {
+        return;
+    }
 
-        while (true) {
-            Telemetry& telemetry = _mavlink->telemetry();
+    std::thread(&PulseSimulator::_loadThread, this).detach();
+}
+
+void PulseSimulator::_singleTagThread(void)
+{
+    int     seqCounter = 1;
+    int     intraPulseSeconds = 2.0;
+    int     k = 3;
+
+    while (true) {
+        Telemetry& telemetry = _mavlink->telemetry();
 
-            TunnelProtocol::PulseInfo_t heartbeatInfo;
+        TunnelProtocol::PulseInfo_t heartbeatInfo;
 
-            memset(&heartbeatInfo, 0, sizeof(heartbeatInfo));
+        memset(&heartbeatInfo, 0, sizeof(heartbeatInfo));
 
-            heartbeatInfo.header.command    = COMMAND_ID_PULSE;
-            heartbeatInfo.frequency_hz      = 0;
+        heartbeatInfo.header.command    = COMMAND_ID_PULSE;
+        heartbeatInfo.frequency_hz      = 0;
 
-            if (telemetry.lastPosition().has_value() && telemetry.lastAttitudeEuler().has_value() && _mavlink->gcsSystemId().has_value()) {
-                heartbeatInfo.tag_id = 2;
-                _mavlink->sendTunnelMessage(&heartbeatInfo, sizeof(heartbeatInfo));
-                heartbeatInfo.tag_id = 3;
-                _mavlink->sendTunnelMessage(&heartbeatInfo, sizeof(heartbeatInfo));
+        if (telemetry.lastPosition().has_value() && telemetry.lastAttitudeEuler().has_value() && _mavlink->gcsSystemId().has_value()) {
+            heartbeatInfo.tag_id = 2;
+            _mavlink->sendTunnelMessage(&heartbeatInfo, sizeof(heartbeatInfo));
+            heartbeatInfo.tag_id = 3;
+            _mavlink->sendTunnelMessage(&heartbeatInfo, sizeof(heartbeatInfo));
 
 				auto vehicleAttitude = telemetry.lastAttitudeEuler().value();
 				auto vehiclePosition = telemetry.lastPosition().value();
 
-                double currentTimeInSeconds = secondsSinceEpoch();
-
-                TunnelProtocol::PulseInfo_t pulseInfo;
-
-                memset(&pulseInfo, 0, sizeof(pulseInfo));
-
-                pulseInfo.header.command                = COMMAND_ID_PULSE;
-                pulseInfo.tag_id                        = 3;
-                pulseInfo.frequency_hz                  = 146000000;
-                pulseInfo.snr                           = _snrFromYaw(vehicleAttitude.yawDegrees);
-                pulseInfo.group_seq_counter             = seqCounter++;
-                pulseInfo.confirmed_status              = 1;
-                pulseInfo.position_x                    = vehiclePosition.latitude;
-                pulseInfo.position_y                    = vehiclePosition.longitude;
-                pulseInfo.position_z                    = vehiclePosition.relativeAltitude;
-                pulseInfo.orientation_x                 = vehicleAttitude.rollDegrees;
-                pulseInfo.orientation_y                 = vehicleAttitude.pitchDegrees;
-                pulseInfo.orientation_z                 = vehicleAttitude.yawDegrees;
-                pulseInfo.noise_psd                     = 1e-9;
-
-                for (int i=2; i>=0; i--) {
-                    pulseInfo.start_time_seconds            = currentTimeInSeconds - (i * intraPulseSeconds);
-                    pulseInfo.group_ind                     = i + 1;
-
-                    std::string pulseStatus = formatString("Conf: %u Id: %2u snr: %5.1f noise_psd: %5.1g freq: %9u lat/lon/yaw/alt: %3.6f %3.6f %4.0f %3.0f",
-                                                    pulseInfo.confirmed_status,
-                                                    pulseInfo.tag_id,
-                                                    pulseInfo.snr,
-                                                    pulseInfo.noise_psd,
-                                                    pulseInfo.frequency_hz,
-                                                    vehiclePosition.latitude,
-                                                    vehiclePosition.longitude,
-                                                    vehicleAttitude.yawDegrees,
-                                                    vehiclePosition.relativeAltitude);
-                    logInfo() << pulseStatus;
-
-                    _mavlink->sendTunnelMessage(&pulseInfo, sizeof(pulseInfo));
-                }
-            }
+            double currentTimeInSeconds = secondsSinceEpoch();
+
+            TunnelProtocol::PulseInfo_t pulseInfo;
 
-            std::this_thread::sleep_for(std::chrono::milliseconds(intraPulseSeconds * (k + 1) * 1000));
+            memset(&pulseInfo, 0, sizeof(pulseInfo));
+
+            pulseInfo.header.command                = COMMAND_ID_PULSE;
+            pulseInfo.tag_id                        = 3;
+            pulseInfo.frequency_hz                  = 146000000;
+            pulseInfo.snr                           = _snrFromYaw(vehicleAttitude.yawDegrees);
+            pulseInfo.group_seq_counter             = seqCounter++;
+            pulseInfo.confirmed_status              = 1;
+            pulseInfo.position_x                    = vehiclePosition.latitude;
+            pulseInfo.position_y                    = vehiclePosition.longitude;
+            pulseInfo.position_z                    = vehiclePosition.relativeAltitude;
+            pulseInfo.orientation_x                 = vehicleAttitude.rollDegrees;
+            pulseInfo.orientation_y                 = vehicleAttitude.pitchDegrees;
+            pulseInfo.orientation_z                 = vehicleAttitude.yawDegrees;
+            pulseInfo.noise_psd                     = 1e-9;
+
+            for (int i=2; i>=0; i--) {
+                pulseInfo.start_time_seconds            = currentTimeInSeconds - (i * intraPulseSeconds);
+                pulseInfo.group_ind                     = i + 1;
+
+                std::string pulseStatus = formatString("Conf: %u Id: %2u snr: %5.1f noise_psd: %5.1g freq: %9u lat/lon/yaw/alt: %3.6f %3.6f %4.0f %3.0f",
+                                                pulseInfo.confirmed_status,
+                                                pulseInfo.tag_id,
+                                                pulseInfo.snr,
+                                                pulseInfo.noise_psd,
+                                                pulseInfo.frequency_hz,
+                                                vehiclePosition.latitude,
+                                                vehiclePosition.longitude,
+                                                vehicleAttitude.yawDegrees,
+                                                vehiclePosition.relativeAltitude);
+                logInfo() << pulseStatus;
+
+                _mavlink->sendTunnelMessage(&pulseInfo, sizeof(pulseInfo));
+            }
         }
-    }).detach();
+
+        sleepForMSecs(intraPulseSeconds * (k + 1) * 1000);
+    }
 }
 
 double PulseSimulator::_normalizeYaw(double yaw)
@@ -103,3 +131,300 @@ double PulseSimulator::_snrFromYaw(double vehicleYawDegrees)
 
     return (antennaYawDegrees / 180.0) * maxSnr;
 }
+
+bool PulseSimulator::parseLoadConfig(const std::string& settings, LoadConfig_t& loadConfig)
+{
+    std::stringstream   settingsStream(settings);
+    std::string         setting;
+
+    while (std::getline(settingsStream, setting, ',')) {
+        if (setting.empty()) {
+            continue;
+        }
+
+        auto equalsIndex = setting.find('=');
+        if (equalsIndex == std::string::npos) {
+            logError() << "PulseSimulator: load setting missing '=':" << setting;
+            return false;
+        }
+
+        std::string key     = setting.substr(0, equalsIndex);
+        std::string value   = setting.substr(equalsIndex + 1);
+
+        try {
+            if (key == "tags") {
+                loadConfig.tagCount = std::stoul(value);
+            } else if (key == "id") {
+                loadConfig.firstTagId = std::stoul(value);
+            } else if (key == "ip") {
+                loadConfig.intraPulseMSecs = std::stoul(value);
+            } else if (key == "k") {
+                loadConfig.k = std::stoul(value);
+            } else if (key == "jitter") {
+                loadConfig.jitterMSecs = std::stoul(value);
+            } else if (key == "batch") {
+                loadConfig.pulsesPerDatagram = std::clamp<uint32_t>(std::stoul(value), 1, 15);
+            } else if (key == "duration") {
+                loadConfig.durationSecs = std::stoul(value);
+            } else if (key == "snr") {
+                if (value == "yaw") {
+                    loadConfig.snrModel = SnrYaw;
+                } else if (value.starts_with("constant:")) {
+                    loadConfig.snrModel = SnrConstant;
+                    loadConfig.snrDb    = std::stod(value.substr(9));
+                } else if (value.starts_with("random:")) {
+                    std::string params  = value.substr(7);
+                    auto        colon   = params.find(':');
+
+                    loadConfig.snrModel     = SnrRandom;
+                    loadConfig.snrDb        = std::stod(params.substr(0, colon));
+                    loadConfig.snrStdDev    = colon == std::string::npos ? 3.0 : std::stod(params.substr(colon + 1));
+                } else {
+                    logError() << "PulseSimulator: unknown snr model:" << value;
+                    return false;
+                }
+            } else {
+                logError() << "PulseSimulator: unknown load setting:" << key;
+                return false;
+            }
+        } catch (const std::exception& e) {
+            logError() << "PulseSimulator: invalid value for" << key << ":" << value;
+            return false;
+        }
+    }
+
+    if (loadConfig.tagCount == 0 || loadConfig.intraPulseMSecs == 0) {
+        logError() << "PulseSimulator: load needs at least one tag and a non-zero intra pulse interval";
+        return false;
+    }
+
+    return true;
+}
+
+bool PulseSimulator::_openLoadSender(void)
+{
+    const std::string& url = _loadConfig.pulseTransportUrl;
+
+    if (url.starts_with("udp://")) {
+        std::string         conn = url.substr(std::string("udp://").length());
+        struct sockaddr_in  addr {};
+
+        addr.sin_family         = AF_INET;
+        addr.sin_addr.s_addr    = inet_addr(conn.substr(0, conn.find(':')).c_str());
+        addr.sin_port           = htons(std::stoi(conn.substr(conn.find(':') + 1)));
+
+        _fdSocket       = socket(AF_INET, SOCK_DGRAM, 0);
+        _socketAddress  = std::string(reinterpret_cast<const char*>(&addr), sizeof(addr));
+    } else if (url.starts_with("unix://")) {
+        struct sockaddr_un addr {};
+
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, url.substr(std::string("unix://").length()).c_str(), sizeof(addr.sun_path) - 1);
+
+        _fdSocket       = socket(AF_UNIX, SOCK_DGRAM, 0);
+        _socketAddress  = std::string(reinterpret_cast<const char*>(&addr), sizeof(addr));
+    } else if (url.starts_with("shm://")) {
+        const char* eventFdEnv = getenv(PULSE_SHM_EVENTFD_ENV);
+
+        _shmSegment = pulseShmAttach(std::string("/").append(url, std::string("shm://").length()).c_str());
+        _shmEventFd = eventFdEnv ? atoi(eventFdEnv) : -1;
+        if (!_shmSegment) {
+            logError() << "PulseSimulator: unable to attach to" << url;
+            return false;
+        }
+        return true;
+    } else {
+        logError() << "PulseSimulator: load generator does not support pulse transport" << url;
+        return false;
+    }
+
+    if (_fdSocket < 0) {
+        logError() << "PulseSimulator: socket failed" << strerror(errno);
+        return false;
+    }
+
+    return true;
+}
+
+bool PulseSimulator::_sendLoad(const UDPPulseReceiver::UDPPulseInfo_T* pulses, int pulseCount)
+{
+    if (_shmSegment) {
+        for (int i=0; i<pulseCount; i++) {
+            if (!pulseShmPush(static_cast<PulseShmSegment_t*>(_shmSegment), reinterpret_cast<const PulseShmRecord_t*>(&pulses[i]), _shmEventFd)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    ssize_t cBytes = sendto(_fdSocket,
+                            pulses,
+                            pulseCount * sizeof(UDPPulseReceiver::UDPPulseInfo_T),
+                            0,
+                            reinterpret_cast<const sockaddr*>(_socketAddress.data()),
+                            _socketAddress.size());
+
+    return cBytes == ssize_t(pulseCount * sizeof(UDPPulseReceiver::UDPPulseInfo_T));
+}
+
+double PulseSimulator::_loadSnr(void)
+{
+    switch (_loadConfig.snrModel) {
+    case SnrRandom:
+        return std::max(0.0, std::normal_distribution<double>(_loadConfig.snrDb, _loadConfig.snrStdDev)(_random));
+    case SnrYaw:
+    {
+        auto attitude = _mavlink->telemetry().lastAttitudeEuler();
+        if (attitude.has_value()) {
+            return _snrFromYaw(attitude.value().yawDegrees);
+        }
+    }
+        break;
+    case SnrConstant:
+        break;
+    }
+
+    return _loadConfig.snrDb;
+}
+
+void PulseSimulator::_logLoadStats(const char* reason, uint64_t elapsedNSecs)
+{
+    auto    counts          = _udpPulseReceiver->pulseCounts();
+    uint64_t sentRecords    = _sentPulses + _sentHeartbeats;
+    double  elapsedSecs     = elapsedNSecs / 1e9;
+
+    logInfo() << formatString("PulseSimulator load %s: %.0f secs sent pulses: %llu (%.0f/sec) heartbeats: %llu send failures: %llu",
+                                reason,
+                                elapsedSecs,
+                                (unsigned long long)_sentPulses,
+                                elapsedSecs > 0 ? _sentPulses / elapsedSecs : 0.0,
+                                (unsigned long long)_sentHeartbeats,
+                                (unsigned long long)_sendFailures);
+    logInfo() << formatString("PulseSimulator load %s: received: %llu lost in transport: %lld forwarded: %llu dropped in pipeline: %llu outgoing queue: %zu",
+                                reason,
+                                (unsigned long long)counts.received,
+                                (long long)sentRecords - (long long)counts.received,
+                                (unsigned long long)counts.forwarded,
+                                (unsigned long long)counts.dropped,
+                                _mavlink->outgoingMessageQueue().size());
+}
+
+void PulseSimulator::_loadThread(void)
+{
+    const uint64_t  msecsToNSecs        = 1000000;
+    const uint64_t  intraPulseNSecs     = _loadConfig.intraPulseMSecs * msecsToNSecs;
+    const uint64_t  heartbeatNSecs      = intraPulseNSecs * (_loadConfig.k + 1);
+    const uint64_t  startNSecs          = nsecsMonotonic();
+    const uint64_t  endNSecs            = _loadConfig.durationSecs ? startNSecs + _loadConfig.durationSecs * 1000 * msecsToNSecs : UINT64_MAX;
+    uint64_t        nextStatsNSecs      = startNSecs + _loadStatsIntervalMSecs * msecsToNSecs;
+    std::vector<LoadTag_t> tags         (_loadConfig.tagCount);
+
+    std::uniform_int_distribution<int64_t> jitterDistribution(-int64_t(_loadConfig.jitterMSecs * msecsToNSecs), int64_t(_loadConfig.jitterMSecs * msecsToNSecs));
+
+    logInfo() << formatString("PulseSimulator load: %u tags ip: %u ms k: %u jitter: %u ms -> %.0f pulses/sec to %s",
+                                _loadConfig.tagCount,
+                                _loadConfig.intraPulseMSecs,
+                                _loadConfig.k,
+                                _loadConfig.jitterMSecs,
+                                _loadConfig.tagCount * 1000.0 / _loadConfig.intraPulseMSecs,
+                                _loadConfig.pulseTransportUrl.c_str());
+
+    // Tags are spread evenly over the first interval so they don't all pulse at the same moment
+    typedef std::pair<uint64_t, uint32_t> Event_t;    // Due time, tag index
+    std::priority_queue<Event_t, std::vector<Event_t>, std::greater<Event_t>> events;
+
+    for (uint32_t i=0; i<_loadConfig.tagCount; i++) {
+        LoadTag_t& tag = tags[i];
+
+        tag.tagId               = _loadConfig.firstTagId + (i * 2);     // Odd ids are left for secondary channels, like real detectors
+        tag.nextPulseNSecs      = startNSecs + (intraPulseNSecs * i) / _loadConfig.tagCount;
+        tag.nextHeartbeatNSecs  = tag.nextPulseNSecs;
+        tag.groupSeqCounter     = 1;
+        tag.groupInd            = 1;
+
+        events.push({ tag.nextPulseNSecs, i });
+    }
+
+    std::vector<UDPPulseReceiver::UDPPulseInfo_T> batch;
+    batch.reserve(_loadConfig.pulsesPerDatagram);
+
+    auto flushBatch = [&]() {
+        if (batch.empty()) {
+            return;
+        }
+        if (!_sendLoad(batch.data(), batch.size())) {
+            _sendFailures++;
+        }
+        batch.clear();
+    };
+
+    while (true) {
+        uint64_t nowNSecs = nsecsMonotonic();
+
+        if (nowNSecs >= endNSecs) {
+            break;
+        }
+
+        while (!events.empty() && events.top().first <= nowNSecs) {
+            LoadTag_t&                          tag     = tags[events.top().second];
+            double                              nowSecs = secondsSinceEpoch();
+            UDPPulseReceiver::UDPPulseInfo_T    pulse   {};
+
+            events.pop();
+
+            if (tag.nextHeartbeatNSecs <= nowNSecs) {
+                pulse.tag_id        = tag.tagId;
+                pulse.noise_psd     = 1e-9;
+                batch.push_back(pulse);
+                _sentHeartbeats++;
+                tag.nextHeartbeatNSecs += heartbeatNSecs;
+                if (batch.size() >= _loadConfig.pulsesPerDatagram) {
+                    flushBatch();
+                }
+            }
+
+            pulse.tag_id                        = tag.tagId;
+            pulse.frequency_hz                  = 146000000 + (tag.tagId * 1000);
+            pulse.start_time_seconds            = nowSecs;
+            pulse.predict_next_start_seconds    = nowSecs + _loadConfig.intraPulseMSecs / 1000.0;
+            pulse.snr                           = _loadSnr();
+            pulse.stft_score                    = pulse.snr;
+            pulse.group_seq_counter             = tag.groupSeqCounter;
+            pulse.group_ind                     = tag.groupInd;
+            pulse.group_snr                     = pulse.snr;
+            pulse.detection_status              = 1;
+            pulse.confirmed_status              = 1;
+            pulse.noise_psd                     = 1e-9;
+
+            batch.push_back(pulse);
+            _sentPulses++;
+            if (batch.size() >= _loadConfig.pulsesPerDatagram) {
+                flushBatch();
+            }
+
+            if (++tag.groupInd > _loadConfig.k + 1) {
+                tag.groupInd = 1;
+                tag.groupSeqCounter++;
+            }
+
+            int64_t jitterNSecs = _loadConfig.jitterMSecs ? jitterDistribution(_random) : 0;
+            tag.nextPulseNSecs += intraPulseNSecs;
+            events.push({ uint64_t(int64_t(tag.nextPulseNSecs) + jitterNSecs), uint32_t(&tag - tags.data()) });
+        }
+        flushBatch();
+
+        if (nowNSecs >= nextStatsNSecs) {
+            nextStatsNSecs += _loadStatsIntervalMSecs * msecsToNSecs;
+            _logLoadStats("running", nowNSecs - startNSecs);
+        }
+
+        if (!events.empty()) {
+            Clock::instance()->sleepUntilMonotonicNSecs(std::min(events.top().first, nextStatsNSecs));
+        }
+    }
+
+    // Give the pipeline a moment to drain before the final tally
+    uint64_t elapsedNSecs = nsecsMonotonic() - startNSecs;
+    sleepForMSecs(2000);
+    _logLoadStats("complete", elapsedNSecs);
+}
@@ -4,20 +4,79 @@
 
 #include "ThreadSafeQueue.h"
 #include "MavlinkSystem.h"
+#include "UDPPulseReceiver.h"
 
 #include <string>
 #include <thread>
 #include <optional>
+#include <random>
 
+// Two modes:
+//	- Single simulated tag whose pulses are sent straight to the GCS (--simulate-pulse:<antenna offset>)
+//	- Load generator which sends UDPPulseInfo_T records for many tags to the pulse transport, exercising the whole
+//	  pulse pipeline (--simulate-load:<settings>, see parseLoadConfig)
 class PulseSimulator
 {
 public:
+	enum SnrModel {
+		SnrConstant,	// snrDb
+		SnrRandom,		// Normal distribution around snrDb with snrStdDev
+		SnrYaw,			// From vehicle yaw like the single tag simulator, snrDb if no telemetry yet
+	};
+
+	typedef struct {
+		uint32_t	tagCount			= 10;
+		uint32_t	firstTagId			= 2;
+		uint32_t	intraPulseMSecs		= 2000;
+		uint32_t	k					= 3;
+		uint32_t	jitterMSecs			= 0;	// Each intra pulse interval is randomly moved by up to +/- jitter
+		SnrModel	snrModel			= SnrConstant;
+		double		snrDb				= 20;
+		double		snrStdDev			= 3;
+		uint32_t	pulsesPerDatagram	= 1;	// Pulses due at the same time are batched up to this many per datagram
+		uint32_t	durationSecs		= 0;	// 0 to run forever
+		std::string	pulseTransportUrl;
+	} LoadConfig_t;
+
 	PulseSimulator(MavlinkSystem* mavlink, uint32_t antennaOffset);
+	PulseSimulator(MavlinkSystem* mavlink, const LoadConfig_t& loadConfig, UDPPulseReceiver* udpPulseReceiver);
+
+	// Parses comma separated key=value settings on top of the defaults:
+	//	tags=<count>,id=<first tag id>,ip=<intra pulse msecs>,k=<k>,jitter=<msecs>,
+	//	snr=constant:<db>|random:<db>:<stddev>|yaw,batch=<pulses per datagram>,duration=<secs>
+	static bool parseLoadConfig(const std::string& settings, LoadConfig_t& loadConfig);
 
 private:
-	double _snrFromYaw	(double vehicleYawDegrees);
-	double _normalizeYaw(double yaw);
+	typedef struct {
+		uint32_t	tagId;
+		uint64_t	nextPulseNSecs;
+		uint64_t	nextHeartbeatNSecs;
+		uint16_t	groupSeqCounter;
+		uint16_t	groupInd;
+	} LoadTag_t;
+
+	void	_singleTagThread	(void);
+	void	_loadThread			(void);
+	bool	_openLoadSender		(void);
+	bool	_sendLoad			(const UDPPulseReceiver::UDPPulseInfo_T* pulses, int pulseCount);
+	double	_loadSnr			(void);
+	void	_logLoadStats		(const char* reason, uint64_t elapsedNSecs);
+	double	_snrFromYaw			(double vehicleYawDegrees);
+	double	_normalizeYaw		(double yaw);
+
+	MavlinkSystem* 		_mavlink {}; 
+	uint32_t 			_antennaOffset {};
+
+	LoadConfig_t		_loadConfig {};
+	UDPPulseReceiver*	_udpPulseReceiver	= nullptr;
+	std::mt19937		_random;
+	int					_fdSocket			= -1;
+	std::string			_socketAddress;			// sockaddr for the udp/unix transports
+	void*				_shmSegment			= nullptr;
+	int					_shmEventFd			= -1;
+	uint64_t			_sentPulses			= 0;
+	uint64_t			_sentHeartbeats		= 0;
+	uint64_t			_sendFailures		= 0;
 
-	MavlinkSystem* 	_mavlink {}; 
-	uint32_t 		_antennaOffset {};
+	static constexpr uint64_t _loadStatsIntervalMSecs = 10000;
 };
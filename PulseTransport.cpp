@@ -0,0 +1,71 @@
+#include "PulseTransport.h"
+#include "UdpPulseTransport.h"
+#include "UnixPulseTransport.h"
+#include "ShmPulseTransport.h"
+#include "ReplayPulseTransport.h"
+#include "log.h"
+#include "timeHelpers.h"
+#include "Clock.h"
+
+#include <sys/socket.h>
+#include <errno.h>
+#include <string.h>
+
+std::unique_ptr<PulseTransport> PulseTransport::create(const std::string& url)
+{
+	if (url.starts_with("udp://")) {
+		return std::make_unique<UdpPulseTransport>(url);
+	} else if (url.starts_with("unix://")) {
+		return std::make_unique<UnixPulseTransport>(url);
+	} else if (url.starts_with("shm://")) {
+		return std::make_unique<ShmPulseTransport>(url);
+	} else if (url.starts_with("replay:")) {
+		return std::make_unique<ReplayPulseTransport>(url);
+	}
+
+	logError() << "Invalid pulse transport url:" << url;
+	return nullptr;
+}
+
+bool PulseTransport::_enableTimestamps(int fdSocket)
+{
+	int enable = 1;
+
+	if (setsockopt(fdSocket, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) != 0) {
+		logWarn() << "SO_TIMESTAMPNS not supported, using user space receive times" << strerror(errno);
+		return false;
+	}
+
+	return true;
+}
+
+ssize_t PulseTransport::_receiveWithTimestamp(int fdSocket, void* buffer, size_t cBuffer, uint64_t& receivedRealtimeNSecs)
+{
+	struct iovec	iov			{ buffer, cBuffer };
+	char			control		[CMSG_SPACE(sizeof(struct timespec))];
+	struct msghdr	msg			{};
+
+	msg.msg_iov			= &iov;
+	msg.msg_iovlen		= 1;
+	msg.msg_control		= control;
+	msg.msg_controllen	= sizeof(control);
+
+	ssize_t cBytesReceived = recvmsg(fdSocket, &msg, 0);
+
+	receivedRealtimeNSecs = 0;
+	if (cBytesReceived >= 0) {
+		for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+				struct timespec ts;
+				memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+				receivedRealtimeNSecs = uint64_t(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+			}
+		}
+		// Kernel timestamps are meaningless against a simulated clock
+		if (receivedRealtimeNSecs == 0 || !Clock::instance()->isRealTime()) {
+			receivedRealtimeNSecs = nsecsSinceEpoch();
+		}
+	}
+
+	return cBytesReceived;
+}
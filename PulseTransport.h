@@ -0,0 +1,39 @@
+#pragma once
+
+#include "UDPPulseReceiver.h"
+
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <sys/types.h>
+
+// Transport which delivers detector pulses to UDPPulseReceiver. Selected by url:
+//	udp://<ip>:<port>	- UDP datagrams of UDPPulseInfo_T records (default: udp://127.0.0.1:50000)
+//	unix://<path>		- AF_UNIX datagrams of UDPPulseInfo_T records
+//	shm://<name>		- PulseShm.h shared memory ring with eventfd notification
+//	replay:				- pulses from the capture being replayed (see ReplayPlayer.h)
+class PulseTransport
+{
+public:
+	virtual ~PulseTransport() = default;
+
+	static std::unique_ptr<PulseTransport> create(const std::string& url);
+
+	virtual bool open	() = 0;
+	virtual void close	() = 0;
+
+	// Blocks until pulses are available. Returns the number of pulses placed in buffer, -1 once the transport is closed.
+	// receivedRealtimeNSecs is set to the wall clock time the pulses arrived, from the kernel when the transport supports it.
+	virtual int receivePulses(UDPPulseReceiver::UDPPulseInfo_T* buffer, int maxPulses, uint64_t& receivedRealtimeNSecs) = 0;
+
+	const std::string& url() const { return _url; }
+
+protected:
+	PulseTransport(const std::string& url) : _url(url) {}
+
+	// Shared by the socket transports: recv with an SO_TIMESTAMPNS receive timestamp
+	static ssize_t _receiveWithTimestamp(int fdSocket, void* buffer, size_t cBuffer, uint64_t& receivedRealtimeNSecs);
+	static bool _enableTimestamps(int fdSocket);
+
+	std::string _url;
+};
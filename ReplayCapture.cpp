@@ -0,0 +1,65 @@
+#include "ReplayCapture.h"
+#include "timeHelpers.h"
+#include "log.h"
+
+#include <errno.h>
+#include <string.h>
+
+ReplayCapture* ReplayCapture::_instance = nullptr;
+
+ReplayCapture* ReplayCapture::instance()
+{
+	static std::once_flag once;
+
+	std::call_once(once, []() { _instance = new ReplayCapture(); });
+
+	return _instance;
+}
+
+bool ReplayCapture::open(const std::string& path)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_file = fopen(path.c_str(), "wb");
+	if (!_file) {
+		logError() << "ReplayCapture::open failed" << path << strerror(errno);
+		return false;
+	}
+
+	ReplayCaptureHeader_t header;
+
+	header.magic				= REPLAY_CAPTURE_MAGIC;
+	header.version				= REPLAY_CAPTURE_VERSION;
+	header.startRealtimeNSecs	= nsecsSinceEpoch();
+
+	fwrite(&header, sizeof(header), 1, _file);
+	fflush(_file);
+
+	_startRealtimeNSecs	= header.startRealtimeNSecs;
+	_capturing			= true;
+
+	logInfo() << "Capturing MAVLink and pulse input to" << path;
+
+	return true;
+}
+
+void ReplayCapture::write(Source source, const void* data, size_t length)
+{
+	if (!_capturing) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	ReplayCaptureChunk_t chunk;
+
+	chunk.offsetNSecs	= nsecsSinceEpoch() - _startRealtimeNSecs;
+	chunk.source		= source;
+	chunk.length		= length;
+
+	fwrite(&chunk, sizeof(chunk), 1, _file);
+	fwrite(data, length, 1, _file);
+
+	// Flush each chunk so a capture is usable even when the controller is killed
+	fflush(_file);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+// Capture file used by the replay harness (see ReplayPlayer.h). It holds everything which arrived from the outside
+// world, in arrival order:
+//	ReplayCaptureHeader_t
+//	ReplayCaptureChunk_t + <length> bytes
+//	...
+
+#define REPLAY_CAPTURE_MAGIC	0x43564155u		// "UAVC"
+#define REPLAY_CAPTURE_VERSION	1u
+
+typedef struct {
+	uint32_t	magic;
+	uint32_t	version;
+	uint64_t	startRealtimeNSecs;		// Wall clock time the capture was started
+} ReplayCaptureHeader_t;
+
+typedef struct {
+	uint64_t	offsetNSecs;			// Arrival time relative to startRealtimeNSecs
+	uint32_t	source;					// ReplayCapture::Source
+	uint32_t	length;
+} ReplayCaptureChunk_t;
+
+// Writes the capture file. Enabled from the command line with --capture:<file>.
+class ReplayCapture
+{
+public:
+	enum Source {
+		SourceMavlink	= 1,	// Raw bytes read from the MAVLink connection
+		SourcePulses	= 2,	// Array of UDPPulseReceiver::UDPPulseInfo_T as read from the pulse transport
+	};
+
+	static ReplayCapture* instance();
+
+	bool open	(const std::string& path);
+	void write	(Source source, const void* data, size_t length);	// Thread safe, no-op if not capturing
+
+private:
+	ReplayCapture() = default;
+
+	std::atomic_bool	_capturing			{ false };
+	std::mutex			_mutex;
+	FILE*				_file				= nullptr;
+	uint64_t			_startRealtimeNSecs	= 0;
+
+	static ReplayCapture* _instance;
+};
@@ -0,0 +1,38 @@
+#include "ReplayConnection.h"
+#include "ReplayPlayer.h"
+#include "log.h"
+
+ReplayConnection::ReplayConnection(MavlinkSystem* mavlink)
+	: Connection(mavlink)
+{
+
+}
+
+bool ReplayConnection::_open()
+{
+	if (!ReplayPlayer::instance()->active()) {
+		logError() << "ReplayConnection::_open - no capture to replay, use --replay:<capture file>";
+		return false;
+	}
+
+	_started = true;
+
+	return true;
+}
+
+void ReplayConnection::_close()
+{
+	_started = false;
+}
+
+ssize_t ReplayConnection::_receiveBytes(uint8_t* buffer, size_t cBuffer)
+{
+	return ReplayPlayer::instance()->receiveMavlinkBytes(buffer, cBuffer);
+}
+
+bool ReplayConnection::_sendMessage(const mavlink_message_t& message)
+{
+	ReplayPlayer::instance()->writeOutgoing(message);
+
+	return true;
+}
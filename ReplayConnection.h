@@ -0,0 +1,24 @@
+#pragma once
+
+#include "Connection.h"
+
+class MavlinkSystem;
+
+// Connection which reads its input from ReplayPlayer and writes outgoing tunnel messages to the replay output
+// instead of a link. Selected with the connection url "replay:".
+class ReplayConnection : public Connection
+{
+public:
+	ReplayConnection(MavlinkSystem* mavlink);
+
+	// Non-copyable
+	ReplayConnection(const ReplayConnection&) = delete;
+	const ReplayConnection& operator=(const ReplayConnection&) = delete;
+
+protected:
+	// Connection overrides
+	bool 	_open			() override;
+	void 	_close			() override;
+	ssize_t _receiveBytes	(uint8_t* buffer, size_t cBuffer) override;
+	bool 	_sendMessage	(const mavlink_message_t& message) override;
+};
@@ -0,0 +1,265 @@
+#include "ReplayPlayer.h"
+#include "timeHelpers.h"
+#include "Clock.h"
+#include "formatString.h"
+#include "TunnelProtocol.h"
+#include "log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include <errno.h>
+#include <string.h>
+
+ReplayPlayer* ReplayPlayer::_instance = nullptr;
+
+ReplayPlayer* ReplayPlayer::instance()
+{
+	static std::once_flag once;
+
+	std::call_once(once, []() { _instance = new ReplayPlayer(); });
+
+	return _instance;
+}
+
+ReplayPlayer::ReplayPlayer()
+	: _mavlinkQueue	(_queueSize)
+	, _pulseQueue	(_queueSize)
+{
+
+}
+
+bool ReplayPlayer::open(const std::string& capturePath, const std::string& outputPath, bool fast, SimulatedClock* clock)
+{
+	_captureFile = fopen(capturePath.c_str(), "rb");
+	if (!_captureFile) {
+		logError() << "ReplayPlayer::open unable to open capture" << capturePath << strerror(errno);
+		return false;
+	}
+
+	if (fread(&_header, sizeof(_header), 1, _captureFile) != 1 || _header.magic != REPLAY_CAPTURE_MAGIC || _header.version != REPLAY_CAPTURE_VERSION) {
+		logError() << "ReplayPlayer::open not a supported capture file" << capturePath;
+		fclose(_captureFile);
+		_captureFile = nullptr;
+		return false;
+	}
+
+	_outputFile = fopen(outputPath.c_str(), "w");
+	if (!_outputFile) {
+		logError() << "ReplayPlayer::open unable to create output" << outputPath << strerror(errno);
+		fclose(_captureFile);
+		_captureFile = nullptr;
+		return false;
+	}
+
+	// Pulse times and the telemetry replayed alongside them then line up without rewriting anything
+	_clock		= clock;
+	_clock->setRealtime(_header.startRealtimeNSecs);
+	_startNSecs	= _clock->monotonicNSecs();
+
+	_fast	= fast;
+	_active	= true;
+
+	logInfo() << "Replaying" << capturePath << (fast ? "fast" : "real time") << "- tunnel output to" << outputPath;
+
+	return true;
+}
+
+void ReplayPlayer::start(void)
+{
+	if (_active) {
+		std::thread(&ReplayPlayer::_dispatchThread, this).detach();
+	}
+}
+
+void ReplayPlayer::close(void)
+{
+	std::lock_guard<std::mutex> lock(_outputMutex);
+
+	if (!_outputFile) {
+		return;
+	}
+
+	for (const auto& [command, lines] : _outputLines) {
+		for (size_t i=0; i<lines.size(); i++) {
+			fprintf(_outputFile, "%06zu %s\n", i, lines[i].c_str());
+		}
+	}
+	_outputLines.clear();
+
+	fclose(_outputFile);
+	_outputFile = nullptr;
+}
+
+bool ReplayPlayer::_nextChunk(ReplayCaptureChunk_t& chunkHeader, Chunk_t& chunk)
+{
+	if (fread(&chunkHeader, sizeof(chunkHeader), 1, _captureFile) != 1) {
+		return false;
+	}
+
+	chunk.resize(chunkHeader.length);
+	if (chunkHeader.length && fread(chunk.data(), chunkHeader.length, 1, _captureFile) != 1) {
+		logWarn() << "ReplayPlayer: capture truncated mid chunk";
+		return false;
+	}
+
+	return true;
+}
+
+void ReplayPlayer::_deliver(ThreadSafeQueue<Chunk_t>& queue, const Chunk_t& chunk)
+{
+	// In fast mode the reader may fall behind, wait for room rather than dropping input
+	while (!queue.push_back(chunk)) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+void ReplayPlayer::_dispatchThread(void)
+{
+	ReplayCaptureChunk_t	chunkHeader;
+	Chunk_t					chunk;
+	uint64_t				chunkCount	= 0;
+
+	while (_nextChunk(chunkHeader, chunk)) {
+		uint64_t chunkNSecs = _startNSecs + chunkHeader.offsetNSecs;
+
+		if (_fast) {
+			uint64_t nowNSecs = _clock->monotonicNSecs();
+			if (chunkNSecs > nowNSecs) {
+				_clock->advance(chunkNSecs - nowNSecs);
+			}
+		} else {
+			_clock->sleepUntilMonotonicNSecs(chunkNSecs);
+		}
+
+		switch (chunkHeader.source) {
+		case ReplayCapture::SourceMavlink:
+			_deliver(_mavlinkQueue, chunk);
+			break;
+		case ReplayCapture::SourcePulses:
+			_deliver(_pulseQueue, chunk);
+			break;
+		default:
+			logWarn() << "ReplayPlayer: unknown capture chunk source" << chunkHeader.source;
+			break;
+		}
+
+		chunkCount++;
+	}
+
+	fclose(_captureFile);
+	_captureFile = nullptr;
+
+	_deliver(_mavlinkQueue, Chunk_t());
+	_deliver(_pulseQueue, Chunk_t());
+	_finished = true;
+
+	logInfo() << "ReplayPlayer: capture delivered - chunks:" << chunkCount;
+}
+
+ssize_t ReplayPlayer::receiveMavlinkBytes(uint8_t* buffer, size_t cBuffer)
+{
+	if (_mavlinkDone) {
+		// Nothing more will arrive, behave like an idle link
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		return -1;
+	}
+
+	std::optional<Chunk_t> chunk;
+	while (!(chunk = _mavlinkQueue.pop_front(true /* blocking */))) {
+	}
+
+	if (chunk->empty()) {
+		_mavlinkDone = true;
+		return -1;
+	}
+
+	// Captured reads were at most the connection's receive buffer size, so a chunk always fits
+	size_t cBytes = std::min(chunk->size(), cBuffer);
+	memcpy(buffer, chunk->data(), cBytes);
+
+	return cBytes;
+}
+
+int ReplayPlayer::receivePulses(UDPPulseReceiver::UDPPulseInfo_T* buffer, int maxPulses, uint64_t& receivedRealtimeNSecs)
+{
+	if (_pulsesDone) {
+		return -1;
+	}
+
+	std::optional<Chunk_t> chunk;
+	while (!(chunk = _pulseQueue.pop_front(true /* blocking */))) {
+	}
+
+	if (chunk->empty()) {
+		_pulsesDone = true;
+		return -1;
+	}
+
+	int pulseCount = std::min<int>(chunk->size() / sizeof(UDPPulseReceiver::UDPPulseInfo_T), maxPulses);
+	memcpy(buffer, chunk->data(), pulseCount * sizeof(UDPPulseReceiver::UDPPulseInfo_T));
+
+	receivedRealtimeNSecs = nsecsSinceEpoch();
+
+	return pulseCount;
+}
+
+void ReplayPlayer::writeOutgoing(const mavlink_message_t& message)
+{
+	if (message.msgid != MAVLINK_MSG_ID_TUNNEL) {
+		return;
+	}
+
+	mavlink_tunnel_t tunnel;
+	mavlink_msg_tunnel_decode(&message, &tunnel);
+
+	uint32_t command = 0;
+	if (tunnel.payload_length >= sizeof(command)) {
+		memcpy(&command, tunnel.payload, sizeof(command));
+	}
+
+	// Only what follows from the capture is written, so the output of two runs over the same capture can be diffed
+	// directly. Heartbeats, detector health and process stats come from timers and are left out, so are the session
+	// log directory sent with the START_DETECTION ack and the pulse position and attitude, which are sampled from
+	// telemetry every 500 ms.
+	std::string line;
+
+	switch (command) {
+	case COMMAND_ID_ACK:
+	{
+		TunnelProtocol::AckInfo_t ackInfo;
+
+		if (tunnel.payload_length < sizeof(ackInfo)) {
+			return;
+		}
+		memcpy(&ackInfo, tunnel.payload, sizeof(ackInfo));
+		line = formatString("ack command: %u result: %u", ackInfo.command, ackInfo.result);
+	}
+		break;
+	case COMMAND_ID_PULSE:
+	{
+		TunnelProtocol::PulseInfo_t pulseInfo;
+
+		if (tunnel.payload_length < sizeof(pulseInfo)) {
+			return;
+		}
+		memcpy(&pulseInfo, tunnel.payload, sizeof(pulseInfo));
+		line = formatString("pulse tag: %u frequency: %u start: %.6f next: %.6f snr: %g stft: %g group: %u/%u snr: %g detection: %u confirmed: %u noise psd: %g",
+					pulseInfo.tag_id, pulseInfo.frequency_hz, pulseInfo.start_time_seconds, pulseInfo.predict_next_start_seconds,
+					pulseInfo.snr, pulseInfo.stft_score, pulseInfo.group_seq_counter, pulseInfo.group_ind, pulseInfo.group_snr,
+					pulseInfo.detection_status, pulseInfo.confirmed_status, pulseInfo.noise_psd);
+	}
+		break;
+	default:
+		return;
+	}
+
+	// Acks and pulses are sent from different threads, so only the order within each kind is repeatable. Lines are
+	// grouped by kind and written on close.
+	std::lock_guard<std::mutex> lock(_outputMutex);
+
+	if (_outputFile) {
+		_outputLines[command].push_back(line);
+	}
+}
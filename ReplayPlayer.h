@@ -0,0 +1,68 @@
+#pragma once
+
+#include "ReplayCapture.h"
+#include "ThreadSafeQueue.h"
+#include "UDPPulseReceiver.h"
+
+#include <mavlink.h>
+
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class SimulatedClock;
+
+// Feeds a capture file (see ReplayCapture.h) back through the controller:
+//	- MAVLink bytes are returned from ReplayConnection (connection url "replay:")
+//	- Detector pulses are returned from ReplayPulseTransport (pulse transport url "replay:")
+//	- Outgoing command acks and pulses are written as text lines to the output file so runs can be diffed
+// The clock is moved to the capture's start time, so chunks are delivered at the wall clock time they were captured
+// at. In fast mode the clock jumps ahead to each chunk instead of waiting for it.
+class ReplayPlayer
+{
+public:
+	static ReplayPlayer* instance();
+
+	bool open		(const std::string& capturePath, const std::string& outputPath, bool fast, SimulatedClock* clock);
+	void start		(void);
+	void close		(void);
+	bool active		(void) const { return _active; }
+	bool fast		(void) const { return _fast; }
+	bool finished	(void) const { return _finished; }
+
+	// Block until replayed input is available. Return -1 once the capture has been fully delivered.
+	ssize_t	receiveMavlinkBytes	(uint8_t* buffer, size_t cBuffer);
+	int		receivePulses		(UDPPulseReceiver::UDPPulseInfo_T* buffer, int maxPulses, uint64_t& receivedRealtimeNSecs);
+
+	void	writeOutgoing		(const mavlink_message_t& message);
+
+private:
+	ReplayPlayer();
+
+	typedef std::vector<uint8_t> Chunk_t;	// Empty chunk marks the end of the capture
+
+	void _dispatchThread	(void);
+	void _deliver			(ThreadSafeQueue<Chunk_t>& queue, const Chunk_t& chunk);
+	bool _nextChunk			(ReplayCaptureChunk_t& chunkHeader, Chunk_t& chunk);
+
+	std::atomic_bool			_active		{ false };
+	std::atomic_bool			_fast		{ false };
+	std::atomic_bool			_finished	{ false };
+	FILE*						_captureFile	= nullptr;
+	FILE*						_outputFile		= nullptr;
+	std::mutex					_outputMutex;
+	std::map<uint32_t, std::vector<std::string>> _outputLines;	// By tunnel command, written on close
+	SimulatedClock*				_clock			= nullptr;
+	uint64_t					_startNSecs		= 0;		// Clock monotonic time of the capture start
+	ReplayCaptureHeader_t		_header;
+	ThreadSafeQueue<Chunk_t>	_mavlinkQueue;
+	ThreadSafeQueue<Chunk_t>	_pulseQueue;
+	bool						_mavlinkDone	= false;	// Only touched by the connection receive thread
+	bool						_pulsesDone		= false;	// Only touched by the pulse ingest thread
+
+	static ReplayPlayer*		_instance;
+	static constexpr size_t		_queueSize		= 256;
+};
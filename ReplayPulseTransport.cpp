@@ -0,0 +1,29 @@
+#include "ReplayPulseTransport.h"
+#include "ReplayPlayer.h"
+#include "log.h"
+
+ReplayPulseTransport::ReplayPulseTransport(const std::string& url)
+	: PulseTransport(url)
+{
+
+}
+
+bool ReplayPulseTransport::open()
+{
+	if (!ReplayPlayer::instance()->active()) {
+		logError() << "ReplayPulseTransport::open - no capture to replay, use --replay:<capture file>";
+		return false;
+	}
+
+	return true;
+}
+
+void ReplayPulseTransport::close()
+{
+
+}
+
+int ReplayPulseTransport::receivePulses(UDPPulseReceiver::UDPPulseInfo_T* buffer, int maxPulses, uint64_t& receivedRealtimeNSecs)
+{
+	return ReplayPlayer::instance()->receivePulses(buffer, maxPulses, receivedRealtimeNSecs);
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "PulseTransport.h"
+
+// Pulse transport which returns the detector pulses from the capture being replayed by ReplayPlayer
+class ReplayPulseTransport : public PulseTransport
+{
+public:
+	ReplayPulseTransport(const std::string& url);
+
+	// PulseTransport overrides
+	bool	open			() override;
+	void	close			() override;
+	int		receivePulses	(UDPPulseReceiver::UDPPulseInfo_T* buffer, int maxPulses, uint64_t& receivedRealtimeNSecs) override;
+};
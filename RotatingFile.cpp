@@ -0,0 +1,76 @@
+#include "RotatingFile.h"
+#include "log.h"
+
+#include <cerrno>
+#include <cstring>
+
+bool RotatingFile::open(const std::string& path, uint64_t maxBytes, uint32_t maxRotations)
+{
+	close();
+
+	_path			= path;
+	_maxBytes		= maxBytes;
+	_maxRotations	= maxRotations;
+	_rotations		= 0;
+	_file			= fopen(_path.c_str(), "a");
+
+	if (!_file) {
+		logError() << "RotatingFile::open unable to open" << _path << strerror(errno);
+		return false;
+	}
+
+	fseek(_file, 0, SEEK_END);
+	_size = ftell(_file);
+
+	return true;
+}
+
+void RotatingFile::close(void)
+{
+	if (_file) {
+		fclose(_file);
+		_file = nullptr;
+	}
+}
+
+void RotatingFile::rotate(void)
+{
+	if (!_file) {
+		return;
+	}
+	fclose(_file);
+	_file = nullptr;
+
+	if (_maxRotations == 0) {
+		remove(_path.c_str());
+	} else {
+		remove((_path + "." + std::to_string(_maxRotations)).c_str());
+		for (uint32_t i=_maxRotations - 1; i>=1; i--) {
+			rename((_path + "." + std::to_string(i)).c_str(), (_path + "." + std::to_string(i + 1)).c_str());
+		}
+		rename(_path.c_str(), (_path + ".1").c_str());
+	}
+
+	_file = fopen(_path.c_str(), "w");
+	_size = 0;
+	_rotations++;
+
+	if (!_file) {
+		logError() << "RotatingFile::rotate unable to open" << _path << strerror(errno);
+	}
+}
+
+void RotatingFile::write(const void* data, size_t cBytes)
+{
+	if (_file && cBytes) {
+		fwrite(data, 1, cBytes, _file);
+		_size += cBytes;
+	}
+}
+
+void RotatingFile::flush(void)
+{
+	if (_file) {
+		fflush(_file);
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Log file with a size cap. Once the file reaches maxBytes it is renamed to <path>.1 (shifting older ones up to
+// <path>.<maxRotations>, the oldest is deleted) and a new file is started, so a long flight keeps the most recent
+// output within (maxRotations + 1) * maxBytes. Not thread safe.
+class RotatingFile
+{
+public:
+	RotatingFile() = default;
+	~RotatingFile() { close(); }
+
+	RotatingFile(const RotatingFile&) = delete;
+	RotatingFile& operator=(const RotatingFile&) = delete;
+
+	// Appends to an existing file
+	bool		open			(const std::string& path, uint64_t maxBytes, uint32_t maxRotations);
+	void		close			(void);
+	bool		isOpen			(void) const { return _file != nullptr; }
+
+	// Caller decides where to rotate so that a file never starts mid record
+	bool		wouldExceed		(size_t cBytes) const { return _maxBytes && _size && _size + cBytes > _maxBytes; }
+	void		rotate			(void);
+
+	void		write			(const void* data, size_t cBytes);
+	void		flush			(void);
+	uint64_t	size			(void) const { return _size; }
+	uint32_t	rotations		(void) const { return _rotations; }	// Files started because of the size cap
+
+private:
+	FILE*		_file			= nullptr;
+	std::string	_path;
+	uint64_t	_maxBytes		= 0;
+	uint32_t	_maxRotations	= 0;
+	uint64_t	_size			= 0;
+	uint32_t	_rotations		= 0;
+};
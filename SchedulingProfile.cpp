@@ -0,0 +1,231 @@
+#include "SchedulingProfile.h"
+#include "log.h"
+
+#include <cerrno>
+#include <sstream>
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Not in glibc, from linux/ioprio.h
+static constexpr int _ioprioWhoProcess	= 1;
+static constexpr int _ioprioClassShift	= 13;
+static constexpr int _maxCpus			= 32;
+
+static bool _parseCpus(const std::string& cpus, uint32_t& cpuMask)
+{
+	std::stringstream	cpusStream(cpus);
+	std::string			range;
+
+	cpuMask = 0;
+	while (std::getline(cpusStream, range, '+')) {
+		auto	dashIndex	= range.find('-');
+		int		firstCpu	= std::stoi(range.substr(0, dashIndex));
+		int		lastCpu		= dashIndex == std::string::npos ? firstCpu : std::stoi(range.substr(dashIndex + 1));
+
+		if (firstCpu < 0 || lastCpu >= _maxCpus || firstCpu > lastCpu) {
+			return false;
+		}
+		for (int cpu=firstCpu; cpu<=lastCpu; cpu++) {
+			cpuMask |= 1u << cpu;
+		}
+	}
+
+	return cpuMask != 0;
+}
+
+bool parseSchedulingProfile(const std::string& spec, SchedulingProfile_t& profile)
+{
+	std::stringstream	specStream(spec);
+	std::string			setting;
+
+	profile = SchedulingProfile_t();
+	if (spec == "none") {
+		return true;
+	}
+
+	while (std::getline(specStream, setting, ',')) {
+		if (setting.empty()) {
+			continue;
+		}
+
+		auto equalsIndex = setting.find('=');
+		if (equalsIndex == std::string::npos) {
+			logError() << "SchedulingProfile: setting missing '=':" << setting;
+			return false;
+		}
+
+		std::string key		= setting.substr(0, equalsIndex);
+		std::string value	= setting.substr(equalsIndex + 1);
+
+		try {
+			if (key == "cpus") {
+				if (!_parseCpus(value, profile.cpuMask)) {
+					logError() << "SchedulingProfile: invalid cpus:" << value;
+					return false;
+				}
+			} else if ((key == "fifo" && profile.policy == SCHED_OTHER) || (key == "nice" && profile.policy == SCHED_FIFO)) {
+				logError() << "SchedulingProfile: fifo and nice can't be combined:" << spec;
+				return false;
+			} else if (key == "fifo") {
+				profile.policy		= SCHED_FIFO;
+				profile.priority	= std::stoi(value);
+				if (profile.priority < 1 || profile.priority > 99) {
+					logError() << "SchedulingProfile: fifo priority must be 1-99:" << value;
+					return false;
+				}
+			} else if (key == "nice") {
+				profile.policy	= SCHED_OTHER;
+				profile.nice	= std::stoi(value);
+				if (profile.nice < -20 || profile.nice > 19) {
+					logError() << "SchedulingProfile: nice must be -20-19:" << value;
+					return false;
+				}
+			} else if (key == "io") {
+				if (value == "idle") {
+					profile.ioClass = SchedulingProfile_t::IoClassIdle;
+				} else if (value.starts_with("rt:")) {
+					profile.ioClass = SchedulingProfile_t::IoClassRealtime;
+					profile.ioLevel = std::stoi(value.substr(3));
+				} else if (value.starts_with("be:")) {
+					profile.ioClass = SchedulingProfile_t::IoClassBestEffort;
+					profile.ioLevel = std::stoi(value.substr(3));
+				} else {
+					logError() << "SchedulingProfile: unknown io class:" << value;
+					return false;
+				}
+				if (profile.ioLevel < 0 || profile.ioLevel > 7) {
+					logError() << "SchedulingProfile: io level must be 0-7:" << value;
+					return false;
+				}
+			} else {
+				logError() << "SchedulingProfile: unknown setting:" << key;
+				return false;
+			}
+		} catch (const std::exception&) {
+			logError() << "SchedulingProfile: invalid value:" << setting;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static int _ioprio(const SchedulingProfile_t& profile)
+{
+	return (profile.ioClass << _ioprioClassShift) | (profile.ioClass == SchedulingProfile_t::IoClassIdle ? 0 : profile.ioLevel);
+}
+
+// pid 0 is the calling thread for all of these
+int applySchedulingProfile(const SchedulingProfile_t& profile)
+{
+	int error = 0;
+
+	if (profile.cpuMask) {
+		cpu_set_t cpuSet;
+
+		CPU_ZERO(&cpuSet);
+		for (int cpu=0; cpu<_maxCpus; cpu++) {
+			if (profile.cpuMask & (1u << cpu)) {
+				CPU_SET(cpu, &cpuSet);
+			}
+		}
+		if (sched_setaffinity(0, sizeof(cpuSet), &cpuSet) != 0 && !error) {
+			error = errno;
+		}
+	}
+
+	if (profile.policy >= 0) {
+		struct sched_param param {};
+
+		param.sched_priority = profile.policy == SCHED_FIFO ? profile.priority : 0;
+		if (sched_setscheduler(0, profile.policy, &param) != 0 && !error) {
+			error = errno;
+		}
+		if (profile.policy == SCHED_OTHER && setpriority(PRIO_PROCESS, 0, profile.nice) != 0 && !error) {
+			error = errno;
+		}
+	}
+
+	if (profile.ioClass != SchedulingProfile_t::IoClassNone) {
+		if (syscall(SYS_ioprio_set, _ioprioWhoProcess, 0, _ioprio(profile)) != 0 && !error) {
+			error = errno;
+		}
+	}
+
+	return error;
+}
+
+bool schedulingProfileApplied(pid_t pid, const SchedulingProfile_t& profile)
+{
+	if (profile.cpuMask) {
+		cpu_set_t cpuSet;
+
+		if (sched_getaffinity(pid, sizeof(cpuSet), &cpuSet) != 0) {
+			return false;
+		}
+		for (int cpu=0; cpu<_maxCpus; cpu++) {
+			if (CPU_ISSET(cpu, &cpuSet) && !(profile.cpuMask & (1u << cpu))) {
+				return false;
+			}
+		}
+	}
+
+	if (profile.policy >= 0 && sched_getscheduler(pid) != profile.policy) {
+		return false;
+	}
+
+	if (profile.policy == SCHED_OTHER) {
+		errno = 0;
+		if (getpriority(PRIO_PROCESS, pid) != profile.nice || errno != 0) {
+			return false;
+		}
+	}
+
+	if (profile.ioClass != SchedulingProfile_t::IoClassNone && syscall(SYS_ioprio_get, _ioprioWhoProcess, pid) != _ioprio(profile)) {
+		return false;
+	}
+
+	return true;
+}
+
+std::string schedulingProfileString(const SchedulingProfile_t& profile)
+{
+	std::string profileStr;
+
+	if (profile.cpuMask) {
+		profileStr += "cpus=";
+		for (int cpu=0; cpu<_maxCpus; cpu++) {
+			if (profile.cpuMask & (1u << cpu)) {
+				profileStr += std::to_string(cpu) + "+";
+			}
+		}
+		profileStr.back() = ',';
+	}
+	if (profile.policy == SCHED_FIFO) {
+		profileStr += "fifo=" + std::to_string(profile.priority) + ",";
+	} else if (profile.policy == SCHED_OTHER) {
+		profileStr += "nice=" + std::to_string(profile.nice) + ",";
+	}
+	switch (profile.ioClass) {
+	case SchedulingProfile_t::IoClassNone:
+		break;
+	case SchedulingProfile_t::IoClassRealtime:
+		profileStr += "io=rt:" + std::to_string(profile.ioLevel) + ",";
+		break;
+	case SchedulingProfile_t::IoClassBestEffort:
+		profileStr += "io=be:" + std::to_string(profile.ioLevel) + ",";
+		break;
+	case SchedulingProfile_t::IoClassIdle:
+		profileStr += "io=idle,";
+		break;
+	}
+
+	if (profileStr.empty()) {
+		return "none";
+	}
+	profileStr.pop_back();
+
+	return profileStr;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <sched.h>
+#include <sys/types.h>
+
+// How a process or thread shares the cpus with everything else on the vehicle computer: which cpus it may run on, its
+// scheduling policy and priority, and its io priority. Each setting left at its default is not touched. Processes and
+// threads started by the one it is applied to inherit it.
+//
+// SCHED_FIFO, negative nice values and the realtime io class need CAP_SYS_NICE (or RLIMIT_RTPRIO for SCHED_FIFO).
+// Without it those settings are skipped and the rest still applies.
+typedef struct {
+	enum IoClass {
+		IoClassNone,				// Values match the kernel's IOPRIO_CLASS_*
+		IoClassRealtime,
+		IoClassBestEffort,
+		IoClassIdle,
+	};
+
+	uint32_t	cpuMask		= 0;	// Bit per cpu, 0 for any cpu
+	int			policy		= -1;	// SCHED_OTHER or SCHED_FIFO, -1 to leave it alone
+	int			priority	= 0;	// SCHED_FIFO priority 1-99
+	int			nice		= 0;	// SCHED_OTHER only
+	IoClass		ioClass		= IoClassNone;
+	int			ioLevel		= 4;	// 0 highest - 7 lowest, not used by IoClassIdle
+} SchedulingProfile_t;
+
+// Parses comma separated key=value settings, anything not given is left alone:
+//	cpus=<cpu>[-<cpu>][+<cpu>...],fifo=<priority 1-99>,nice=<-20-19>,io=rt:<level>|be:<level>|idle
+// or "none" to leave everything alone.
+bool parseSchedulingProfile(const std::string& spec, SchedulingProfile_t& profile);
+
+// Applies the profile to the calling thread. Only makes system calls, so it can also be used in a child between fork
+// and exec. Returns 0, or the errno of the first setting which failed after trying all of them.
+int applySchedulingProfile(const SchedulingProfile_t& profile);
+
+// Reads back the settings of process pid to see whether the profile took
+bool schedulingProfileApplied(pid_t pid, const SchedulingProfile_t& profile);
+
+std::string schedulingProfileString(const SchedulingProfile_t& profile);
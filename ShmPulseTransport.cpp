@@ -0,0 +1,164 @@
+#include "ShmPulseTransport.h"
+#include "log.h"
+#include "timeHelpers.h"
+
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static_assert(sizeof(PulseShmRecord_t) == sizeof(UDPPulseReceiver::UDPPulseInfo_T), "Shared memory pulse records must match the UDP record layout");
+
+ShmPulseTransport::ShmPulseTransport(const std::string& url)
+	: PulseTransport(url)
+	, _shmName		(std::string("/").append(url, std::string("shm://").length()))
+{
+
+}
+
+ShmPulseTransport::~ShmPulseTransport()
+{
+	close();
+
+	// The receive thread may still be using these after close, so they are only released here
+	if (_segment) {
+		munmap(_segment, sizeof(PulseShmSegment_t));
+	}
+	if (_eventFd >= 0) {
+		::close(_eventFd);
+	}
+}
+
+bool ShmPulseTransport::open()
+{
+	int fd = shm_open(_shmName.c_str(), O_CREAT | O_RDWR, 0666);
+	if (fd < 0) {
+		logError() << "ShmPulseTransport::open shm_open failed" << strerror(errno);
+		return false;
+	}
+
+	if (ftruncate(fd, sizeof(PulseShmSegment_t)) != 0) {
+		logError() << "ShmPulseTransport::open ftruncate failed" << strerror(errno);
+		::close(fd);
+		return false;
+	}
+
+	void* mapping = mmap(nullptr, sizeof(PulseShmSegment_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (mapping == MAP_FAILED) {
+		logError() << "ShmPulseTransport::open mmap failed" << strerror(errno);
+		return false;
+	}
+
+	_segment = static_cast<PulseShmSegment_t*>(mapping);
+
+	__atomic_store_n(&_segment->magic, 0, __ATOMIC_RELEASE);
+	_segment->version		= PULSE_SHM_VERSION;
+	_segment->capacity		= PULSE_SHM_CAPACITY;
+	_segment->recordSize	= sizeof(PulseShmRecord_t);
+	_segment->enqueuePos	= 0;
+	_segment->dequeuePos	= 0;
+	for (uint32_t i=0; i<PULSE_SHM_CAPACITY; i++) {
+		_segment->slots[i].sequence = i;
+	}
+	__atomic_store_n(&_segment->magic, PULSE_SHM_MAGIC, __ATOMIC_RELEASE);
+
+	// Not close-on-exec: detector processes we start inherit the descriptor and find it through the environment
+	_eventFd = eventfd(0, 0);
+	if (_eventFd < 0) {
+		logError() << "ShmPulseTransport::open eventfd failed" << strerror(errno);
+		return false;
+	}
+	setenv(PULSE_SHM_EVENTFD_ENV, std::to_string(_eventFd).c_str(), 1 /* overwrite */);
+
+	logDebug() << "ShmPulseTransport::open" << _shmName << "eventfd:" << _eventFd;
+
+	return true;
+}
+
+void ShmPulseTransport::close()
+{
+	if (_closed.exchange(true)) {
+		return;
+	}
+
+	if (_eventFd >= 0) {
+		// Wake up a blocked receivePulses so it sees we are closed
+		uint64_t one = 1;
+		if (write(_eventFd, &one, sizeof(one)) < 0) {
+			logDebug() << "ShmPulseTransport::close eventfd write failed" << strerror(errno);
+		}
+	}
+	if (_segment) {
+		shm_unlink(_shmName.c_str());
+	}
+}
+
+int ShmPulseTransport::receivePulses(UDPPulseReceiver::UDPPulseInfo_T* buffer, int maxPulses, uint64_t& receivedRealtimeNSecs)
+{
+	auto records = reinterpret_cast<PulseShmRecord_t*>(buffer);
+
+	while (!_closed) {
+		int pulseCount = 0;
+
+		while (pulseCount < maxPulses && pulseShmPop(_segment, &records[pulseCount])) {
+			pulseCount++;
+		}
+		if (pulseCount) {
+			receivedRealtimeNSecs = nsecsSinceEpoch();
+			return pulseCount;
+		}
+
+		if (!_waitForPulses()) {
+			return -1;
+		}
+	}
+
+	return -1;
+}
+
+bool ShmPulseTransport::_waitForPulses(void)
+{
+	int timeoutMSecs = -1;
+
+	if (pulseShmHeadClaimed(_segment)) {
+		uint64_t nowNSecs = nsecsMonotonic();
+
+		if (_claimedSinceNSecs == 0 || _claimedPos != _segment->dequeuePos) {
+			_claimedPos			= _segment->dequeuePos;
+			_claimedSinceNSecs	= nowNSecs;
+		} else if (nowNSecs - _claimedSinceNSecs >= _claimedSlotTimeoutMSecs * 1000000ull) {
+			_claimedSinceNSecs = 0;
+			if (pulseShmSkipClaimed(_segment)) {
+				logWarn() << "ShmPulseTransport: skipped a pulse slot which was claimed but not published for" << _claimedSlotTimeoutMSecs << "msecs - detector exited mid push?";
+			}
+			return true;
+		}
+		timeoutMSecs = _claimedSlotTimeoutMSecs;
+	} else {
+		_claimedSinceNSecs = 0;
+	}
+
+	// Producers publishing behind the claimed slot keep bumping the eventfd, so poll with a timeout to get back here
+	struct pollfd pollFd = { _eventFd, POLLIN, 0 };
+
+	int ready = poll(&pollFd, 1, timeoutMSecs);
+	if (ready < 0 && errno != EINTR) {
+		logError() << "ShmPulseTransport eventfd poll failed" << strerror(errno);
+		return false;
+	}
+	if (ready > 0) {
+		uint64_t eventCount;
+		if (read(_eventFd, &eventCount, sizeof(eventCount)) < 0 && errno != EINTR) {
+			logError() << "ShmPulseTransport eventfd read failed" << strerror(errno);
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "PulseTransport.h"
+#include "PulseShm.h"
+
+#include <atomic>
+
+class ShmPulseTransport : public PulseTransport
+{
+public:
+	ShmPulseTransport(const std::string& url);
+	~ShmPulseTransport();
+
+	// PulseTransport overrides
+	bool	open			() override;
+	void	close			() override;
+	int		receivePulses	(UDPPulseReceiver::UDPPulseInfo_T* buffer, int maxPulses, uint64_t& receivedRealtimeNSecs) override;
+
+private:
+	// Wait for the next pulse, giving up on a slot a dead detector claimed but never published (see PulseShm.h)
+	bool _waitForPulses(void);
+
+	std::string			_shmName;
+	PulseShmSegment_t*	_segment			{ nullptr };
+	int					_eventFd			{ -1 };
+	std::atomic_bool	_closed				{ false };
+	uint64_t			_claimedPos			{ 0 };
+	uint64_t			_claimedSinceNSecs	{ 0 };		// 0 if the next slot isn't waiting to be published
+
+	static constexpr int _claimedSlotTimeoutMSecs = 1000;	// A live producer publishes within microseconds
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Lock-free bounded ring for exactly one producer thread and one consumer thread.
+// The consumer can block in waitForItem without the producer ever taking a lock.
+template<class T, size_t Capacity>
+class SpscRing
+{
+	static_assert(Capacity && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+	SpscRing() = default;
+
+	// Non-copyable
+	SpscRing(const SpscRing&) = delete;
+	const SpscRing& operator=(const SpscRing&) = delete;
+
+	// Producer only. Returns false if the ring is full.
+	bool push(const T& item)
+	{
+		uint32_t head = _head.load(std::memory_order_relaxed);
+
+		if (head - _tail.load(std::memory_order_acquire) == Capacity) {
+			return false;
+		}
+
+		_items[head & (Capacity - 1)] = item;
+		_head.store(head + 1, std::memory_order_release);
+		_head.notify_one();
+
+		return true;
+	}
+
+	// Consumer only. Returns false if the ring is empty.
+	bool pop(T& item)
+	{
+		uint32_t tail = _tail.load(std::memory_order_relaxed);
+
+		if (tail == _head.load(std::memory_order_acquire)) {
+			return false;
+		}
+
+		item = _items[tail & (Capacity - 1)];
+		_tail.store(tail + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	// Consumer only. Blocks until at least one item is available.
+	void waitForItem()
+	{
+		uint32_t tail = _tail.load(std::memory_order_relaxed);
+
+		_head.wait(tail, std::memory_order_acquire);
+	}
+
+	size_t size() const
+	{
+		return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+	}
+
+	static constexpr size_t capacity() { return Capacity; }
+
+private:
+	alignas(64) std::atomic<uint32_t>	_head { 0 };	// Written by producer
+	alignas(64) std::atomic<uint32_t>	_tail { 0 };	// Written by consumer
+	std::array<T, Capacity>				_items {};
+};
@@ -17,7 +17,13 @@ std::string TagDatabase::detectorConfigFileName(const TunnelProtocol::TagInfo_t&
     return logFileManager->filename(root.c_str(), "config");
 }
 
-bool TagDatabase::_writeDetectorConfig(const TunnelProtocol::TagInfo_t& tagInfo, bool secondaryChannel, uint32_t sdrType) const
+// Each detector gets its own control port, laid out the same way as the data ports, so it can be commanded on its own
+uint16_t TagDatabase::detectorControlPort(const TunnelProtocol::TagInfo_t& tagInfo, bool secondaryChannel) const
+{
+    return 30000 + ((tagInfo.channelizer_channel_number - 1) * 2) + (secondaryChannel ? 1 : 0);
+}
+
+bool TagDatabase::_writeDetectorConfig(const TunnelProtocol::TagInfo_t& tagInfo, bool secondaryChannel, uint32_t sdrType, bool startInRunState) const
 {
     auto logFileManager = LogFileManager::instance();
 
@@ -60,10 +66,10 @@ bool TagDatabase::_writeDetectorConfig(const TunnelProtocol::TagInfo_t& tagInfo,
     fprintf(fp, "logPath:\t%s\n",                               logFileManager->logDir().c_str());
     fprintf(fp, "startIndex:\t%d\n",                            1);
     fprintf(fp, "ipCntrl:\t127.0.0.1\n");
-    fprintf(fp, "portCntrl:\t30000\n");
+    fprintf(fp, "portCntrl:\t%u\n",                             detectorControlPort(tagInfo, secondaryChannel));
     fprintf(fp, "processedOuputPath:\t%s\n",                    logFileManager->logDir().c_str());
     fprintf(fp, "ros2enable:\tfalse\n");
-    fprintf(fp, "startInRunState:\ttrue\n");
+    fprintf(fp, "startInRunState:\t%s\n",                       startInRunState ? "true" : "false");
     fprintf(fp, "timeStamp:\t1646403180.469\n");
 
     fclose(fp);
@@ -90,12 +96,12 @@ bool TagDatabase::_writeDetectorConfig(const TunnelProtocol::TagInfo_t& tagInfo,
     return true;
 }
 
-bool TagDatabase::writeDetectorConfigs(uint32_t sdrType) const
+bool TagDatabase::writeDetectorConfigs(uint32_t sdrType, bool startInRunState) const
 {
     for (const auto& tagInfo : *this) {
-        _writeDetectorConfig(tagInfo, false, sdrType);
+        _writeDetectorConfig(tagInfo, false, sdrType, startInRunState);
         if (tagInfo.intra_pulse2_msecs != 0) {
-            _writeDetectorConfig(tagInfo, true, sdrType);
+            _writeDetectorConfig(tagInfo, true, sdrType, startInRunState);
         }
     }
 
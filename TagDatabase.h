@@ -12,9 +12,10 @@ public:
     TagDatabase() = default;
 
     std::string detectorConfigFileName  (const TunnelProtocol::TagInfo_t& tagInfo, bool secondaryChannel) const;
-    bool        writeDetectorConfigs    (uint32_t sdrType) const;
+    uint16_t    detectorControlPort     (const TunnelProtocol::TagInfo_t& tagInfo, bool secondaryChannel) const;
+    bool        writeDetectorConfigs    (uint32_t sdrType, bool startInRunState = true) const;
     std::string channelizerCommandLine  () const;
 
 private:
-    bool        _writeDetectorConfig    (const TunnelProtocol::TagInfo_t& tagInfo, bool secondaryChannel, uint32_t sdrType) const;
+    bool        _writeDetectorConfig    (const TunnelProtocol::TagInfo_t& tagInfo, bool secondaryChannel, uint32_t sdrType, bool startInRunState) const;
 };
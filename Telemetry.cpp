@@ -1,16 +1,30 @@
 #include "Telemetry.h"
 #include "MavlinkSystem.h"
 #include "log.h"
+#include "timeHelpers.h"
+#include "FlightRecorder.h"
 
 #include <functional>
 #include <chrono>
 #include <cmath>
+#include <thread>
 
 Telemetry::Telemetry(MavlinkSystem* mavlink)
     : _mavlink(mavlink)
 {
+    _streamRates = {
+        { MAVLINK_MSG_ID_GLOBAL_POSITION_INT,   "GLOBAL_POSITION_INT",  POSITION_RATE_IDLE_HZ, POSITION_RATE_DETECTING_HZ, &_positionMessageCount, 0, 0, 0, false, 0, 0, 0 },
+        { MAVLINK_MSG_ID_ATTITUDE,              "ATTITUDE",             ATTITUDE_RATE_IDLE_HZ, ATTITUDE_RATE_DETECTING_HZ, &_attitudeMessageCount, 0, 0, 0, false, 0, 0, 0 },
+    };
+
 	_mavlink->subscribeToMessage(MAVLINK_MSG_ID_GLOBAL_POSITION_INT,    std::bind(&Telemetry::_positionCallback, this, std::placeholders::_1));
 	_mavlink->subscribeToMessage(MAVLINK_MSG_ID_ATTITUDE,               std::bind(&Telemetry::_attitudeCallback, this, std::placeholders::_1));
+	_mavlink->subscribeToMessage(MAVLINK_MSG_ID_COMMAND_ACK,            std::bind(&Telemetry::_commandAckCallback, this, std::placeholders::_1));
+}
+
+void Telemetry::start()
+{
+    std::thread(&Telemetry::_streamRateThread, this).detach();
 }
 
 void Telemetry::_positionCallback(const mavlink_message_t& message)
@@ -18,6 +32,8 @@ void Telemetry::_positionCallback(const mavlink_message_t& message)
     mavlink_global_position_int_t globalPositionInt;
     mavlink_msg_global_position_int_decode(&message, &globalPositionInt);
 
+    _positionMessageCount++;
+
     // ArduPilot sends bogus GLOBAL_POSITION_INT messages with lat/lat 0/0 even when it has no gps signal
     // Apparently, this is in order to transport relative altitude information.
     if (globalPositionInt.lat == 0 && globalPositionInt.lon == 0) {
@@ -32,6 +48,8 @@ void Telemetry::_positionCallback(const mavlink_message_t& message)
     lastPosition.relativeAltitude   = globalPositionInt.relative_alt * 1e-3f;
 
     _lastPosition = lastPosition;
+
+    FlightRecorder::instance()->recordPosition(lastPosition, globalPositionInt.time_boot_ms);
 }
 
 float Telemetry::_toDegFromRad(float rad)
@@ -68,6 +86,8 @@ void Telemetry::_attitudeCallback(const mavlink_message_t& message)
     mavlink_attitude_t attitude;
     mavlink_msg_attitude_decode(&message, &attitude);
 
+    _attitudeMessageCount++;
+
     std::lock_guard<std::mutex> lock(_accessMutex);
 
     EulerAngle_t lastAttitudeEuler;
@@ -76,6 +96,8 @@ void Telemetry::_attitudeCallback(const mavlink_message_t& message)
     lastAttitudeEuler.yawDegrees   = _radiansToDegrees(attitude.yaw);
 
     _lastAttitudeEuler = lastAttitudeEuler;
+
+    FlightRecorder::instance()->recordAttitude(lastAttitudeEuler, attitude.time_boot_ms);
 }
 
 std::optional<Telemetry::Position_t> Telemetry::lastPosition()
@@ -89,3 +111,171 @@ std::optional<Telemetry::EulerAngle_t> Telemetry::lastAttitudeEuler()
     std::lock_guard<std::mutex> lock(_accessMutex);
     return _lastAttitudeEuler;
 }
+
+void Telemetry::setDetecting(bool detecting)
+{
+    if (_detecting != detecting) {
+        logInfo() << "Telemetry::setDetecting" << detecting;
+        _detecting = detecting;
+    }
+}
+
+void Telemetry::_commandAckCallback(const mavlink_message_t& message)
+{
+    mavlink_command_ack_t commandAck;
+    mavlink_msg_command_ack_decode(&message, &commandAck);
+
+    if (commandAck.command != MAV_CMD_SET_MESSAGE_INTERVAL || message.sysid != _mavlink->ourSystemId()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_streamRateMutex);
+
+    if (_pendingAckStreamIndex < 0) {
+        logWarn() << "Telemetry::_commandAckCallback unexpected SET_MESSAGE_INTERVAL ack result:" << commandAck.result;
+        return;
+    }
+
+    StreamRate_t& streamRate = _streamRates[_pendingAckStreamIndex];
+    _pendingAckStreamIndex = -1;
+
+    switch (commandAck.result) {
+    case MAV_RESULT_ACCEPTED:
+        logInfo() << "SET_MESSAGE_INTERVAL accepted" << streamRate.name << "rate:" << streamRate.requestedRateHz;
+        break;
+    case MAV_RESULT_DENIED:
+    case MAV_RESULT_UNSUPPORTED:
+        // No point in asking again, we live with whatever the autopilot streams by default
+        logWarn() << "SET_MESSAGE_INTERVAL rejected" << streamRate.name << "result:" << commandAck.result;
+        streamRate.rejected = true;
+        break;
+    default:
+        // Temporary failures are retried by rate verification
+        logWarn() << "SET_MESSAGE_INTERVAL failed" << streamRate.name << "result:" << commandAck.result;
+        break;
+    }
+}
+
+void Telemetry::_sendSetMessageInterval(uint16_t messageId, double rateHz)
+{
+    mavlink_command_long_t  commandLong;
+    mavlink_message_t       message;
+
+    memset(&commandLong, 0, sizeof(commandLong));
+    commandLong.target_system       = _mavlink->ourSystemId().value();
+    commandLong.target_component    = MAV_COMP_ID_AUTOPILOT1;
+    commandLong.command             = MAV_CMD_SET_MESSAGE_INTERVAL;
+    commandLong.param1              = messageId;
+    commandLong.param2              = 1000000.0 / rateHz;    // Interval in microseconds
+
+    mavlink_msg_command_long_encode(_mavlink->ourSystemId().value(), _mavlink->ourComponentId(), &message, &commandLong);
+
+    _mavlink->sendMessage(message);
+}
+
+// Returns true if a SET_MESSAGE_INTERVAL was sent for this stream
+bool Telemetry::_updateStreamRate(StreamRate_t& streamRate, uint64_t nowMSecs)
+{
+    double      desiredRateHz   = _detecting ? streamRate.detectingRateHz : streamRate.idleRateHz;
+    uint32_t    receivedCount   = streamRate.receivedCount->load();
+    bool        windowComplete  = false;
+
+    // The first window starts with the first request below, before that there is nothing to measure against
+    if (streamRate.requestedRateHz != 0 && nowMSecs - streamRate.windowStartMSecs >= _rateCheckWindowMSecs) {
+        streamRate.achievedRateHz   = (receivedCount - streamRate.windowStartCount) * 1000.0 / (nowMSecs - streamRate.windowStartMSecs);
+        streamRate.windowStartCount = receivedCount;
+        streamRate.windowStartMSecs = nowMSecs;
+        windowComplete              = true;
+
+        logDebug() << "Telemetry rate" << streamRate.name << "requested:achieved" << streamRate.requestedRateHz << streamRate.achievedRateHz;
+    }
+
+    if (streamRate.rejected) {
+        return false;
+    }
+
+    if (streamRate.requestedRateHz != desiredRateHz) {
+        logInfo() << "Telemetry requesting" << streamRate.name << "rate:" << desiredRateHz;
+        streamRate.requestedRateHz  = desiredRateHz;
+        streamRate.requestAttempts  = 0;
+    } else if (windowComplete && nowMSecs - streamRate.requestedMSecs > _rateCheckWindowMSecs) {
+        // Verify the achieved rate against what we asked for
+        if (std::fabs(streamRate.achievedRateHz - desiredRateHz) <= desiredRateHz * _rateTolerance) {
+            return false;
+        }
+        if (streamRate.requestAttempts >= _maxRequestAttempts) {
+            if (streamRate.requestAttempts++ == _maxRequestAttempts) {
+                logWarn() << "Telemetry giving up on" << streamRate.name << "rate requested:achieved" << desiredRateHz << streamRate.achievedRateHz;
+            }
+            return false;
+        }
+        logWarn() << "Telemetry rate mismatch" << streamRate.name << "requested:achieved" << desiredRateHz << streamRate.achievedRateHz;
+    } else {
+        return false;
+    }
+
+    streamRate.requestAttempts++;
+    streamRate.requestedMSecs   = nowMSecs;
+    streamRate.windowStartCount = receivedCount;
+    streamRate.windowStartMSecs = nowMSecs;
+
+    _sendSetMessageInterval(streamRate.messageId, desiredRateHz);
+
+    return true;
+}
+
+// Returns true while the outstanding SET_MESSAGE_INTERVAL is still waiting for its ack. A request which isn't acked in
+// time is sent again, after the last retry rate verification takes over.
+bool Telemetry::_waitForAck(uint64_t nowMSecs)
+{
+    if (_pendingAckStreamIndex < 0) {
+        return false;
+    }
+    if (nowMSecs - _pendingAckMSecs < _ackTimeoutMSecs) {
+        return true;
+    }
+
+    StreamRate_t& streamRate = _streamRates[_pendingAckStreamIndex];
+
+    if (_pendingAckRetries >= _maxAckRetries) {
+        logWarn() << "Telemetry no SET_MESSAGE_INTERVAL ack for" << streamRate.name;
+        _pendingAckStreamIndex = -1;
+        return false;
+    }
+
+    logWarn() << "Telemetry SET_MESSAGE_INTERVAL ack timeout, retrying" << streamRate.name;
+    _pendingAckRetries++;
+    _pendingAckMSecs = nowMSecs;
+    _sendSetMessageInterval(streamRate.messageId, streamRate.requestedRateHz);
+
+    return true;
+}
+
+void Telemetry::_streamRateThread()
+{
+    while (true) {
+        if (_mavlink->connected() && _mavlink->ourSystemId().has_value()) {
+            std::lock_guard<std::mutex> lock(_streamRateMutex);
+
+            auto nowMSecs = msecsSinceEpoch();
+
+            // Only a single request is outstanding at a time so acks can be matched up to their stream. Streams take
+            // turns so one which is never acked doesn't hold up the others.
+            if (!_waitForAck(nowMSecs)) {
+                for (size_t n=0; n<_streamRates.size(); n++) {
+                    size_t i = (_nextStreamIndex + n) % _streamRates.size();
+
+                    if (_updateStreamRate(_streamRates[i], nowMSecs)) {
+                        _pendingAckStreamIndex  = i;
+                        _pendingAckMSecs        = nowMSecs;
+                        _pendingAckRetries      = 0;
+                        _nextStreamIndex        = i + 1;
+                        break;
+                    }
+                }
+            }
+        }
+
+        sleepForMSecs(1000);
+    }
+}
@@ -2,6 +2,8 @@
 
 #include <optional>
 #include <mutex>
+#include <atomic>
+#include <vector>
 
 #include <mavlink.h>
 
@@ -31,12 +33,44 @@ public:
 
 	Telemetry(MavlinkSystem* mavlink);
 
+	// Starts requesting stream rates, call once the connection is set up
+	void start();
+
 	std::optional<Position_t>		lastPosition();			// thread safe
 	std::optional<EulerAngle_t> 	lastAttitudeEuler();	// thread safe
 
+	// Switches the requested stream rates between the idle and detecting profiles
+	void setDetecting(bool detecting);
+
+	// Stream rates requested from the autopilot through MAV_CMD_SET_MESSAGE_INTERVAL
+	static constexpr double POSITION_RATE_IDLE_HZ		= 1.0;
+	static constexpr double POSITION_RATE_DETECTING_HZ	= 5.0;
+	static constexpr double ATTITUDE_RATE_IDLE_HZ		= 2.0;
+	static constexpr double ATTITUDE_RATE_DETECTING_HZ	= 20.0;
+
 private:
+	typedef struct {
+		uint16_t					messageId;
+		const char*					name;
+		double						idleRateHz;
+		double						detectingRateHz;
+		std::atomic_uint32_t*		receivedCount;
+		double						requestedRateHz;		// 0 if not yet requested
+		uint64_t					requestedMSecs;
+		uint32_t					requestAttempts;
+		bool						rejected;
+		uint32_t					windowStartCount;
+		uint64_t					windowStartMSecs;
+		double						achievedRateHz;
+	} StreamRate_t;
+
 	void 			_positionCallback			(const mavlink_message_t& message);
 	void 			_attitudeCallback			(const mavlink_message_t& message);
+	void 			_commandAckCallback			(const mavlink_message_t& message);
+	void			_streamRateThread			();
+	bool			_updateStreamRate			(StreamRate_t& streamRate, uint64_t nowMSecs);
+	bool			_waitForAck					(uint64_t nowMSecs);
+	void			_sendSetMessageInterval		(uint16_t messageId, double rateHz);
 	float 			_toDegFromRad				(float rad);
 	EulerAngle_t 	_toEulerAngleFromQuaternion	(Quaternion_t quaternion);
 	float			_radiansToDegrees			(float radians);
@@ -45,4 +79,20 @@ private:
 	std::optional<Position_t>		_lastPosition;
 	std::optional<EulerAngle_t> 	_lastAttitudeEuler;
 	std::mutex						_accessMutex;
+
+	std::atomic_bool				_detecting				{ false };
+	std::atomic_uint32_t			_positionMessageCount	{ 0 };
+	std::atomic_uint32_t			_attitudeMessageCount	{ 0 };
+	std::vector<StreamRate_t>		_streamRates;
+	int								_pendingAckStreamIndex	{ -1 };
+	uint64_t						_pendingAckMSecs		= 0;
+	uint32_t						_pendingAckRetries		= 0;
+	size_t							_nextStreamIndex		= 0;
+	std::mutex						_streamRateMutex;
+
+	static constexpr uint64_t	_rateCheckWindowMSecs	= 5000;	// Window over which achieved rates are measured
+	static constexpr double		_rateTolerance			= 0.5;	// Allowed fractional deviation from the requested rate
+	static constexpr uint32_t	_maxRequestAttempts		= 3;
+	static constexpr uint64_t	_ackTimeoutMSecs		= 3000;	// Acks queue up behind the paced outgoing messages
+	static constexpr uint32_t	_maxAckRetries			= 2;
 };
\ No newline at end of file
@@ -10,9 +10,14 @@
 #include <ctime>
 #include <time.h>
 
-TelemetryCache::TelemetryCache(MavlinkSystem* mavlink)
+TelemetryCache::TelemetryCache(MavlinkSystem* mavlink, const char* shmName)
     : _mavlink(mavlink)
 {
+    // Detector processes on the same machine can read pose directly from shared memory
+    if (shmName) {
+        _shmPublisher.open(shmName);
+    }
+
     std::thread([this]()
     {
         while (true) {
@@ -29,8 +34,20 @@ TelemetryCache::TelemetryCache(MavlinkSystem* mavlink)
                 _telemetryCache.push_back(entry);
 
                 _pruneTelemetryCache();
+
+                TelemetryShmEntry_t shmEntry {};
+
+                shmEntry.timeInSeconds      = entry.timeInSeconds;
+                shmEntry.latitude           = entry.position.latitude;
+                shmEntry.longitude          = entry.position.longitude;
+                shmEntry.relativeAltitude   = entry.position.relativeAltitude;
+                shmEntry.rollDegrees        = entry.attitudeEuler.rollDegrees;
+                shmEntry.pitchDegrees       = entry.attitudeEuler.pitchDegrees;
+                shmEntry.yawDegrees         = entry.attitudeEuler.yawDegrees;
+
+                _shmPublisher.publish(shmEntry);
             }
-            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            sleepForMSecs(500);
         }
     }).detach();
 }
@@ -67,9 +84,7 @@ TelemetryCache::TelemetryCacheEntry_t TelemetryCache::telemetryForTime(double ti
 
 void TelemetryCache::_pruneTelemetryCache()
 {
-    auto    timeSince           = std::chrono::system_clock::now().time_since_epoch();
-    auto    nowMSecs            = std::chrono::duration_cast<std::chrono::milliseconds>(timeSince).count();
-    double  nowSecs             = nowMSecs / 1000.0;
+    double  nowSecs             = secondsSinceEpoch();
     double  maxIntraPulseSecs   = 5.0;
     double  maxK                = 3.0;
     double  pruneBeforeSecs     = nowSecs - (((maxK + 1) * maxIntraPulseSecs) * 2);
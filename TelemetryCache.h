@@ -7,6 +7,7 @@
 #include <mavlink.h>
 
 #include "Telemetry.h"
+#include "TelemetryShmPublisher.h"
 
 class MavlinkSystem;
 
@@ -19,7 +20,9 @@ public:
 		Telemetry::EulerAngle_t attitudeEuler;
 	} TelemetryCacheEntry_t;
 
-	TelemetryCache(MavlinkSystem* mavlink);
+	// Also publishes the telemetry into the TelemetryShm.h segment shmName, if one is given. Only the controller should
+	// publish to TELEMETRY_SHM_NAME, the detectors read their pose from it.
+	TelemetryCache(MavlinkSystem* mavlink, const char* shmName = nullptr);
 	~TelemetryCache();
 
 	TelemetryCacheEntry_t telemetryForTime(double timeInSeconds);
@@ -30,4 +33,5 @@ private:
 	MavlinkSystem* 						_mavlink;
 	std::list<TelemetryCacheEntry_t> 	_telemetryCache;
 	std::mutex							_telemetryCacheMutex;
+	TelemetryShmPublisher				_shmPublisher;
 };
\ No newline at end of file
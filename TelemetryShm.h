@@ -0,0 +1,111 @@
+/*
+ * Shared memory telemetry segment published by MavlinkTagController2.
+ *
+ * This header is plain C so it can be included by co-located processes such as uavrt_detection.
+ * The controller is the single writer. Readers map the segment read-only and use the seqlock
+ * protocol implemented by the inline functions below:
+ *
+ *     int fd = shm_open(TELEMETRY_SHM_NAME, O_RDONLY, 0);
+ *     const TelemetryShmSegment_t* seg = mmap(NULL, sizeof(TelemetryShmSegment_t), PROT_READ, MAP_SHARED, fd, 0);
+ *     TelemetryShmEntry_t entry;
+ *     if (telemetryShmValid(seg) && telemetryShmReadForTime(seg, pulseTimeSeconds, &entry)) { ... }
+ */
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#define TELEMETRY_SHM_NAME      "/uavrt_telemetry"
+#define TELEMETRY_SHM_MAGIC     0x54564155u    /* "UAVT" */
+#define TELEMETRY_SHM_VERSION   1u
+#define TELEMETRY_SHM_CAPACITY  256u           /* Must be a power of two */
+
+typedef struct {
+    uint32_t    sequence;           /* Seqlock: odd while the writer is updating the entry */
+    uint32_t    reserved;
+    uint64_t    index;              /* Monotonic write index this entry was written as */
+    double      timeInSeconds;      /* Seconds since epoch */
+    double      latitude;
+    double      longitude;
+    double      relativeAltitude;
+    float       rollDegrees;
+    float       pitchDegrees;
+    float       yawDegrees;
+    float       reserved2;
+} TelemetryShmEntry_t;
+
+typedef struct {
+    uint32_t            magic;          /* Written last by the controller once the segment is initialized */
+    uint32_t            version;
+    uint32_t            capacity;
+    uint32_t            entrySize;
+    uint64_t            writeIndex;     /* Number of entries written, newest entry is writeIndex - 1 */
+    uint8_t             reserved[40];
+    TelemetryShmEntry_t entries[TELEMETRY_SHM_CAPACITY];
+} TelemetryShmSegment_t;
+
+static inline int telemetryShmValid(const TelemetryShmSegment_t* segment)
+{
+    return __atomic_load_n(&segment->magic, __ATOMIC_ACQUIRE) == TELEMETRY_SHM_MAGIC &&
+           segment->version     == TELEMETRY_SHM_VERSION &&
+           segment->capacity    == TELEMETRY_SHM_CAPACITY &&
+           segment->entrySize   == sizeof(TelemetryShmEntry_t);
+}
+
+/* Returns 1 and fills in entry if the entry at index was read consistently, 0 if it was overwritten or is being written */
+static inline int telemetryShmReadEntry(const TelemetryShmSegment_t* segment, uint64_t index, TelemetryShmEntry_t* entry)
+{
+    const TelemetryShmEntry_t* slot = &segment->entries[index & (TELEMETRY_SHM_CAPACITY - 1)];
+
+    uint32_t sequenceBefore = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    if (sequenceBefore & 1) {
+        return 0;
+    }
+    memcpy(entry, slot, sizeof(*entry));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint32_t sequenceAfter = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+
+    return sequenceBefore == sequenceAfter && entry->index == index;
+}
+
+static inline int telemetryShmReadLatest(const TelemetryShmSegment_t* segment, TelemetryShmEntry_t* entry)
+{
+    for (int retry = 0; retry < 4; retry++) {
+        uint64_t writeIndex = __atomic_load_n(&segment->writeIndex, __ATOMIC_ACQUIRE);
+        if (writeIndex == 0) {
+            return 0;
+        }
+        if (telemetryShmReadEntry(segment, writeIndex - 1, entry)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Finds the entry closest in time to timeInSeconds. Entries are written in time order so the search stops once it passes the requested time. */
+static inline int telemetryShmReadForTime(const TelemetryShmSegment_t* segment, double timeInSeconds, TelemetryShmEntry_t* entry)
+{
+    uint64_t            writeIndex  = __atomic_load_n(&segment->writeIndex, __ATOMIC_ACQUIRE);
+    uint64_t            oldestIndex = writeIndex > TELEMETRY_SHM_CAPACITY ? writeIndex - TELEMETRY_SHM_CAPACITY : 0;
+    int                 found       = 0;
+    double              bestDiff    = 0;
+    TelemetryShmEntry_t candidate;
+
+    for (uint64_t index = writeIndex; index > oldestIndex; index--) {
+        if (!telemetryShmReadEntry(segment, index - 1, &candidate)) {
+            continue;
+        }
+        double diff = fabs(timeInSeconds - candidate.timeInSeconds);
+        if (!found || diff < bestDiff) {
+            found       = 1;
+            bestDiff    = diff;
+            *entry      = candidate;
+        }
+        if (candidate.timeInSeconds < timeInSeconds) {
+            break;
+        }
+    }
+
+    return found;
+}
@@ -0,0 +1,89 @@
+#include "TelemetryShmPublisher.h"
+#include "log.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+static_assert(sizeof(TelemetryShmEntry_t) == 64, "TelemetryShmEntry_t layout is shared with other processes");
+
+TelemetryShmPublisher::~TelemetryShmPublisher()
+{
+	close();
+}
+
+bool TelemetryShmPublisher::open(const char* name)
+{
+	int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+	if (fd < 0) {
+		logError() << "TelemetryShmPublisher::open shm_open failed" << strerror(errno);
+		return false;
+	}
+
+	if (ftruncate(fd, sizeof(TelemetryShmSegment_t)) != 0) {
+		logError() << "TelemetryShmPublisher::open ftruncate failed" << strerror(errno);
+		::close(fd);
+		return false;
+	}
+
+	void* mapping = mmap(nullptr, sizeof(TelemetryShmSegment_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (mapping == MAP_FAILED) {
+		logError() << "TelemetryShmPublisher::open mmap failed" << strerror(errno);
+		return false;
+	}
+
+	_segment	= static_cast<TelemetryShmSegment_t*>(mapping);
+	_name		= name;
+
+	// A previous controller instance may have left a segment behind. Invalidate it while re-initializing.
+	__atomic_store_n(&_segment->magic, 0, __ATOMIC_RELEASE);
+	memset(_segment->entries, 0, sizeof(_segment->entries));
+	_segment->version		= TELEMETRY_SHM_VERSION;
+	_segment->capacity		= TELEMETRY_SHM_CAPACITY;
+	_segment->entrySize		= sizeof(TelemetryShmEntry_t);
+	__atomic_store_n(&_segment->writeIndex, 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&_segment->magic, TELEMETRY_SHM_MAGIC, __ATOMIC_RELEASE);
+
+	logInfo() << "TelemetryShmPublisher::open" << _name << "size:" << sizeof(TelemetryShmSegment_t);
+
+	return true;
+}
+
+void TelemetryShmPublisher::close()
+{
+	if (_segment) {
+		munmap(_segment, sizeof(TelemetryShmSegment_t));
+		_segment = nullptr;
+		shm_unlink(_name.c_str());
+	}
+}
+
+void TelemetryShmPublisher::publish(const TelemetryShmEntry_t& entry)
+{
+	if (!_segment) {
+		return;
+	}
+
+	uint64_t				writeIndex	= __atomic_load_n(&_segment->writeIndex, __ATOMIC_RELAXED);
+	TelemetryShmEntry_t*	slot		= &_segment->entries[writeIndex & (TELEMETRY_SHM_CAPACITY - 1)];
+	uint32_t				sequence	= slot->sequence;
+
+	__atomic_store_n(&slot->sequence, sequence + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	slot->index				= writeIndex;
+	slot->timeInSeconds		= entry.timeInSeconds;
+	slot->latitude			= entry.latitude;
+	slot->longitude			= entry.longitude;
+	slot->relativeAltitude	= entry.relativeAltitude;
+	slot->rollDegrees		= entry.rollDegrees;
+	slot->pitchDegrees		= entry.pitchDegrees;
+	slot->yawDegrees		= entry.yawDegrees;
+
+	__atomic_store_n(&slot->sequence, sequence + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&_segment->writeIndex, writeIndex + 1, __ATOMIC_RELEASE);
+}
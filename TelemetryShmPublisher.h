@@ -0,0 +1,28 @@
+#pragma once
+
+#include "TelemetryShm.h"
+
+#include <cstdint>
+#include <string>
+
+// Single writer side of the TelemetryShm.h segment
+class TelemetryShmPublisher
+{
+public:
+	TelemetryShmPublisher() = default;
+	~TelemetryShmPublisher();
+
+	// Non-copyable
+	TelemetryShmPublisher(const TelemetryShmPublisher&) = delete;
+	const TelemetryShmPublisher& operator=(const TelemetryShmPublisher&) = delete;
+
+	bool open	(const char* name);	// Takes over the segment, any other publisher using name is clobbered
+	void close	();
+	bool isOpen	() const { return _segment != nullptr; }
+
+	void publish(const TelemetryShmEntry_t& entry);
+
+private:
+	TelemetryShmSegment_t*	_segment { nullptr };
+	std::string				_name;
+};
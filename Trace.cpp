@@ -0,0 +1,183 @@
+#include "Trace.h"
+#include "LogFileManager.h"
+#include "timeHelpers.h"
+#include "log.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+Trace* Trace::_instance = nullptr;
+
+// Hands the thread's buffer back to Trace when the thread exits so short lived threads (the detection start and stop
+// threads CommandHandler runs for each command) don't leak a buffer per detection session
+class TraceThreadBufferOwner
+{
+public:
+	~TraceThreadBufferOwner()
+	{
+		if (threadBuffer) {
+			Trace::instance()->_retireBuffer(threadBuffer);
+		}
+	}
+
+	Trace::ThreadBuffer* threadBuffer = nullptr;
+};
+
+static thread_local TraceThreadBufferOwner threadBufferOwner;
+
+Trace* Trace::instance()
+{
+	static std::once_flag once;
+
+	std::call_once(once, []() { _instance = new Trace(); });
+
+	return _instance;
+}
+
+void Trace::sessionStarted()
+{
+	_sessionStartNSecs	= nsecsMonotonic();
+	_enabled			= true;
+}
+
+void Trace::sessionEnded()
+{
+	_enabled = false;
+	writeTrace();
+}
+
+Trace::ThreadBuffer* Trace::_threadBuffer(void)
+{
+	if (threadBufferOwner.threadBuffer) {
+		return threadBufferOwner.threadBuffer;
+	}
+
+	std::lock_guard<std::mutex> lock(_buffersMutex);
+
+	ThreadBuffer* threadBuffer = nullptr;
+
+	// Spans from a retired buffer are only needed until the trace for the session they belong to is written
+	for (ThreadBuffer* retiredBuffer: _buffers) {
+		if (retiredBuffer->retired && (!_enabled || retiredBuffer->retiredNSecs < _sessionStartNSecs)) {
+			threadBuffer = retiredBuffer;
+			break;
+		}
+	}
+	if (!threadBuffer) {
+		threadBuffer = new ThreadBuffer;
+		threadBuffer->spans.resize(_threadBufferCapacity);
+		_buffers.push_back(threadBuffer);
+	}
+
+	threadBuffer->tid		= syscall(SYS_gettid);
+	threadBuffer->spanCount	= 0;
+	threadBuffer->retired	= false;
+
+	threadBufferOwner.threadBuffer = threadBuffer;
+
+	return threadBuffer;
+}
+
+void Trace::_retireBuffer(ThreadBuffer* threadBuffer)
+{
+	std::lock_guard<std::mutex> lock(_buffersMutex);
+
+	threadBuffer->retiredNSecs	= nsecsMonotonic();
+	threadBuffer->retired		= true;
+}
+
+void Trace::recordSpan(const char* name, uint64_t startNSecs, uint64_t endNSecs)
+{
+	if (!_enabled) {
+		return;
+	}
+
+	ThreadBuffer*	threadBuffer	= _threadBuffer();
+	uint64_t		spanCount		= threadBuffer->spanCount.load(std::memory_order_relaxed);
+	Span_t&			span			= threadBuffer->spans[spanCount % _threadBufferCapacity];
+
+	span.startNSecs		= startNSecs;
+	span.durationNSecs	= endNSecs - startNSecs;
+	strncpy(span.name, name, sizeof(span.name) - 1);
+	span.name[sizeof(span.name) - 1] = 0;
+
+	threadBuffer->spanCount.store(spanCount + 1, std::memory_order_release);
+}
+
+void Trace::writeTrace()
+{
+	std::lock_guard<std::mutex> lock(_buffersMutex);
+
+	std::string filename	= LogFileManager::instance()->filename("trace", "json");
+	FILE*		file		= fopen(filename.c_str(), "w");
+
+	if (!file) {
+		logError() << "Trace::writeTrace unable to create" << filename << strerror(errno);
+		return;
+	}
+
+	uint64_t	sessionStartNSecs	= _sessionStartNSecs;
+	pid_t		pid					= getpid();
+	bool		firstEvent			= true;
+	uint64_t	spanTotal			= 0;
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+	for (ThreadBuffer* threadBuffer: _buffers) {
+		uint64_t spanCount = threadBuffer->spanCount.load(std::memory_order_acquire);
+		uint64_t firstSpan = 0;
+
+		if (spanCount > _threadBufferCapacity) {
+			// The owning thread keeps writing while we read, skip the oldest spans since they may be overwritten meanwhile
+			firstSpan = spanCount - _threadBufferCapacity + (_threadBufferCapacity / 16);
+		}
+
+		for (uint64_t i=firstSpan; i<spanCount; i++) {
+			const Span_t& span = threadBuffer->spans[i % _threadBufferCapacity];
+
+			// Spans which finished before the session started are from an earlier session
+			if (span.startNSecs + span.durationNSecs < sessionStartNSecs) {
+				continue;
+			}
+
+			std::string name;
+			for (const char* p = span.name; *p; p++) {
+				if (*p == '"' || *p == '\\') {
+					name += '\\';
+				}
+				name += *p;
+			}
+
+			fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+						firstEvent ? "" : ",\n",
+						name.c_str(),
+						span.startNSecs / 1000.0,
+						span.durationNSecs / 1000.0,
+						pid,
+						threadBuffer->tid);
+			firstEvent = false;
+			spanTotal++;
+		}
+	}
+
+	fprintf(file, "\n]}\n");
+	fclose(file);
+
+	logInfo() << "Trace: wrote" << spanTotal << "spans to" << filename;
+}
+
+TraceSpan::TraceSpan(const char* name)
+	: _startNSecs(nsecsMonotonic())
+{
+	strncpy(_name, name, sizeof(_name) - 1);
+	_name[sizeof(_name) - 1] = 0;
+}
+
+TraceSpan::~TraceSpan()
+{
+	Trace::instance()->recordSpan(_name, _startNSecs, nsecsMonotonic());
+}
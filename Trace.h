@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Span tracing for finding where time goes in command handling, process startup and the pulse pipeline. Each thread
+// records completed spans into its own ring buffer, so recording never takes a lock. While detectors are running the
+// spans are written as Chrome trace JSON to trace.json in the session log directory (open it with chrome://tracing
+// or ui.perfetto.dev). Each thread keeps its most recent _threadBufferCapacity spans.
+class Trace
+{
+public:
+	static Trace* instance();
+
+	void sessionStarted	();
+	void sessionEnded	();		// Writes the trace for the session
+	void writeTrace		();		// Writes the trace so far, can be called at any point in the session
+
+	// Thread safe. Dropped while no session is running.
+	void recordSpan		(const char* name, uint64_t startNSecs, uint64_t endNSecs);
+
+private:
+	Trace() = default;
+
+	typedef struct {
+		uint64_t	startNSecs;
+		uint64_t	durationNSecs;
+		char		name[48];
+	} Span_t;
+
+	struct ThreadBuffer {
+		int						tid				= 0;
+		std::atomic_uint64_t	spanCount		{ 0 };		// Total spans written, index into spans is modulo capacity
+		std::atomic_bool		retired			{ false };	// Owning thread has exited
+		uint64_t				retiredNSecs	= 0;
+		std::vector<Span_t>		spans;
+	};
+
+	ThreadBuffer*	_threadBuffer	(void);
+	void			_retireBuffer	(ThreadBuffer* threadBuffer);
+
+	std::mutex					_buffersMutex;		// Held while adding/reusing buffers and writing the trace
+	std::vector<ThreadBuffer*>	_buffers;
+	std::atomic_bool			_enabled			{ false };
+	std::atomic_uint64_t		_sessionStartNSecs	{ 0 };
+
+	static Trace*				_instance;
+	static constexpr size_t		_threadBufferCapacity = 4096;
+
+	friend class TraceThreadBufferOwner;
+};
+
+// Records a span from construction to destruction:
+//	TraceSpan span("writeDetectorConfigs");
+class TraceSpan
+{
+public:
+	TraceSpan(const char* name);
+	TraceSpan(const std::string& name) : TraceSpan(name.c_str()) {}
+	~TraceSpan();
+
+	TraceSpan(const TraceSpan&) = delete;
+	TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+	char		_name[48];
+	uint64_t	_startNSecs;
+};
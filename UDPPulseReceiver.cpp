@@ -4,28 +4,31 @@
 #include "log.h"
 #include "MavlinkSystem.h"
 #include "TelemetryCache.h"
-
-#include <netinet/in.h>
-#include <sys/socket.h>
-#include <arpa/inet.h>
-#include <errno.h>
-#include <unistd.h> // for close()
+#include "timeHelpers.h"
+#include "PulseTransport.h"
+#include "DetectorHealth.h"
+#include "FlightRecorder.h"
+#include "Trace.h"
+#include "ReplayCapture.h"
+#include "AllocationCounter.h"
 
 #include <algorithm>
+#include <array>
 #include <utility>
 #include <iostream>
 #include <string.h>
 #include <cstddef>
 #include <chrono>
+#include <thread>
 
 using namespace TunnelProtocol;
 
 
-UDPPulseReceiver::UDPPulseReceiver(std::string localIp, int localPort, MavlinkSystem* mavlink, TelemetryCache* telemetryCache)
-    : _localIp	            (std::move(localIp))
-    , _localPort            (localPort)
+UDPPulseReceiver::UDPPulseReceiver(const std::string& pulseTransportUrl, MavlinkSystem* mavlink, TelemetryCache* telemetryCache, DetectorHealth* detectorHealth)
+    : _transport            (PulseTransport::create(pulseTransportUrl))
     , _mavlink              (mavlink)
     , _telemetryCache       (telemetryCache)
+    , _detectorHealth       (detectorHealth)
 {
 
 }
@@ -39,83 +42,212 @@ UDPPulseReceiver::~UDPPulseReceiver()
 
 void UDPPulseReceiver::start()
 {
-    if (!_setupPort()) {
+    if (!_transport || !_transport->open()) {
         return;
     }
 
-    _thread = new std::thread(&UDPPulseReceiver::_receive, this);
+    logInfo() << "Receiving pulses from" << _transport->url();
+
+    _lastStageTimingsMSecs = msecsSinceEpoch();
+
+    _enqueueThread  = std::thread(&UDPPulseReceiver::_enqueue, this);
+    _encodeThread   = std::thread(&UDPPulseReceiver::_encode, this);
+    _enrichThread   = std::thread(&UDPPulseReceiver::_enrich, this);
+    _thread         = std::thread(&UDPPulseReceiver::_ingest, this);
+    _watchdogThread = std::thread(&UDPPulseReceiver::_pipelineWatchdog, this);
 }
 
-bool UDPPulseReceiver::_setupPort(void)
+void UDPPulseReceiver::stop()
 {
-    _fdSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    {
+        std::lock_guard<std::mutex> lock(_watchdogMutex);
+        _shouldExit = true;
+    }
+    _watchdogCondition.notify_all();
 
-    if (_fdSocket < 0) {
-        logError() << "socket error" << strerror(errno);
-        return false;
+    if (_transport) {
+        _transport->close();
     }
 
-    struct sockaddr_in addr {};
-    addr.sin_family         = AF_INET;
-    addr.sin_addr.s_addr    = inet_addr(_localIp.c_str());
-    addr.sin_port           = htons(_localPort);
+    if (!_thread.joinable()) {
+        return;
+    }
 
-    if (bind(_fdSocket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
-        logError() << "bind error:" << strerror(errno);
-        return false;
+    // Stages are shut down in pipeline order. Once a stage's producer has been joined this thread takes its place and
+    // pushes an empty item, which wakes up the next stage so it sees _shouldExit. If the ring is full the stage isn't
+    // waiting anyway.
+    _thread.join();
+    _ingestedRing.push(IngestedPulse_t {});
+    _enrichThread.join();
+    _enrichedRing.push(EnrichedPulse_t {});
+    _encodeThread.join();
+    _encodedRing.push(EncodedPulse_t {});
+    _enqueueThread.join();
+    _watchdogThread.join();
+}
+
+UDPPulseReceiver::PulseCounts_t UDPPulseReceiver::pulseCounts(void)
+{
+    PulseCounts_t counts;
+
+    counts.received     = _receivedPulses;
+    counts.forwarded    = _stageTimings[StageEnqueue].count;
+    counts.dropped      = _droppedPulses;
+
+    return counts;
+}
+
+void UDPPulseReceiver::_recordStage(PipelineStage stage, uint64_t startNSecs, uint64_t queuedNSecs)
+{
+    StageTiming_t&  timing      = _stageTimings[stage];
+    uint64_t        busyNSecs   = nsecsMonotonic() - startNSecs;
+
+    timing.count++;
+    timing.busyNSecs += busyNSecs;
+    timing.waitNSecs += startNSecs - queuedNSecs;
+    if (busyNSecs > timing.maxBusyNSecs) {
+        timing.maxBusyNSecs = busyNSecs;
     }
+}
+
+void UDPPulseReceiver::_logStageTimings(void)
+{
+    static const char* stageNames[StageCount] = { "ingest", "enrich", "encode", "enqueue" };
 
-    logDebug() << "UDPPulseReceiver::_setupPort" << _localIp << "port:" << _localPort;
+    for (int stage=0; stage<StageCount; stage++) {
+        StageTiming_t&  timing  = _stageTimings[stage];
+        uint64_t        count   = timing.count;
 
-    return true;
+        if (count == 0) {
+            continue;
+        }
+
+        logInfo() << formatString("Pulse pipeline %-7s count: %6llu avg busy: %7.1f us max busy: %8.1f us avg wait: %8.1f us",
+                                    stageNames[stage],
+                                    (unsigned long long)count,
+                                    timing.busyNSecs / count / 1000.0,
+                                    timing.maxBusyNSecs / 1000.0,
+                                    timing.waitNSecs / count / 1000.0);
+    }
+
+    if (_droppedPulses) {
+        logWarn() << "Pulse pipeline dropped pulses:" << _droppedPulses.load();
+    }
 }
 
-void UDPPulseReceiver::stop()
+void UDPPulseReceiver::_pipelineWatchdog(void)
 {
-    // This should interrupt a recv/recvfrom call.
-    shutdown(_fdSocket, SHUT_RDWR);
+    static const char* stageNames[StageCount] = { "ingest", "enrich", "encode", "enqueue" };
 
-    // But on Mac, closing is also needed to stop blocking recv/recvfrom.
-    close(_fdSocket);
+    uint64_t    lastCounts[StageCount]  = {};
+    bool        stalled[StageCount]     = {};
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(_watchdogMutex);
+
+            if (_watchdogCondition.wait_for(lock, std::chrono::milliseconds(_watchdogIntervalMSecs), [this] { return _shouldExit.load(); })) {
+                return;
+            }
+        }
+
+        // A stage is stalled if there is work waiting in its input ring but it has not processed anything since the last check
+        size_t pending[StageCount];
+
+        pending[StageIngest]    = 0;
+        pending[StageEnrich]    = _ingestedRing.size();
+        pending[StageEncode]    = _enrichedRing.size();
+        pending[StageEnqueue]   = _encodedRing.size();
+
+        for (int stage=StageEnrich; stage<StageCount; stage++) {
+            uint64_t    count       = _stageTimings[stage].count;
+            bool        isStalled   = pending[stage] != 0 && count == lastCounts[stage];
+
+            if (isStalled != stalled[stage]) {
+                stalled[stage] = isStalled;
+                if (isStalled) {
+                    logError() << "Pulse pipeline stage stalled:" << stageNames[stage] << "pending:" << pending[stage];
+                    _mavlink->sendStatusText(formatString("Pulse pipeline %s stalled", stageNames[stage]), MAV_SEVERITY_CRITICAL);
+                } else {
+                    logInfo() << "Pulse pipeline stage resumed:" << stageNames[stage];
+                    _mavlink->sendStatusText(formatString("Pulse pipeline %s resumed", stageNames[stage]), MAV_SEVERITY_INFO);
+                }
+            }
+
+            lastCounts[stage] = count;
+        }
+    }
 }
 
-void UDPPulseReceiver::_receive()
+void UDPPulseReceiver::_ingest()
 {
+    // Enough for MTU 1500 bytes.
+    UDPPulseInfo_T buffer[sizeof(UDPPulseInfo_T) * 10];
+
+    int error = applySchedulingProfile(_ingestSchedulingProfile);
+    if (error) {
+        logWarn() << "UDPPulseReceiver: ingest thread scheduling profile not fully applied:" << schedulingProfileString(_ingestSchedulingProfile) << strerror(error);
+    }
+
     while (true) {
-        // Enough for MTU 1500 bytes.
-        typedef struct {
-            double tag_id;
-            double frequency_hz;
-            double start_time_seconds;
-            double predict_next_start_seconds;
-            double snr;
-            double stft_score;
-            double group_seq_counter;
-            double group_ind;
-            double group_snr;
-            double detection_status;
-            double confirmed_status;
-            double noise_psd;
-        } UDPPulseInfo_T;
-
-        UDPPulseInfo_T buffer[sizeof(UDPPulseInfo_T) * 10];
-
-        auto cBytesReceived = recvfrom(_fdSocket, buffer, sizeof(buffer), 0, NULL, NULL);
-
-        if (cBytesReceived < 0) {
-            // This happens on destruction when close(_fdSocket) is called,
-            // therefore be quiet.
-            logDebug() << "recvfrom error:" << strerror(errno);
+        uint64_t    receivedRealtimeNSecs;
+        int         pulseCount = _transport->receivePulses(buffer, sizeof(buffer) / sizeof(buffer[0]), receivedRealtimeNSecs);
+
+        if (pulseCount < 0) {
+            // Transport was closed
             return;
         }
 
-        int pulseCount = cBytesReceived / sizeof(UDPPulseInfo_T);
-        int pulseIndex = 0;
+        HotPathScope hotPath;
 
-        while (pulseCount--) {
-            UDPPulseInfo_T udpPulseInfo = buffer[pulseIndex++];
+        ReplayCapture::instance()->write(ReplayCapture::SourcePulses, buffer, pulseCount * sizeof(UDPPulseInfo_T));
+        _receivedPulses += pulseCount;
 
-            PulseInfo_t pulseInfo;
+        // Move the kernel receive time over to the monotonic clock used for the stage timings
+        uint64_t nowNSecs           = nsecsMonotonic();
+        uint64_t nowRealtimeNSecs   = nsecsSinceEpoch();
+        uint64_t receivedNSecs      = nowNSecs - std::min(nowNSecs, nowRealtimeNSecs > receivedRealtimeNSecs ? nowRealtimeNSecs - receivedRealtimeNSecs : 0);
+
+        for (int pulseIndex=0; pulseIndex<pulseCount; pulseIndex++) {
+            IngestedPulse_t ingestedPulse;
+
+            ingestedPulse.udpPulseInfo          = buffer[pulseIndex];
+            ingestedPulse.receivedRealtimeNSecs = receivedRealtimeNSecs;
+            ingestedPulse.receivedNSecs         = receivedNSecs;
+            ingestedPulse.queuedNSecs           = nsecsMonotonic();
+
+            if (!_ingestedRing.push(ingestedPulse)) {
+                _droppedPulses++;
+            }
+        }
+
+        _recordStage(StageIngest, receivedNSecs, receivedNSecs);
+    }
+}
+
+void UDPPulseReceiver::_enrich()
+{
+    IngestedPulse_t ingestedPulse;
+
+    while (!_shouldExit) {
+        _ingestedRing.waitForItem();
+
+        while (!_shouldExit && _ingestedRing.pop(ingestedPulse)) {
+            HotPathScope            hotPath;
+            TraceSpan               span            ("enrichPulse");
+            uint64_t                startNSecs      = nsecsMonotonic();
+            const UDPPulseInfo_T&   udpPulseInfo    = ingestedPulse.udpPulseInfo;
+            EnrichedPulse_t         enrichedPulse;
+            PulseInfo_t&            pulseInfo       = enrichedPulse.pulseInfo;
+
+            if (udpPulseInfo.frequency_hz == 0) {
+                // Detector heartbeats are aggregated into the detector health summary instead of being forwarded
+                _detectorHealth->heartbeatReceived((uint32_t)udpPulseInfo.tag_id, udpPulseInfo.noise_psd);
+                _recordStage(StageEnrich, startNSecs, ingestedPulse.queuedNSecs);
+                continue;
+            }
+
+            _detectorHealth->pulseReceived((uint32_t)udpPulseInfo.tag_id, udpPulseInfo.noise_psd);
 
             memset(&pulseInfo, 0, sizeof(pulseInfo));
 
@@ -123,46 +255,129 @@ void UDPPulseReceiver::_receive()
             pulseInfo.tag_id                        = (uint32_t)udpPulseInfo.tag_id;
             pulseInfo.frequency_hz                  = (uint32_t)udpPulseInfo.frequency_hz;
 
-            if (pulseInfo.frequency_hz == 0) {
-                logInfo() << "HEARTBEAT from Detector" << pulseInfo.tag_id;
+            auto telemetry = _telemetryCache->telemetryForTime(udpPulseInfo.start_time_seconds);
+
+            pulseInfo.start_time_seconds            = udpPulseInfo.start_time_seconds;
+            pulseInfo.predict_next_start_seconds    = udpPulseInfo.predict_next_start_seconds;
+            pulseInfo.snr                           = udpPulseInfo.snr;
+            pulseInfo.stft_score                    = udpPulseInfo.stft_score;
+            pulseInfo.group_seq_counter             = (uint16_t)udpPulseInfo.group_seq_counter;
+            pulseInfo.group_ind                     = (uint16_t)udpPulseInfo.group_ind;
+            pulseInfo.group_snr                     = udpPulseInfo.group_snr;
+            pulseInfo.detection_status              = (uint8_t)udpPulseInfo.detection_status;
+            pulseInfo.confirmed_status              = (uint8_t)udpPulseInfo.confirmed_status;
+            pulseInfo.position_x                    = telemetry.position.latitude;
+            pulseInfo.position_y                    = telemetry.position.longitude;
+            pulseInfo.position_z                    = telemetry.position.relativeAltitude;
+            pulseInfo.orientation_x                 = telemetry.attitudeEuler.rollDegrees;
+            pulseInfo.orientation_y                 = telemetry.attitudeEuler.pitchDegrees;
+            pulseInfo.orientation_z                 = telemetry.attitudeEuler.yawDegrees;
+            pulseInfo.noise_psd                     = udpPulseInfo.noise_psd;
+
+            FlightRecorder::instance()->recordPulse(pulseInfo);
+
+            enrichedPulse.receivedRealtimeNSecs = ingestedPulse.receivedRealtimeNSecs;
+            enrichedPulse.receivedNSecs         = ingestedPulse.receivedNSecs;
+            enrichedPulse.queuedNSecs           = nsecsMonotonic();
+
+            if (!_enrichedRing.push(enrichedPulse)) {
+                _droppedPulses++;
+            }
+
+            _recordStage(StageEnrich, startNSecs, ingestedPulse.queuedNSecs);
+        }
+    }
+}
+
+void UDPPulseReceiver::_encode()
+{
+    EnrichedPulse_t enrichedPulse;
+
+    while (!_shouldExit) {
+        _enrichedRing.waitForItem();
+
+        while (!_shouldExit && _enrichedRing.pop(enrichedPulse)) {
+            HotPathScope        hotPath;
+            uint64_t            startNSecs  = nsecsMonotonic();
+            const PulseInfo_t&  pulseInfo   = enrichedPulse.pulseInfo;
+            EncodedPulse_t      encodedPulse;
+
+            encodedPulse.encoded        = _mavlink->encodeTunnelMessage(&pulseInfo, sizeof(pulseInfo), encodedPulse.message);
+            encodedPulse.confirmed      = pulseInfo.confirmed_status;
+
+            encodedPulse.pulseInfo      = pulseInfo;
+
+            PulseTimestamps_t& timestamps = encodedPulse.timestamps;
+
+            timestamps.tagId                    = pulseInfo.tag_id;
+            timestamps.startTimeSeconds         = pulseInfo.start_time_seconds;
+            timestamps.receivedRealtimeNSecs    = enrichedPulse.receivedRealtimeNSecs;
+            timestamps.receivedNSecs            = enrichedPulse.receivedNSecs;
+            timestamps.enrichedNSecs            = enrichedPulse.queuedNSecs;
+            timestamps.enqueuedNSecs            = 0;
+
+            encodedPulse.queuedNSecs    = nsecsMonotonic();
+
+            if (!_encodedRing.push(encodedPulse)) {
+                _droppedPulses++;
+            }
+
+            _recordStage(StageEncode, startNSecs, enrichedPulse.queuedNSecs);
+        }
+    }
+}
+
+// Only called inside log statements, so nothing is formatted unless the level is enabled. Formats into a buffer on the
+// stack since it runs on the hot path.
+static std::array<char, 160> formatPulseStatus(const PulseInfo_t& pulseInfo)
+{
+    std::array<char, 160> pulseStatus;
+
+    snprintf(pulseStatus.data(), pulseStatus.size(),
+                "Conf: %u Id: %2u snr: %5.1f noise_psd: %5.1g freq: %9u lat/lon/yaw/alt: %3.6f %3.6f %4.0f %3.0f",
+                pulseInfo.confirmed_status,
+                pulseInfo.tag_id,
+                pulseInfo.snr,
+                pulseInfo.noise_psd,
+                pulseInfo.frequency_hz,
+                pulseInfo.position_x,
+                pulseInfo.position_y,
+                pulseInfo.orientation_z,
+                pulseInfo.position_z);
+
+    return pulseStatus;
+}
+
+void UDPPulseReceiver::_enqueue()
+{
+    EncodedPulse_t encodedPulse;
+
+    while (!_shouldExit) {
+        _encodedRing.waitForItem();
+
+        while (!_shouldExit && _encodedRing.pop(encodedPulse)) {
+            HotPathScope    hotPath;
+            uint64_t        startNSecs = nsecsMonotonic();
+
+            if (encodedPulse.encoded) {
+                // Latency is tracked through to the moment the message is written to the connection
+                encodedPulse.timestamps.enqueuedNSecs = nsecsMonotonic();
+                _mavlink->sendMessage(encodedPulse.message, &encodedPulse.timestamps);
+            }
+
+            if (encodedPulse.confirmed) {
+                logInfo() << formatPulseStatus(encodedPulse.pulseInfo).data();
             } else {
-                auto telemetry = _telemetryCache->telemetryForTime(udpPulseInfo.start_time_seconds);
-
-                pulseInfo.start_time_seconds            = udpPulseInfo.start_time_seconds;
-                pulseInfo.predict_next_start_seconds    = udpPulseInfo.predict_next_start_seconds;
-                pulseInfo.snr                           = udpPulseInfo.snr;
-                pulseInfo.stft_score                    = udpPulseInfo.stft_score;
-                pulseInfo.group_seq_counter             = (uint16_t)udpPulseInfo.group_seq_counter;
-                pulseInfo.group_ind                     = (uint16_t)udpPulseInfo.group_ind;
-                pulseInfo.group_snr                     = udpPulseInfo.group_snr;
-                pulseInfo.detection_status              = (uint8_t)udpPulseInfo.detection_status;
-                pulseInfo.confirmed_status              = (uint8_t)udpPulseInfo.confirmed_status;
-                pulseInfo.position_x                    = telemetry.position.latitude;
-                pulseInfo.position_y                    = telemetry.position.longitude;
-                pulseInfo.position_z                    = telemetry.position.relativeAltitude;
-                pulseInfo.orientation_x                 = telemetry.attitudeEuler.rollDegrees;
-                pulseInfo.orientation_y                 = telemetry.attitudeEuler.pitchDegrees;
-                pulseInfo.orientation_z                 = telemetry.attitudeEuler.yawDegrees;
-                pulseInfo.noise_psd                     = udpPulseInfo.noise_psd;
-
-                std::string pulseStatus = formatString("Conf: %u Id: %2u snr: %5.1f noise_psd: %5.1g freq: %9u lat/lon/yaw/alt: %3.6f %3.6f %4.0f %3.0f",
-                                                pulseInfo.confirmed_status,
-                                                pulseInfo.tag_id,
-                                                pulseInfo.snr,
-                                                pulseInfo.noise_psd,
-                                                pulseInfo.frequency_hz,
-                                                telemetry.position.latitude,
-                                                telemetry.position.longitude,
-                                                telemetry.attitudeEuler.yawDegrees,
-                                                telemetry.position.relativeAltitude);
-                if (udpPulseInfo.confirmed_status) {
-                    logInfo() << pulseStatus;
-                } else {
-                    logDebug() << pulseStatus;
-                }
+                logDebug() << formatPulseStatus(encodedPulse.pulseInfo).data();
             }
 
-            _mavlink->sendTunnelMessage(&pulseInfo, sizeof(pulseInfo));
+            _recordStage(StageEnqueue, startNSecs, encodedPulse.queuedNSecs);
+        }
+
+        auto nowMSecs = msecsSinceEpoch();
+        if (nowMSecs - _lastStageTimingsMSecs >= _stageTimingsIntervalMSecs) {
+            _lastStageTimingsMSecs = nowMSecs;
+            _logStageTimings();
         }
     }
 }
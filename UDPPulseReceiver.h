@@ -1,32 +1,136 @@
 #pragma once
 
+#include "SpscRing.h"
+#include "TunnelProtocol.h"
+#include "PulseLatencyStats.h"
+#include "SchedulingProfile.h"
+
+#include <mavlink.h>
+
 #include <thread>
 #include <string>
 #include <memory>
 #include <thread>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 class MavlinkSystem;
 class TelemetryCache;
+class PulseTransport;
+class DetectorHealth;
 
+// Pulses are processed by a pipeline of stages, each running on its own thread and connected by lock-free SPSC rings:
+//	ingest	- drains the detector pulse transport (see PulseTransport.h)
+//	enrich	- adds vehicle telemetry for the pulse time, detector heartbeats end here in the DetectorHealth table
+//	encode	- builds the tunnel message and the pulse log line
+//	enqueue	- hands the message to the outgoing queue and does the logging
+// This way transport draining never waits on telemetry locks or log i/o. A watchdog thread reports stages which
+// stop draining their input ring.
 class UDPPulseReceiver
 {
 public:
-	UDPPulseReceiver(std::string localIp, int localPort, MavlinkSystem* mavlink, TelemetryCache* telemetryCache);
+	// Pulse information as sent by uavrt_detection. Detector heartbeats have frequency_hz == 0.
+	typedef struct {
+		double tag_id;
+		double frequency_hz;
+		double start_time_seconds;
+		double predict_next_start_seconds;
+		double snr;
+		double stft_score;
+		double group_seq_counter;
+		double group_ind;
+		double group_snr;
+		double detection_status;
+		double confirmed_status;
+		double noise_psd;
+	} UDPPulseInfo_T;
+
+	UDPPulseReceiver(const std::string& pulseTransportUrl, MavlinkSystem* mavlink, TelemetryCache* telemetryCache, DetectorHealth* detectorHealth);
 	~UDPPulseReceiver();
 
-	void start	(void);
-	void run 	(void);
-	void stop 	(void);
+	typedef struct {
+		uint64_t received;		// Pulses and heartbeats read from the transport
+		uint64_t forwarded;		// Pulses handed to the outgoing message queue
+		uint64_t dropped;		// Lost to a full pipeline ring
+	} PulseCounts_t;
+
+	void			start		(void);
+	void			setIngestSchedulingProfile(const SchedulingProfile_t& schedulingProfile) { _ingestSchedulingProfile = schedulingProfile; }	// Call before start
+	void			run 		(void);
+	void			stop 		(void);
+	PulseCounts_t	pulseCounts	(void);
 
 private:
-	bool _setupPort (void);
-	void _receive 	(void);
+	enum PipelineStage {
+		StageIngest,
+		StageEnrich,
+		StageEncode,
+		StageEnqueue,
+		StageCount
+	};
+
+	typedef struct {
+		UDPPulseInfo_T	udpPulseInfo;
+		uint64_t		receivedRealtimeNSecs;
+		uint64_t		receivedNSecs;
+		uint64_t		queuedNSecs;
+	} IngestedPulse_t;
+
+	typedef struct {
+		TunnelProtocol::PulseInfo_t	pulseInfo;
+		uint64_t					receivedRealtimeNSecs;
+		uint64_t					receivedNSecs;
+		uint64_t					queuedNSecs;
+	} EnrichedPulse_t;
 
-	std::thread*					_thread 	{ nullptr };
-    std::string 					_localIp;
-    int 							_localPort;
-    int 							_fdSocket	{-1};
+	typedef struct {
+		mavlink_message_t	message;
+		bool				encoded;
+		bool				confirmed;
+		TunnelProtocol::PulseInfo_t	pulseInfo;		// Only formatted for the log if the level is enabled
+		PulseTimestamps_t	timestamps;
+		uint64_t			queuedNSecs;
+	} EncodedPulse_t;
+
+	typedef struct {
+		std::atomic_uint64_t	count;
+		std::atomic_uint64_t	busyNSecs;		// Time spent processing
+		std::atomic_uint64_t	maxBusyNSecs;
+		std::atomic_uint64_t	waitNSecs;		// Time spent sitting in the input ring
+	} StageTiming_t;
+
+	void _ingest 			(void);
+	void _enrich 			(void);
+	void _encode 			(void);
+	void _enqueue 			(void);
+	void _recordStage		(PipelineStage stage, uint64_t startNSecs, uint64_t queuedNSecs);
+	void _logStageTimings	(void);
+	void _pipelineWatchdog	(void);
+
+	static constexpr size_t		_ringCapacity				= 1024;
+	static constexpr uint64_t	_stageTimingsIntervalMSecs	= 30000;
+	static constexpr uint64_t	_watchdogIntervalMSecs		= 2000;
+
+	std::thread						_thread;
+	std::thread						_enrichThread;
+	std::thread						_encodeThread;
+	std::thread						_enqueueThread;
+	std::thread						_watchdogThread;
+	std::atomic_bool				_shouldExit		{ false };
+	std::mutex						_watchdogMutex;
+	std::condition_variable			_watchdogCondition;
+    std::unique_ptr<PulseTransport>	_transport;
+	SchedulingProfile_t				_ingestSchedulingProfile { .policy = SCHED_FIFO, .priority = 10 };	// Pulses are read as soon as they arrive
     MavlinkSystem*					_mavlink;
 	TelemetryCache*					_telemetryCache;
-};
\ No newline at end of file
+	DetectorHealth*					_detectorHealth;
+
+	SpscRing<IngestedPulse_t, _ringCapacity>	_ingestedRing;
+	SpscRing<EnrichedPulse_t, _ringCapacity>	_enrichedRing;
+	SpscRing<EncodedPulse_t, _ringCapacity>		_encodedRing;
+	StageTiming_t								_stageTimings[StageCount] {};
+	std::atomic_uint64_t						_droppedPulses { 0 };
+	std::atomic_uint64_t						_receivedPulses { 0 };
+	uint64_t									_lastStageTimingsMSecs { 0 };
+};
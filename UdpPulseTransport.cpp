@@ -0,0 +1,77 @@
+#include "UdpPulseTransport.h"
+#include "log.h"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+UdpPulseTransport::UdpPulseTransport(const std::string& url)
+	: PulseTransport(url)
+{
+	std::string udp		= "udp://";
+	std::string conn	= url.substr(udp.length());
+
+	size_t index = conn.find(':');
+	_localIp	= conn.substr(0, index);
+	_localPort	= std::stoi(conn.substr(index + 1));
+}
+
+UdpPulseTransport::~UdpPulseTransport()
+{
+	close();
+}
+
+bool UdpPulseTransport::open()
+{
+    _fdSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+    if (_fdSocket < 0) {
+        logError() << "socket error" << strerror(errno);
+        return false;
+    }
+
+    struct sockaddr_in addr {};
+    addr.sin_family         = AF_INET;
+    addr.sin_addr.s_addr    = inet_addr(_localIp.c_str());
+    addr.sin_port           = htons(_localPort);
+
+    if (bind(_fdSocket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        logError() << "bind error:" << strerror(errno);
+        return false;
+    }
+
+    _enableTimestamps(_fdSocket);
+
+    logDebug() << "UdpPulseTransport::open" << _localIp << "port:" << _localPort;
+
+    return true;
+}
+
+void UdpPulseTransport::close()
+{
+	if (_fdSocket >= 0) {
+	    // This should interrupt a recv/recvfrom call.
+	    shutdown(_fdSocket, SHUT_RDWR);
+
+	    // But on Mac, closing is also needed to stop blocking recv/recvfrom.
+	    ::close(_fdSocket);
+		_fdSocket = -1;
+	}
+}
+
+int UdpPulseTransport::receivePulses(UDPPulseReceiver::UDPPulseInfo_T* buffer, int maxPulses, uint64_t& receivedRealtimeNSecs)
+{
+	auto cBytesReceived = _receiveWithTimestamp(_fdSocket, buffer, maxPulses * sizeof(UDPPulseReceiver::UDPPulseInfo_T), receivedRealtimeNSecs);
+
+	if (cBytesReceived < 0) {
+		// This happens on destruction when close(_fdSocket) is called,
+		// therefore be quiet.
+		logDebug() << "recvmsg error:" << strerror(errno);
+		return -1;
+	}
+
+	return cBytesReceived / sizeof(UDPPulseReceiver::UDPPulseInfo_T);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "PulseTransport.h"
+
+class UdpPulseTransport : public PulseTransport
+{
+public:
+	UdpPulseTransport(const std::string& url);
+	~UdpPulseTransport();
+
+	// PulseTransport overrides
+	bool	open			() override;
+	void	close			() override;
+	int		receivePulses	(UDPPulseReceiver::UDPPulseInfo_T* buffer, int maxPulses, uint64_t& receivedRealtimeNSecs) override;
+
+private:
+	std::string _localIp;
+	int			_localPort	{ 0 };
+	int			_fdSocket	{ -1 };
+};
@@ -0,0 +1,77 @@
+#include "UnixPulseTransport.h"
+#include "log.h"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+UnixPulseTransport::UnixPulseTransport(const std::string& url)
+	: PulseTransport(url)
+	, _socketPath	(url.substr(std::string("unix://").length()))
+{
+
+}
+
+UnixPulseTransport::~UnixPulseTransport()
+{
+	close();
+}
+
+bool UnixPulseTransport::open()
+{
+	struct sockaddr_un addr {};
+
+	if (_socketPath.length() >= sizeof(addr.sun_path)) {
+		logError() << "UnixPulseTransport::open socket path too long" << _socketPath;
+		return false;
+	}
+
+	_fdSocket = socket(AF_UNIX, SOCK_DGRAM, 0);
+	if (_fdSocket < 0) {
+		logError() << "UnixPulseTransport::open socket error" << strerror(errno);
+		return false;
+	}
+
+	// Remove a stale socket left behind by a previous run
+	unlink(_socketPath.c_str());
+
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, _socketPath.c_str(), sizeof(addr.sun_path) - 1);
+
+	if (bind(_fdSocket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+		logError() << "UnixPulseTransport::open bind error:" << strerror(errno);
+		return false;
+	}
+	chmod(_socketPath.c_str(), 0666);
+
+	_enableTimestamps(_fdSocket);
+
+	logDebug() << "UnixPulseTransport::open" << _socketPath;
+
+	return true;
+}
+
+void UnixPulseTransport::close()
+{
+	if (_fdSocket >= 0) {
+		shutdown(_fdSocket, SHUT_RDWR);
+		::close(_fdSocket);
+		_fdSocket = -1;
+		unlink(_socketPath.c_str());
+	}
+}
+
+int UnixPulseTransport::receivePulses(UDPPulseReceiver::UDPPulseInfo_T* buffer, int maxPulses, uint64_t& receivedRealtimeNSecs)
+{
+	auto cBytesReceived = _receiveWithTimestamp(_fdSocket, buffer, maxPulses * sizeof(UDPPulseReceiver::UDPPulseInfo_T), receivedRealtimeNSecs);
+
+	if (cBytesReceived < 0) {
+		logDebug() << "UnixPulseTransport recv error:" << strerror(errno);
+		return -1;
+	}
+
+	return cBytesReceived / sizeof(UDPPulseReceiver::UDPPulseInfo_T);
+}
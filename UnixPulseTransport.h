@@ -0,0 +1,19 @@
+#pragma once
+
+#include "PulseTransport.h"
+
+class UnixPulseTransport : public PulseTransport
+{
+public:
+	UnixPulseTransport(const std::string& url);
+	~UnixPulseTransport();
+
+	// PulseTransport overrides
+	bool	open			() override;
+	void	close			() override;
+	int		receivePulses	(UDPPulseReceiver::UDPPulseInfo_T* buffer, int maxPulses, uint64_t& receivedRealtimeNSecs) override;
+
+private:
+	std::string _socketPath;
+	int			_fdSocket	{ -1 };
+};
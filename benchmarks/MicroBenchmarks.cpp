@@ -0,0 +1,456 @@
+// Microbenchmarks for the controller hot paths. Each benchmark is run in batches for at least --min-secs per
+// sample and the median and best time per item across --samples samples are reported. Results are printed as a
+// table and written as JSON so runs can be compared across releases and boards.
+//
+// Usage: MicroBenchmarks [--json:<file>] [--filter:<name substring>] [--min-secs:<secs>] [--samples:<count>]
+// The JSON file defaults to microbenchmarks.json in the current directory.
+
+#include "MavlinkSystem.h"
+#include "MavlinkOutgoingMessageQueue.h"
+#include "MessageParser.h"
+#include "ThreadSafeQueue.h"
+#include "TelemetryCache.h"
+#include "channelizerTuner.h"
+#include "formatString.h"
+#include "log.h"
+#include "Clock.h"
+#include "timeHelpers.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef struct {
+	std::string name;
+	uint64_t	iterations;				// Total calls of the benchmark function across all samples
+	uint64_t	itemsPerIteration;
+	double		medianNSecsPerItem;
+	double		minNSecsPerItem;
+} BenchmarkResult_t;
+
+// Benchmarks can't use the controller clock for timing since it may be simulated
+static uint64_t steadyNSecs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Prevents the compiler from optimizing away a result
+template<typename T> static void doNotOptimize(const T& value)
+{
+	asm volatile("" : : "g"(&value) : "memory");
+}
+
+class BenchmarkRunner
+{
+public:
+	BenchmarkRunner(const std::string& filter, double minSecs, int samples)
+		: _filter	(filter)
+		, _minNSecs	(minSecs * 1e9)
+		, _samples	(samples)
+	{}
+
+	// function is called repeatedly and does itemsPerIteration units of work on each call
+	void run(const std::string& name, uint64_t itemsPerIteration, const std::function<void()>& function)
+	{
+		if (!_filter.empty() && name.find(_filter) == std::string::npos) {
+			return;
+		}
+
+		std::vector<double>	samplesNSecsPerItem;
+		uint64_t			totalIterations = 0;
+		uint64_t			batchSize		= 1;
+
+		// Warm up and size the batch so a batch takes ~1/10 of a sample
+		while (true) {
+			uint64_t startNSecs = steadyNSecs();
+			for (uint64_t i=0; i<batchSize; i++) {
+				function();
+			}
+			if (steadyNSecs() - startNSecs > _minNSecs / 10 || batchSize > (1ull << 30)) {
+				break;
+			}
+			batchSize *= 2;
+		}
+
+		for (int sample=0; sample<_samples; sample++) {
+			uint64_t iterations = 0;
+			uint64_t startNSecs = steadyNSecs();
+			uint64_t elapsedNSecs;
+
+			do {
+				for (uint64_t i=0; i<batchSize; i++) {
+					function();
+				}
+				iterations		+= batchSize;
+				elapsedNSecs	= steadyNSecs() - startNSecs;
+			} while (elapsedNSecs < _minNSecs);
+
+			totalIterations += iterations;
+			samplesNSecsPerItem.push_back(double(elapsedNSecs) / (iterations * itemsPerIteration));
+		}
+
+		std::sort(samplesNSecsPerItem.begin(), samplesNSecsPerItem.end());
+
+		BenchmarkResult_t result;
+
+		result.name					= name;
+		result.iterations			= totalIterations;
+		result.itemsPerIteration	= itemsPerIteration;
+		result.medianNSecsPerItem	= samplesNSecsPerItem[samplesNSecsPerItem.size() / 2];
+		result.minNSecsPerItem		= samplesNSecsPerItem[0];
+
+		_results.push_back(result);
+	}
+
+	const std::vector<BenchmarkResult_t>& results() const { return _results; }
+
+private:
+	std::string						_filter;
+	uint64_t						_minNSecs;
+	int								_samples;
+	std::vector<BenchmarkResult_t>	_results;
+};
+
+// Discards everything written to it, used to keep console output out of the benchmarks
+class NullStreamBuf : public std::streambuf
+{
+protected:
+	int_type		overflow	(int_type c) override { return c; }
+	std::streamsize	xsputn		(const char*, std::streamsize count) override { return count; }
+};
+
+static std::vector<uint8_t> buildMavlinkStream(int messageCount)
+{
+	std::vector<uint8_t> stream;
+
+	for (int i=0; i<messageCount; i++) {
+		mavlink_message_t	message;
+		uint8_t				buffer[MAVLINK_MAX_PACKET_LEN];
+
+		switch (i % 4) {
+		case 0:
+		{
+			mavlink_heartbeat_t heartbeat {};
+			heartbeat.type = MAV_TYPE_QUADROTOR;
+			mavlink_msg_heartbeat_encode(1, MAV_COMP_ID_AUTOPILOT1, &message, &heartbeat);
+		}
+			break;
+		case 1:
+		{
+			mavlink_global_position_int_t position {};
+			position.lat = 473977420;
+			position.lon = 85455940;
+			mavlink_msg_global_position_int_encode(1, MAV_COMP_ID_AUTOPILOT1, &message, &position);
+		}
+			break;
+		case 2:
+		{
+			mavlink_attitude_t attitude {};
+			attitude.yaw = 1.0;
+			mavlink_msg_attitude_encode(1, MAV_COMP_ID_AUTOPILOT1, &message, &attitude);
+		}
+			break;
+		case 3:
+		{
+			mavlink_tunnel_t tunnel {};
+			tunnel.target_system	= 1;
+			tunnel.payload_length	= 120;
+			mavlink_msg_tunnel_encode(255, MAV_COMP_ID_MISSIONPLANNER, &message, &tunnel);
+		}
+			break;
+		}
+
+		uint16_t bufferLen = mavlink_msg_to_send_buffer(buffer, &message);
+		stream.insert(stream.end(), buffer, buffer + bufferLen);
+	}
+
+	return stream;
+}
+
+static mavlink_message_t positionMessage(void)
+{
+	mavlink_global_position_int_t	position {};
+	mavlink_message_t				message;
+
+	position.lat			= 473977420;
+	position.lon			= 85455940;
+	position.relative_alt	= 50000;
+	mavlink_msg_global_position_int_encode(1, MAV_COMP_ID_AUTOPILOT1, &message, &position);
+
+	return message;
+}
+
+static mavlink_message_t attitudeMessage(void)
+{
+	mavlink_attitude_t	attitude {};
+	mavlink_message_t	message;
+
+	attitude.yaw = 1.0;
+	mavlink_msg_attitude_encode(1, MAV_COMP_ID_AUTOPILOT1, &message, &attitude);
+
+	return message;
+}
+
+static void runBenchmarks(BenchmarkRunner& runner, SimulatedClock* clock)
+{
+	// Bound to an ephemeral port so the outgoing queue has a connection to send on. Nothing is listening so sends
+	// go nowhere.
+	auto mavlink = new MavlinkSystem("udp://127.0.0.1:0");
+	mavlink->start();
+	mavlink->outgoingMessageQueue().setPacing(false);
+
+	{
+		const int				messageCount	= 100;
+		std::vector<uint8_t>	stream			= buildMavlinkStream(messageCount);
+
+		runner.run("MessageParser/parse", messageCount, [&]() {
+			MessageParser		parser(stream.data(), stream.size());
+			mavlink_message_t	message;
+			while (parser.parse(&message)) {
+				doNotOptimize(message);
+			}
+		});
+	}
+
+	{
+		mavlink_message_t position		= positionMessage();
+		mavlink_message_t unsubscribed	= positionMessage();
+
+		unsubscribed.msgid = MAVLINK_MSG_ID_STATUSTEXT;
+
+		runner.run("MavlinkSystem/handleMessage/position", 1, [&]() {
+			mavlink->handleMessage(position);
+		});
+		runner.run("MavlinkSystem/handleMessage/unsubscribed", 1, [&]() {
+			mavlink->handleMessage(unsubscribed);
+		});
+	}
+
+	{
+		ThreadSafeQueue<std::vector<uint8_t>>	queue(1000);
+		std::vector<uint8_t>					datagram(96);
+
+		runner.run("ThreadSafeQueue/pushPop", 1, [&]() {
+			queue.push_back(datagram);
+			doNotOptimize(queue.pop_front());
+		});
+	}
+
+	{
+		const int								itemCount = 1000;
+		ThreadSafeQueue<std::vector<uint8_t>>	queue(itemCount);
+		std::vector<uint8_t>					datagram(96);
+
+		runner.run("ThreadSafeQueue/producerConsumer", itemCount, [&]() {
+			std::thread consumer([&]() {
+				int popped = 0;
+				while (popped < itemCount) {
+					if (queue.pop_front().has_value()) {
+						popped++;
+					}
+				}
+			});
+			for (int i=0; i<itemCount; i++) {
+				while (!queue.push_back(datagram)) { }
+			}
+			consumer.join();
+		});
+	}
+
+	{
+		const int			messageCount	= 100;
+		mavlink_message_t	message			= positionMessage();
+
+		runner.run("MavlinkOutgoingMessageQueue/addMessageAndDrain", messageCount, [&]() {
+			for (int i=0; i<messageCount; i++) {
+				mavlink->outgoingMessageQueue().addMessage(message);
+			}
+			while (!mavlink->outgoingMessageQueue().empty()) {
+				std::this_thread::yield();
+			}
+		});
+	}
+
+	{
+		// Fill the cache with a full pruning window of telemetry by running simulated time quickly, then freeze time so
+		// the cache contents stay fixed for the lookups.
+		auto telemetryCache = new TelemetryCache(mavlink);
+
+		mavlink->handleMessage(positionMessage());
+		mavlink->handleMessage(attitudeMessage());
+		clock->setRate(200);
+		std::this_thread::sleep_for(std::chrono::milliseconds(250));
+		clock->setRate(0);
+
+		double nowSecs = secondsSinceEpoch();
+
+		runner.run("TelemetryCache/telemetryForTime", 1, [&]() {
+			doNotOptimize(telemetryCache->telemetryForTime(nowSecs - 3.3));
+		});
+	}
+
+	{
+		double startTimeSeconds = 1700000000.123456;
+
+		runner.run("formatString/pulse", 1, [&]() {
+			doNotOptimize(formatString("Conf: %d Id: %2d snr: %5.1f noise_psd: %3.1e freq: %9d lat/lon/yaw/alt: %3.6f %3.6f %4d %3d",
+										1, 2, 19.5, 1.2e-9, 146002000, 47.397742, 8.545594, 123, 50));
+		});
+		runner.run("log/logDebug", 1, [&]() {
+			logDebug() << "telemetryForTime";
+		});
+		runner.run("log/logInfo/pulse", 1, [&]() {
+			logInfo() << "Pulse" << 2 << startTimeSeconds << 19.5 << 146002000;
+		});
+
+		setBinaryLogging(true);
+		runner.run("log/logDebug/binary", 1, [&]() {
+			logDebug() << "telemetryForTime";
+		});
+		runner.run("log/logInfo/pulse/binary", 1, [&]() {
+			logInfo() << "Pulse" << 2 << startTimeSeconds << 19.5 << 146002000;
+		});
+		setBinaryLogging(false);
+
+		// Cost of a log call below the runtime level, the arguments are never evaluated. Below LOG_MIN_LEVEL the call
+		// compiles to nothing.
+		LogLevel savedLogLevel = logLevel();
+		setLogLevel(LogLevel::Info);
+		runner.run("log/logDebug/suppressed", 1, [&]() {
+			logDebug() << "Pulse" << 2 << startTimeSeconds << formatString("%.1f", 19.5);
+		});
+		setLogLevel(savedLogLevel);
+	}
+
+	{
+		// Airspy mini decimated rate. Tags are kept within half the bandwidth of each other since the tuner can't
+		// handle test centers which put a tag below the bottom edge.
+		std::vector<uint32_t> freqsHz;
+		for (uint32_t i=0; i<10; i++) {
+			freqsHz.push_back(146000000 + i * 15000);
+		}
+
+		runner.run("channelizerTuner/10tags", 1, [&]() {
+			uint32_t				bestCenterHz;
+			std::vector<uint32_t>	channelBins;
+			doNotOptimize(channelizerTuner(375000, 100, freqsHz, bestCenterHz, channelBins));
+			doNotOptimize(bestCenterHz);
+		});
+	}
+}
+
+static bool writeJson(const std::string& path, const std::vector<BenchmarkResult_t>& results)
+{
+	FILE* file = fopen(path.c_str(), "w");
+	if (!file) {
+		fprintf(stderr, "Unable to create %s\n", path.c_str());
+		return false;
+	}
+
+	char hostname[256] = {};
+	gethostname(hostname, sizeof(hostname) - 1);
+
+	char		timestamp[32];
+	time_t		now = time(nullptr);
+	strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+#ifdef NDEBUG
+	const char* buildType = "release";
+#else
+	const char* buildType = "debug";
+#endif
+
+	fprintf(file, "{\n");
+	fprintf(file, "  \"timestamp\": \"%s\",\n", timestamp);
+	fprintf(file, "  \"host\": \"%s\",\n", hostname);
+	fprintf(file, "  \"cpus\": %u,\n", std::thread::hardware_concurrency());
+	fprintf(file, "  \"compiler\": \"%s\",\n", __VERSION__);
+	fprintf(file, "  \"build_type\": \"%s\",\n", buildType);
+	fprintf(file, "  \"benchmarks\": [\n");
+	for (size_t i=0; i<results.size(); i++) {
+		const BenchmarkResult_t& result = results[i];
+
+		fprintf(file, "    { \"name\": \"%s\", \"iterations\": %llu, \"items_per_iteration\": %llu, \"ns_per_item_median\": %.2f, \"ns_per_item_min\": %.2f, \"items_per_second\": %.0f }%s\n",
+				result.name.c_str(),
+				(unsigned long long)result.iterations,
+				(unsigned long long)result.itemsPerIteration,
+				result.medianNSecsPerItem,
+				result.minNSecsPerItem,
+				1e9 / result.medianNSecsPerItem,
+				i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "  ]\n");
+	fprintf(file, "}\n");
+	fclose(file);
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	std::string jsonPath	= "microbenchmarks.json";
+	std::string filter;
+	double		minSecs		= 0.2;
+	int			samples		= 5;
+
+	for (int i = 1; i < argc; i++) {
+		std::string strArg		= argv[i];
+		std::string jsonPrefix	= "--json:";
+		std::string filterPrefix	= "--filter:";
+		std::string minSecsPrefix	= "--min-secs:";
+		std::string samplesPrefix	= "--samples:";
+
+		if (strArg.starts_with(jsonPrefix)) {
+			jsonPath = strArg.substr(jsonPrefix.length());
+		} else if (strArg.starts_with(filterPrefix)) {
+			filter = strArg.substr(filterPrefix.length());
+		} else if (strArg.starts_with(minSecsPrefix)) {
+			minSecs = atof(strArg.substr(minSecsPrefix.length()).c_str());
+		} else if (strArg.starts_with(samplesPrefix)) {
+			samples = std::max(1, atoi(strArg.substr(samplesPrefix.length()).c_str()));
+		} else {
+			fprintf(stderr, "usage: %s [--json:<file>] [--filter:<name substring>] [--min-secs:<secs>] [--samples:<count>]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	// Simulated clock so the telemetry cache can be filled without waiting for real time to pass
+	auto clock = new SimulatedClock(1);
+	Clock::setInstance(clock);
+
+	// Controller logging and channelizerTuner output go to the console, which would swamp the results
+	NullStreamBuf	nullStreamBuf;
+	std::streambuf*	coutStreamBuf = std::cout.rdbuf(&nullStreamBuf);
+	LogWriter::instance()->setConsoleEnabled(false);
+
+	// The log benchmarks measure the full cost of a record, not the rate limiter
+	setLogRateLimit(0);
+
+	BenchmarkRunner runner(filter, minSecs, samples);
+	runBenchmarks(runner, clock);
+
+	LogWriter::instance()->flush();
+	LogWriter::instance()->setConsoleEnabled(true);
+	std::cout.rdbuf(coutStreamBuf);
+
+	printf("%-48s %12s %12s %14s\n", "benchmark", "median ns", "min ns", "items/sec");
+	for (const BenchmarkResult_t& result: runner.results()) {
+		printf("%-48s %12.1f %12.1f %14.0f\n", result.name.c_str(), result.medianNSecsPerItem, result.minNSecsPerItem, 1e9 / result.medianNSecsPerItem);
+	}
+
+	if (!writeJson(jsonPath, runner.results())) {
+		return 1;
+	}
+	printf("Results written to %s\n", jsonPath.c_str());
+
+	return 0;
+}
@@ -0,0 +1,255 @@
+// Checks that the pulse hot path (transport receive -> enrich -> encode -> enqueue -> send on the connection) makes no
+// heap allocations once it has warmed up. The global operator new is replaced with one that counts allocations (see
+// AllocationCounter.h). Pulses are sent through a full UDPPulseReceiver pipeline while this program plays the
+// autopilot and the GCS, and it exits with 1 if anything on the hot path allocated.
+//
+// Usage: PulseAllocationCheck [--pulses:<count>] [--log-format:text|binary]
+
+#include "AllocationCounter.h"
+#include "DetectorHealth.h"
+#include "MavlinkSystem.h"
+#include "TelemetryCache.h"
+#include "UDPPulseReceiver.h"
+#include "log.h"
+#include "timeHelpers.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <thread>
+
+// GCC can't tell these free() calls go with the malloc() in the replaced operator new
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void* operator new(size_t size)
+{
+	AllocationCounter::recordAllocation(size);
+
+	void* p = malloc(size ? size : 1);
+	if (!p) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept				{ free(p); }
+void operator delete[](void* p) noexcept			{ free(p); }
+void operator delete(void* p, size_t) noexcept		{ free(p); }
+void operator delete[](void* p, size_t) noexcept	{ free(p); }
+
+static constexpr uint16_t	mavlinkPort		= 14600;
+static constexpr uint16_t	pulsePort		= 50100;
+static constexpr uint32_t	warmupPulses	= 2000;
+static constexpr uint32_t	pulsesPerSecond	= 2000;
+
+static std::atomic_uint64_t	tunnelMessagesReceived { 0 };
+
+static void sendMessage(int fdSocket, const struct sockaddr_in& addr, const mavlink_message_t& message)
+{
+	uint8_t		buffer[MAVLINK_MAX_PACKET_LEN];
+	uint16_t	bufferLen = mavlink_msg_to_send_buffer(buffer, &message);
+
+	sendto(fdSocket, buffer, bufferLen, 0, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+}
+
+// Autopilot and GCS heartbeats plus a position and attitude so pulses are tagged with telemetry
+static void sendVehicleMessages(int fdSocket, const struct sockaddr_in& addr)
+{
+	mavlink_message_t message;
+
+	mavlink_heartbeat_t autopilotHeartbeat {};
+	autopilotHeartbeat.type = MAV_TYPE_QUADROTOR;
+	mavlink_msg_heartbeat_encode(1, MAV_COMP_ID_AUTOPILOT1, &message, &autopilotHeartbeat);
+	sendMessage(fdSocket, addr, message);
+
+	mavlink_heartbeat_t gcsHeartbeat {};
+	gcsHeartbeat.type = MAV_TYPE_GCS;
+	mavlink_msg_heartbeat_encode(255, MAV_COMP_ID_MISSIONPLANNER, &message, &gcsHeartbeat);
+	sendMessage(fdSocket, addr, message);
+
+	mavlink_global_position_int_t position {};
+	position.lat			= 473977420;
+	position.lon			= 85455940;
+	position.relative_alt	= 50000;
+	mavlink_msg_global_position_int_encode(1, MAV_COMP_ID_AUTOPILOT1, &message, &position);
+	sendMessage(fdSocket, addr, message);
+
+	mavlink_attitude_t attitude {};
+	attitude.yaw = 1.0;
+	mavlink_msg_attitude_encode(1, MAV_COMP_ID_AUTOPILOT1, &message, &attitude);
+	sendMessage(fdSocket, addr, message);
+}
+
+// Counts the tunnel messages the controller sends back, which is how the pulses reach the GCS
+static void receiveThread(int fdSocket)
+{
+	uint8_t buffer[2048];
+
+	while (true) {
+		ssize_t cBytes = recv(fdSocket, buffer, sizeof(buffer), 0);
+		if (cBytes <= 0) {
+			return;
+		}
+
+		// Channel 0 is used by the controller's own connection
+		for (ssize_t i=0; i<cBytes; i++) {
+			mavlink_message_t	message;
+			mavlink_status_t	status;
+
+			if (mavlink_parse_char(MAVLINK_COMM_1, buffer[i], &message, &status) && message.msgid == MAVLINK_MSG_ID_TUNNEL) {
+				tunnelMessagesReceived++;
+			}
+		}
+	}
+}
+
+static void sendPulses(int fdSocket, const struct sockaddr_in& addr, uint32_t pulseCount, uint32_t& sequence)
+{
+	uint64_t startNSecs = nsecsMonotonic();
+
+	for (uint32_t i=0; i<pulseCount; i++) {
+		UDPPulseReceiver::UDPPulseInfo_T pulse {};
+
+		pulse.tag_id				= 2 + (sequence % 10) * 2;
+		pulse.frequency_hz			= 146000000 + pulse.tag_id * 1000;
+		pulse.start_time_seconds	= secondsSinceEpoch();
+		pulse.snr					= 20;
+		pulse.stft_score			= 1;
+		pulse.group_seq_counter		= sequence;
+		pulse.detection_status		= 1;
+		pulse.confirmed_status		= sequence % 2;
+		pulse.noise_psd				= 1e-5;
+		sequence++;
+
+		sendto(fdSocket, &pulse, sizeof(pulse), 0, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+
+		// Paced so the pipeline rings never fill up
+		uint64_t dueNSecs = startNSecs + uint64_t(i + 1) * 1000000000ull / pulsesPerSecond;
+		while (nsecsMonotonic() < dueNSecs) {
+			std::this_thread::yield();
+		}
+	}
+}
+
+static bool waitForTunnelMessages(uint64_t count, uint32_t timeoutMSecs)
+{
+	for (uint32_t waitedMSecs=0; waitedMSecs<timeoutMSecs; waitedMSecs+=10) {
+		if (tunnelMessagesReceived >= count) {
+			return true;
+		}
+		sleepForMSecs(10);
+	}
+
+	return false;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t pulseCount = 20000;
+
+	for (int i = 1; i < argc; i++) {
+		std::string strArg			= argv[i];
+		std::string pulsesPrefix	= "--pulses:";
+		std::string logFormatPrefix	= "--log-format:";
+
+		if (strArg.starts_with(pulsesPrefix)) {
+			pulseCount = std::max(1, atoi(strArg.substr(pulsesPrefix.length()).c_str()));
+		} else if (strArg == logFormatPrefix + "text") {
+			setBinaryLogging(false);
+		} else if (strArg == logFormatPrefix + "binary") {
+			setBinaryLogging(true);
+		} else {
+			fprintf(stderr, "usage: %s [--pulses:<count>] [--log-format:text|binary]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	// Every pulse is logged, the rate limiter would otherwise skip most of the log calls being checked
+	LogWriter::instance()->setConsoleEnabled(false);
+	setLogRateLimit(0);
+
+	auto mavlink = new MavlinkSystem("udp://127.0.0.1:" + std::to_string(mavlinkPort));
+	if (!mavlink->start()) {
+		fprintf(stderr, "Unable to start the mavlink connection on port %u\n", mavlinkPort);
+		return 1;
+	}
+	mavlink->outgoingMessageQueue().setPacing(false);
+
+	auto telemetryCache		= new TelemetryCache(mavlink);
+	auto detectorHealth		= new DetectorHealth(mavlink);
+	auto udpPulseReceiver	= new UDPPulseReceiver("udp://127.0.0.1:" + std::to_string(pulsePort), mavlink, telemetryCache, detectorHealth);
+
+	udpPulseReceiver->start();
+
+	int					fdVehicle	= socket(AF_INET, SOCK_DGRAM, 0);
+	int					fdPulses	= socket(AF_INET, SOCK_DGRAM, 0);
+	struct sockaddr_in	mavlinkAddr	{};
+	struct sockaddr_in	pulseAddr	{};
+
+	mavlinkAddr.sin_family		= AF_INET;
+	mavlinkAddr.sin_addr.s_addr	= inet_addr("127.0.0.1");
+	mavlinkAddr.sin_port		= htons(mavlinkPort);
+	pulseAddr					= mavlinkAddr;
+	pulseAddr.sin_port			= htons(pulsePort);
+
+	std::thread(receiveThread, fdVehicle).detach();
+
+	for (int i=0; i<10 && !mavlink->gcsSystemId().has_value(); i++) {
+		sendVehicleMessages(fdVehicle, mavlinkAddr);
+		sleepForMSecs(100);
+	}
+	if (!mavlink->gcsSystemId().has_value()) {
+		fprintf(stderr, "The controller connection didn't see the vehicle heartbeats\n");
+		return 1;
+	}
+
+	// Lazily created state (log call sites, trace buffers, latency histograms per tag) is set up during the warm up
+	uint32_t sequence = 0;
+
+	sendPulses(fdPulses, pulseAddr, warmupPulses, sequence);
+	if (!waitForTunnelMessages(warmupPulses, 5000)) {
+		fprintf(stderr, "Only %llu of %u warm up pulses reached the GCS\n", (unsigned long long)tunnelMessagesReceived.load(), warmupPulses);
+		return 1;
+	}
+
+	LogWriter::instance()->flush();
+	AllocationCounter::reset();
+	tunnelMessagesReceived = 0;
+
+	sendPulses(fdPulses, pulseAddr, pulseCount, sequence);
+	bool delivered = waitForTunnelMessages(pulseCount, 5000);
+
+	uint64_t hotPathAllocations	= AllocationCounter::hotPathAllocations();
+	uint64_t allocations		= AllocationCounter::allocations();
+
+	printf("Pulses sent:                %u\n", pulseCount);
+	printf("Pulses delivered to GCS:    %llu\n", (unsigned long long)tunnelMessagesReceived.load());
+	printf("Log format:                 %s\n", binaryLogging() ? "binary" : "text");
+	printf("Allocations, all threads:   %llu\n", (unsigned long long)allocations);
+	printf("Allocations, hot path:      %llu\n", (unsigned long long)hotPathAllocations);
+
+	if (!delivered) {
+		fprintf(stderr, "FAIL: not all pulses were delivered\n");
+		return 1;
+	}
+	if (hotPathAllocations) {
+		fprintf(stderr, "FAIL: the pulse hot path allocated, last allocation %zu bytes\n", AllocationCounter::lastHotPathAllocationSize());
+		return 1;
+	}
+	printf("PASS\n");
+
+	return 0;
+}
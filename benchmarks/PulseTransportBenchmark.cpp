@@ -0,0 +1,138 @@
+// Compares pulse delivery latency and CPU cost of the PulseTransport implementations.
+// A producer thread sends one pulse at a time and waits for the consumer to receive it before sending the next.
+//
+// Usage: PulseTransportBenchmark [pulseCount]
+
+#include "PulseTransport.h"
+#include "PulseShm.h"
+#include "timeHelpers.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+static uint64_t cpuNSecs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+static void runBenchmark(const std::string& url, int pulseCount)
+{
+    auto transport = PulseTransport::create(url);
+    if (!transport || !transport->open()) {
+        printf("%-40s failed to open\n", url.c_str());
+        return;
+    }
+
+    std::atomic<uint32_t>   receivedCount   { 0 };
+    std::vector<uint64_t>   latenciesNSecs;
+
+    latenciesNSecs.reserve(pulseCount);
+
+    std::thread consumer([&]() {
+        UDPPulseReceiver::UDPPulseInfo_T buffer[16];
+        uint64_t receivedRealtimeNSecs;
+        int count;
+
+        while ((count = transport->receivePulses(buffer, 16, receivedRealtimeNSecs)) >= 0) {
+            uint64_t nowNSecs = nsecsMonotonic();
+            for (int i=0; i<count; i++) {
+                latenciesNSecs.push_back(nowNSecs - uint64_t(buffer[i].stft_score));
+            }
+            receivedCount += count;
+            receivedCount.notify_one();
+        }
+    });
+
+    // Producer side, which is what a detector would do
+    int                 fdSocket    = -1;
+    struct sockaddr_in  inAddr      {};
+    struct sockaddr_un  unAddr      {};
+    PulseShmSegment_t*  segment     = nullptr;
+    int                 eventFd     = -1;
+
+    if (url.starts_with("udp://")) {
+        std::string conn = url.substr(6);
+        fdSocket                = socket(AF_INET, SOCK_DGRAM, 0);
+        inAddr.sin_family       = AF_INET;
+        inAddr.sin_addr.s_addr  = inet_addr(conn.substr(0, conn.find(':')).c_str());
+        inAddr.sin_port         = htons(std::stoi(conn.substr(conn.find(':') + 1)));
+    } else if (url.starts_with("unix://")) {
+        fdSocket            = socket(AF_UNIX, SOCK_DGRAM, 0);
+        unAddr.sun_family   = AF_UNIX;
+        strncpy(unAddr.sun_path, url.substr(7).c_str(), sizeof(unAddr.sun_path) - 1);
+    } else {
+        segment = pulseShmAttach(std::string("/").append(url, 6).c_str());
+        eventFd = atoi(getenv(PULSE_SHM_EVENTFD_ENV));
+    }
+
+    uint64_t startCpuNSecs  = cpuNSecs();
+    uint64_t startNSecs     = nsecsMonotonic();
+
+    for (int i=0; i<pulseCount; i++) {
+        UDPPulseReceiver::UDPPulseInfo_T pulse {};
+
+        pulse.tag_id        = 2;
+        pulse.frequency_hz  = 146000000;
+        pulse.stft_score    = double(nsecsMonotonic());
+
+        if (segment) {
+            pulseShmPush(segment, reinterpret_cast<PulseShmRecord_t*>(&pulse), eventFd);
+        } else if (url.starts_with("udp://")) {
+            sendto(fdSocket, &pulse, sizeof(pulse), 0, reinterpret_cast<sockaddr*>(&inAddr), sizeof(inAddr));
+        } else {
+            sendto(fdSocket, &pulse, sizeof(pulse), 0, reinterpret_cast<sockaddr*>(&unAddr), sizeof(unAddr));
+        }
+
+        uint32_t count;
+        while ((count = receivedCount.load()) < uint32_t(i + 1)) {
+            receivedCount.wait(count);
+        }
+    }
+
+    uint64_t elapsedNSecs   = nsecsMonotonic() - startNSecs;
+    uint64_t cpuUsedNSecs   = cpuNSecs() - startCpuNSecs;
+
+    transport->close();
+    consumer.join();
+    if (fdSocket >= 0) {
+        close(fdSocket);
+    }
+
+    std::sort(latenciesNSecs.begin(), latenciesNSecs.end());
+    auto percentileUSecs = [&](double percentile) {
+        return latenciesNSecs[std::min(latenciesNSecs.size() - 1, size_t(percentile * latenciesNSecs.size()))] / 1000.0;
+    };
+
+    printf("%-40s p50: %7.1f us p99: %7.1f us max: %8.1f us cpu: %6.2f us/pulse rate: %8.0f pulses/sec\n",
+            url.c_str(),
+            percentileUSecs(0.50),
+            percentileUSecs(0.99),
+            latenciesNSecs.back() / 1000.0,
+            cpuUsedNSecs / 1000.0 / pulseCount,
+            pulseCount / (elapsedNSecs / 1e9));
+}
+
+int main(int argc, char** argv)
+{
+    int pulseCount = argc > 1 ? atoi(argv[1]) : 20000;
+
+    runBenchmark("udp://127.0.0.1:50100",               pulseCount);
+    runBenchmark("unix:///tmp/uavrt_pulse_bench.sock",  pulseCount);
+    runBenchmark("shm://uavrt_pulse_bench",             pulseCount);
+
+    return 0;
+}
@@ -74,13 +74,15 @@ bool channelizerTuner(
     for (auto testCenterHz : testCentersHz) {
         std::for_each(channelUsageCountsForTestCenter.begin(), channelUsageCountsForTestCenter.end(), [](uint32_t& n) { n = 0; });
 
-        std::cout << "Channels edges: ";
-        int nextChannelStartFreqHz = testCenterHz - halfBwHz;
-        for (uint32_t i=0; i<nChannels; i++) {
-            std::cout << nextChannelStartFreqHz << " ";
-            nextChannelStartFreqHz += channelBwHz;
+        if (logLevelEnabled(LogLevel::Debug)) {
+            std::vector<int> channelEdgesHz;
+            int nextChannelStartFreqHz = testCenterHz - halfBwHz;
+            for (uint32_t i=0; i<nChannels; i++) {
+                channelEdgesHz.push_back(nextChannelStartFreqHz);
+                nextChannelStartFreqHz += channelBwHz;
+            }
+            logDebug() << "Channels edges:" << channelEdgesHz;
         }
-        std::cout << std::endl;
 
         std::vector<uint32_t> distanceFromCenters;
         std::vector<uint32_t> channelBins;
@@ -1,14 +1,19 @@
 #pragma once
 
+#include <cstdio>
+#include <stdexcept>
 #include <string>
-#include <memory>
 
+// Formats into a stack buffer first so the common case costs the single allocation for the returned string, or none
+// if it fits in the small string buffer
 template<typename ... Args>
-std::string formatString( const std::string& format, Args ... args )
+std::string formatString( const char* format, Args ... args )
 {
-    size_t size = snprintf( nullptr, 0, format.c_str(), args ... ) + 1; // Extra space for '\0'
-    if( size <= 0 ){ throw std::runtime_error( "Error during formatting." ); }
-    std::unique_ptr<char[]> buf( new char[ size ] ); 
-    snprintf( buf.get(), size, format.c_str(), args ... );
-    return std::string( buf.get(), buf.get() + size - 1 ); // We don't want the '\0' inside
+    char buffer[256];
+    int length = snprintf( buffer, sizeof(buffer), format, args ... );
+    if( length < 0 ){ throw std::runtime_error( "Error during formatting." ); }
+    if( (size_t)length < sizeof(buffer) ){ return std::string( buffer, length ); }
+    std::string string( length, '\0' );
+    snprintf( string.data(), length + 1, format, args ... ); // Writes the '\0' into the string's own terminator
+    return string;
 }
@@ -1,106 +1,121 @@
 #include "log.h"
 #include "LogFileManager.h"
 
-#include <fstream>
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <ctime>
 
-#define ANSI_COLOR_RED "\x1b[31m"
-#define ANSI_COLOR_GREEN "\x1b[32m"
-#define ANSI_COLOR_YELLOW "\x1b[33m"
-#define ANSI_COLOR_BLUE "\x1b[34m"
-#define ANSI_COLOR_GRAY "\x1b[37m"
-#define ANSI_COLOR_RESET "\x1b[0m"
-
-std::mutex LogDetailed::_logMutex;
-
-LogDetailed::LogDetailed(const char* filename, int filenumber) 
-    : _s                ()
+LogDetailed::LogDetailed(const char* filename, int filenumber, uint32_t siteId)
+    : _binary           (_logBinary.load(std::memory_order_relaxed))
     , _caller_filename  (filename)
     , _caller_filenumber(filenumber)
+    , _siteId           (siteId)
 {
 
 }
 
 LogDetailed::~LogDetailed()
 {
-    _logMutex.lock();
-
-    std::stringstream sStream;
-
-    switch (_log_level) {
-        case LogLevel::Debug:
-            set_color(LogColor::Green, sStream);
-            break;
-        case LogLevel::Info:
-            set_color(LogColor::Blue, sStream);
-            break;
-        case LogLevel::Warn:
-            set_color(LogColor::Yellow, sStream);
-            break;
-        case LogLevel::Err:
-            set_color(LogColor::Red, sStream);
-            break;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    uint64_t timeUSecs = static_cast<uint64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+    bool     toFile    = LogFileManager::instance()->detectorsRunning();
+    uint32_t session   = LogFileManager::instance()->session();
+
+    if (!_binary) {
+        // Only the message is built here, the writer thread adds the time and level and does all the I/O
+        _text.push_back('(');
+        _text.append(_caller_filename, strlen(_caller_filename));
+        _text.push_back(':');
+        _formatInt(_text, _caller_filenumber);
+        _text.push_back(')');
     }
 
+    LogWriter::instance()->write({ _log_level, timeUSecs, toFile, session, _binary, _siteId, std::move(_text) });
+}
 
-    // Time output taken from:
-    // https://stackoverflow.com/questions/16357999#answer-16358264
-    time_t rawtime;
-    time(&rawtime);
-    struct tm* timeinfo = localtime(&rawtime);
-    char time_buffer[10]{}; // We need 8 characters + \0
-    strftime(time_buffer, sizeof(time_buffer), "%I:%M:%S", timeinfo);
-    sStream << "[" << time_buffer;
-
-    switch (_log_level) {
-        case LogLevel::Debug:
-            sStream << "|D] ";
-            break;
-        case LogLevel::Info:
-            sStream << "|I] ";
-            break;
-        case LogLevel::Warn:
-            sStream << "|W] ";
-            break;
-        case LogLevel::Err:
-            sStream << "|E] ";
-            break;
-    }
+void LogDetailed::_formatInt(LogWriter::RecordText_t& text, int64_t value)
+{
+    char buffer[24];
 
-    set_color(LogColor::Reset, sStream);
+    text.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value).ptr - buffer);
+}
 
-    sStream << " " << _s.str() << " (" << _caller_filename << ":" << std::dec << _caller_filenumber << ")";
+void LogDetailed::_formatUInt(LogWriter::RecordText_t& text, uint64_t value)
+{
+    char buffer[24];
 
-    std::cout << sStream.str() << std::endl;
+    text.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value).ptr - buffer);
+}
 
-    auto logFileManager = LogFileManager::instance();
-    if (logFileManager->detectorsRunning()) {
-        std::ofstream logFile(logFileManager->filename("MavLinkController", "txt"), std::ios_base::app);
-        logFile << sStream.str() << std::endl;
-    }
+// %g is what an ostream prints for a double with the default flags and precision
+void LogDetailed::_formatDouble(LogWriter::RecordText_t& text, double value)
+{
+    char buffer[32];
+    int  length = snprintf(buffer, sizeof(buffer), "%g", value);
+
+    text.append(buffer, std::min<size_t>(length, sizeof(buffer) - 1));
+}
+
+void LogDetailed::_appendVarint(uint8_t type, uint64_t value)
+{
+    uint8_t buffer[11];
 
-    _logMutex.unlock();
+    buffer[0] = type;
+    _text.append(reinterpret_cast<const char*>(buffer), 1 + logVarintWrite(buffer + 1, value));
 }
 
-void set_color(LogColor LogColor, std::stringstream& s)
+void LogDetailed::_appendString(const char* string, size_t length)
 {
-    switch (LogColor) {
-        case LogColor::Red:
-            s << ANSI_COLOR_RED;
-            break;
-        case LogColor::Green:
-            s << ANSI_COLOR_GREEN;
-            break;
-        case LogColor::Yellow:
-            s << ANSI_COLOR_YELLOW;
-            break;
-        case LogColor::Blue:
-            s << ANSI_COLOR_BLUE;
-            break;
-        case LogColor::Gray:
-            s << ANSI_COLOR_GRAY;
-            break;
-        case LogColor::Reset:
-            s << ANSI_COLOR_RESET;
-            break;
+    uint8_t buffer[10];
+
+    _text.append(reinterpret_cast<const char*>(buffer), logVarintWrite(buffer, length));
+    _text.append(string, length);
+}
+
+std::atomic<int>    _logRuntimeLevel    { static_cast<int>(LogLevel::Debug) };
+std::atomic_bool    _logBinary          { false };
+
+void setLogLevel(LogLevel level)
+{
+    _logRuntimeLevel = static_cast<int>(level);
+}
+
+LogLevel logLevel()
+{
+    return static_cast<LogLevel>(std::max<int>(_logRuntimeLevel, LOG_MIN_LEVEL));
+}
+
+void setBinaryLogging(bool enabled)
+{
+    _logBinary = enabled;
+}
+
+bool binaryLogging()
+{
+    return _logBinary;
+}
+
+void setLogRateLimit(uint32_t recordsPerSecond)
+{
+    LogWriter::instance()->setRateLimit(recordsPerSecond);
+}
+
+bool parseLogLevel(const std::string& name, LogLevel& level)
+{
+    if (name == "debug") {
+        level = LogLevel::Debug;
+    } else if (name == "info") {
+        level = LogLevel::Info;
+    } else if (name == "warn") {
+        level = LogLevel::Warn;
+    } else if (name == "error") {
+        level = LogLevel::Err;
+    } else {
+        return false;
     }
+
+    return true;
 }
@@ -6,6 +6,14 @@
 #include <ctime>
 #include <mutex>
 #include <functional>
+#include <atomic>
+#include <string>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+
+#include "LogWriter.h"
+#include "LogFormat.h"
 
 // Remove path and extract only filename.
 #define FILENAME \
@@ -13,19 +21,53 @@
 
 #define call_user_callback(...) call_user_callback_located(FILENAME, __LINE__, __VA_ARGS__)
 
-#define logDebug()  LogDebugDetailed(FILENAME, __LINE__)
-#define logInfo()   LogInfoDetailed (FILENAME, __LINE__)
-#define logWarn()   LogWarnDetailed (FILENAME, __LINE__)
-#define logError()  LogErrDetailed  (FILENAME, __LINE__)
-
-enum class LogColor { Red, Green, Yellow, Blue, Gray, Reset };
-enum class LogLevel : int { Debug = 0, Info = 1, Warn = 2, Err = 3 };
-
-void set_color(LogColor LogColor, std::stringstream& s);
+// Levels below LOG_MIN_LEVEL are compiled out. Release builds drop debug logging unless told otherwise with
+// -DLOG_MIN_LEVEL=<0-3>.
+#ifndef LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define LOG_MIN_LEVEL 1
+#else
+#define LOG_MIN_LEVEL 0
+#endif
+#endif
+
+// Runtime minimum level on top of LOG_MIN_LEVEL, set from --log-level:
+void        setLogLevel     (LogLevel level);
+LogLevel    logLevel        ();
+bool        parseLogLevel   (const std::string& name, LogLevel& level);
+
+// Binary logging (--log-format:binary) stores raw argument values instead of formatted text, see LogFormat.h
+void        setBinaryLogging(bool enabled);
+bool        binaryLogging   ();
+
+// Records a second per log call site, see LogWriter. 0 for no limit.
+void        setLogRateLimit (uint32_t recordsPerSecond);
+
+extern std::atomic<int>     _logRuntimeLevel;
+extern std::atomic_bool     _logBinary;
+
+static inline bool logLevelEnabled(LogLevel level)
+{
+    return static_cast<int>(level) >= LOG_MIN_LEVEL && static_cast<int>(level) >= _logRuntimeLevel.load(std::memory_order_relaxed);
+}
+
+// Each call site registers itself with the writer the first time it logs, binary records refer to it by id
+#define LOG_SITE(level) \
+    ([]() { static const uint32_t siteId = LogWriter::instance()->registerSite(FILENAME, __LINE__, level); return siteId; }())
+
+// The stream arguments are only evaluated if the level is enabled and the call site is within its rate limit. The
+// empty if branch keeps a following else binding to the caller's if.
+#define LOG_CALL(level, detailedClass) \
+    if (uint32_t _logSiteId = 0; !logLevelEnabled(level) || LogWriter::instance()->suppress(_logSiteId = LOG_SITE(level))) {} else detailedClass(FILENAME, __LINE__, _logSiteId)
+
+#define logDebug()  LOG_CALL(LogLevel::Debug,   LogDebugDetailed)
+#define logInfo()   LOG_CALL(LogLevel::Info,    LogInfoDetailed)
+#define logWarn()   LOG_CALL(LogLevel::Warn,    LogWarnDetailed)
+#define logError()  LOG_CALL(LogLevel::Err,     LogErrDetailed)
 
 class LogDetailed {
 public:
-    LogDetailed(const char* filename, int filenumber);
+    LogDetailed(const char* filename, int filenumber, uint32_t siteId);
     LogDetailed(const LogDetailed&) = delete;
 
     virtual ~LogDetailed();
@@ -34,21 +76,46 @@ public:
 
     LogDetailed& operator<<(uint8_t& x)
     {
-        _s << (unsigned int)x << " ";
+        if (_binary) {
+            _appendUInt(x);
+        } else {
+            _formatValue(_text, (unsigned int)x);
+            _text.push_back(' ');
+        }
         return *this;
     }
 
     template<typename T> LogDetailed& operator<<(const T& x)
     {
-        _s << x << " ";
+        if (_binary) {
+            _appendArg(x);
+        } else {
+            _formatValue(_text, x);
+            _text.push_back(' ');
+        }
         return *this;
     }
 
     template<typename T> LogDetailed& operator<<(const std::vector<T>& vector)
     {
-        for (auto value : vector) {
-            _s << value << ", ";
-        }   
+        if (_binary) {
+            // Formatted here as a single string argument. The separator after the last value is the space the
+            // decoder adds after every argument.
+            LogWriter::RecordText_t string;
+            for (auto value : vector) {
+                _formatValue(string, value);
+                string.append(", ", 2);
+            }
+            if (!string.empty()) {
+                _text.push_back(LOG_ARG_STRING);
+                _appendString(string.data(), string.size() - 1);
+            }
+        } else {
+            for (auto value : vector) {
+                _formatValue(_text, value);
+                _text.append(", ", 2);
+            }
+        }
         return *this;
     }
 
@@ -56,17 +123,89 @@ protected:
     LogLevel _log_level = LogLevel::Debug;
 
 private:
-    std::stringstream   _s;
-    const char*         _caller_filename;
-    int                 _caller_filenumber;
+    // Formats the same text as an ostream would, without going through one for the common types
+    template<typename T> static void _formatValue(LogWriter::RecordText_t& text, const T& x)
+    {
+        if constexpr (std::is_same_v<T, bool>) {
+            text.push_back(x ? '1' : '0');
+        } else if constexpr (std::is_same_v<T, char> || std::is_same_v<T, signed char> || std::is_same_v<T, unsigned char>) {
+            text.push_back(static_cast<char>(x));
+        } else if constexpr (std::is_integral_v<T> || std::is_enum_v<T>) {
+            if constexpr (std::is_signed_v<T> || std::is_enum_v<T>) {
+                _formatInt(text, static_cast<int64_t>(x));
+            } else {
+                _formatUInt(text, x);
+            }
+        } else if constexpr (std::is_floating_point_v<T>) {
+            _formatDouble(text, x);
+        } else if constexpr (std::is_convertible_v<const T&, const char*>) {
+            const char* string = x;
+            if (string) {
+                text.append(string, strlen(string));
+            }
+        } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+            text.append(std::string_view(x));
+        } else {
+            std::ostringstream s;
+            s << x;
+            text.append(s.view());
+        }
+    }
+
+    static void _formatInt      (LogWriter::RecordText_t& text, int64_t value);
+    static void _formatUInt     (LogWriter::RecordText_t& text, uint64_t value);
+    static void _formatDouble   (LogWriter::RecordText_t& text, double value);
+
+    // Binary arguments match what the text stream would print for the same type
+    template<typename T> void _appendArg(const T& x)
+    {
+        if constexpr (std::is_same_v<T, bool>) {
+            _appendUInt(x);
+        } else if constexpr (std::is_same_v<T, char> || std::is_same_v<T, signed char> || std::is_same_v<T, unsigned char>) {
+            char c = static_cast<char>(x);
+            _text.push_back(LOG_ARG_STRING);
+            _appendString(&c, 1);
+        } else if constexpr (std::is_integral_v<T> || std::is_enum_v<T>) {
+            if constexpr (std::is_signed_v<T> || std::is_enum_v<T>) {
+                _appendVarint(LOG_ARG_INT, logZigzagEncode(static_cast<int64_t>(x)));
+            } else {
+                _appendUInt(x);
+            }
+        } else if constexpr (std::is_floating_point_v<T>) {
+            double value = x;
+            _text.push_back(LOG_ARG_DOUBLE);
+            _text.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        } else if constexpr (std::is_convertible_v<const T&, const char*>) {
+            const char* string = x;
+            _text.push_back(LOG_ARG_STRING);
+            _appendString(string, string ? strlen(string) : 0);
+        } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+            std::string_view string = x;
+            _text.push_back(LOG_ARG_STRING);
+            _appendString(string.data(), string.length());
+        } else {
+            LogWriter::RecordText_t string;
+            _formatValue(string, x);
+            _text.push_back(LOG_ARG_STRING);
+            _appendString(string.data(), string.size());
+        }
+    }
+
+    void _appendUInt    (uint64_t value) { _appendVarint(LOG_ARG_UINT, value); }
+    void _appendVarint  (uint8_t type, uint64_t value);
+    void _appendString  (const char* string, size_t length);
 
-    static std::mutex   _logMutex;
+    bool                                _binary;
+    LogWriter::RecordText_t             _text;      // Message, or LOG_ARG_* encoded arguments for binary logging
+    const char*                         _caller_filename;
+    int                                 _caller_filenumber;
+    uint32_t                            _siteId;
 };
 
 class LogDebugDetailed : public LogDetailed {
 public:
-    LogDebugDetailed(const char* filename, int filenumber) 
-        : LogDetailed(filename, filenumber)
+    LogDebugDetailed(const char* filename, int filenumber, uint32_t siteId)
+        : LogDetailed(filename, filenumber, siteId)
     {
         _log_level = LogLevel::Debug;
     }
@@ -74,8 +213,8 @@ public:
 
 class LogInfoDetailed : public LogDetailed {
 public:
-    LogInfoDetailed(const char* filename, int filenumber) 
-        : LogDetailed(filename, filenumber)
+    LogInfoDetailed(const char* filename, int filenumber, uint32_t siteId)
+        : LogDetailed(filename, filenumber, siteId)
     {
         _log_level = LogLevel::Info;
     }
@@ -83,8 +222,8 @@ public:
 
 class LogWarnDetailed : public LogDetailed {
 public:
-    LogWarnDetailed(const char* filename, int filenumber) 
-        : LogDetailed(filename, filenumber)
+    LogWarnDetailed(const char* filename, int filenumber, uint32_t siteId)
+        : LogDetailed(filename, filenumber, siteId)
     {
         _log_level = LogLevel::Warn;
     }
@@ -92,8 +231,8 @@ public:
 
 class LogErrDetailed : public LogDetailed {
 public:
-    LogErrDetailed(const char* filename, int filenumber) 
-        : LogDetailed(filename, filenumber)
+    LogErrDetailed(const char* filename, int filenumber, uint32_t siteId)
+        : LogDetailed(filename, filenumber, siteId)
     {
         _log_level = LogLevel::Err;
     }
@@ -1,18 +1,44 @@
 #include "log.h"
+#include "LogFileManager.h"
 #include "CommandHandler.h"
 #include "UDPPulseReceiver.h"
 #include "TunnelProtocol.h"
 #include "TelemetryCache.h"
 #include "MavlinkSystem.h"
 #include "PulseSimulator.h"
+#include "DetectorHealth.h"
+#include "ReplayCapture.h"
+#include "ReplayPlayer.h"
+#include "Clock.h"
+#include "SchedulingProfile.h"
+#include "ProcessSupervisor.h"
+#include "timeHelpers.h"
 
+#include <charconv>
 #include <chrono>
 #include <cstdint>
 #include <iostream>
 #include <future>
 #include <memory>
+#include <optional>
 #include <thread>
 
+// Parses the whole number after prefix in arg. Logs an error and returns false if there is anything else in it or it is
+// over maxValue.
+static bool parseUnsignedArg(const std::string& arg, const std::string& prefix, uint64_t maxValue, uint64_t& value)
+{
+	const char*	first	= arg.c_str() + prefix.length();
+	const char*	last	= arg.c_str() + arg.length();
+	auto		result	= std::from_chars(first, last, value);
+
+	if (first == last || result.ec != std::errc() || result.ptr != last || value > maxValue) {
+		logError() << "Invalid value:" << arg << "- expected a whole number up to" << maxValue;
+		return false;
+	}
+
+	return true;
+}
+
 int main(int argc, char** argv)
 {
 	setbuf(stdout, NULL); // Disable stdout buffering
@@ -23,11 +49,35 @@ int main(int argc, char** argv)
     bool simulatePulse 		= false;
 	uint32_t antennaOffset	= 0;
 	std::string connectionUrl = "udp://127.0.0.1:14540";    // default to SITL
-    if (argc == 2) {
-		std::string strArg = argv[1];
+	std::string pulseTransportUrl = "udp://127.0.0.1:50000";
+	std::string capturePath;
+	std::string replayPath;
+	std::string replayOutputPath;
+	bool replayFast = false;
+	bool detectorPool = false;
+	bool simulateLoad = false;
+	PulseSimulator::LoadConfig_t loadConfig;
+	std::string clockSpec;
+	std::optional<SchedulingProfile_t> schedulingProfiles[CommandHandler::SchedulingRoleCount];
+	std::optional<SchedulingProfile_t> ingestSchedulingProfile;
+	std::optional<uint32_t> resourceIntervalSecs;
+    for (int i = 1; i < argc; i++) {
+		std::string strArg = argv[i];
 		std::string simulatePulsePrefix = "--simulate-pulse:";
+		std::string pulseTransportPrefix = "--pulse-transport:";
+		std::string capturePrefix = "--capture:";
+		std::string replayPrefix = "--replay:";
+		std::string replayOutputPrefix = "--replay-output:";
+		std::string clockPrefix = "--clock:";
+		std::string simulateLoadPrefix = "--simulate-load:";
+		std::string logLevelPrefix = "--log-level:";
+		std::string logFormatPrefix = "--log-format:";
+		std::string logRateLimitPrefix = "--log-rate-limit:";
+		std::string logFileMaxPrefix = "--log-file-max-mb:";
+		std::string logBudgetPrefix = "--log-budget-mb:";
+		std::string schedulingPrefix = "--sched-";
+		std::string resourceIntervalPrefix = "--resource-interval-secs:";
         if (strArg.starts_with(simulatePulsePrefix)) {
-			std::string strArg = argv[1];
 			strArg.erase(strArg.find(simulatePulsePrefix), simulatePulsePrefix.length());
 
             simulatePulse = true;
@@ -35,18 +85,170 @@ int main(int argc, char** argv)
 
 			logInfo() << "Simulating pulses - antenna offset:" << antennaOffset;
 
+        } else if (strArg.starts_with(pulseTransportPrefix)) {
+			strArg.erase(strArg.find(pulseTransportPrefix), pulseTransportPrefix.length());
+
+			pulseTransportUrl = strArg;
+
+        } else if (strArg.starts_with(capturePrefix)) {
+			capturePath = strArg.substr(capturePrefix.length());
+
+        } else if (strArg.starts_with(replayPrefix)) {
+			replayPath = strArg.substr(replayPrefix.length());
+
+        } else if (strArg.starts_with(replayOutputPrefix)) {
+			replayOutputPath = strArg.substr(replayOutputPrefix.length());
+
+        } else if (strArg.starts_with(clockPrefix)) {
+			clockSpec = strArg.substr(clockPrefix.length());
+
+        } else if (strArg.starts_with(simulateLoadPrefix)) {
+			if (!PulseSimulator::parseLoadConfig(strArg.substr(simulateLoadPrefix.length()), loadConfig)) {
+				return 1;
+			}
+			simulateLoad = true;
+
+        } else if (strArg.starts_with(logLevelPrefix)) {
+			LogLevel level;
+			if (!parseLogLevel(strArg.substr(logLevelPrefix.length()), level)) {
+				logError() << "Invalid log level:" << strArg << "- expected debug, info, warn or error";
+				return 1;
+			}
+			setLogLevel(level);
+
+        } else if (strArg.starts_with(logFormatPrefix)) {
+			std::string format = strArg.substr(logFormatPrefix.length());
+			if (format != "text" && format != "binary") {
+				logError() << "Invalid log format:" << strArg << "- expected text or binary";
+				return 1;
+			}
+			setBinaryLogging(format == "binary");
+
+        } else if (strArg.starts_with(logRateLimitPrefix)) {
+			uint64_t recordsPerSecond;
+			if (!parseUnsignedArg(strArg, logRateLimitPrefix, UINT32_MAX, recordsPerSecond)) {
+				return 1;
+			}
+			setLogRateLimit(recordsPerSecond);
+
+        } else if (strArg.starts_with(logFileMaxPrefix)) {
+			uint64_t maxFileMBytes;
+			if (!parseUnsignedArg(strArg, logFileMaxPrefix, UINT64_MAX / (1024 * 1024), maxFileMBytes)) {
+				return 1;
+			}
+			LogFileManager::instance()->setMaxFileBytes(maxFileMBytes * 1024 * 1024);
+
+        } else if (strArg.starts_with(logBudgetPrefix)) {
+			uint64_t diskBudgetMBytes;
+			if (!parseUnsignedArg(strArg, logBudgetPrefix, UINT64_MAX / (1024 * 1024), diskBudgetMBytes)) {
+				return 1;
+			}
+			LogFileManager::instance()->setDiskBudgetBytes(diskBudgetMBytes * 1024 * 1024);
+
+        } else if (strArg.starts_with(resourceIntervalPrefix)) {
+			uint64_t intervalSecs;
+			if (!parseUnsignedArg(strArg, resourceIntervalPrefix, UINT32_MAX / 1000, intervalSecs)) {
+				return 1;
+			}
+			resourceIntervalSecs = intervalSecs;
+
+        } else if (strArg.starts_with(schedulingPrefix) && strArg.find(':') != std::string::npos) {
+			auto				colonIndex	= strArg.find(':');
+			std::string			role		= strArg.substr(schedulingPrefix.length(), colonIndex - schedulingPrefix.length());
+			SchedulingProfile_t	profile;
+
+			if (!parseSchedulingProfile(strArg.substr(colonIndex + 1), profile)) {
+				return 1;
+			}
+			if (role == "sdr") {
+				schedulingProfiles[CommandHandler::SchedulingSdr] = profile;
+			} else if (role == "channelizer") {
+				schedulingProfiles[CommandHandler::SchedulingChannelizer] = profile;
+			} else if (role == "detector") {
+				schedulingProfiles[CommandHandler::SchedulingDetector] = profile;
+			} else if (role == "receive") {
+				ingestSchedulingProfile = profile;
+			} else {
+				logError() << "Invalid scheduling role:" << strArg << "- expected sdr, channelizer, detector or receive";
+				return 1;
+			}
+
+        } else if (strArg == "--replay-fast") {
+			replayFast = true;
+
+        } else if (strArg == "--detector-pool") {
+			detectorPool = true;
+
         } else {
             connectionUrl = strArg;
         }
     }
+
+	// The clock has to be in place before any threads are started. A replay moves the clock to the capture's start
+	// time, which only the simulated clock allows.
+	if (clockSpec.empty()) {
+		clockSpec = replayPath.empty() ? "system" : "simulated";
+	}
+	Clock* clock = Clock::create(clockSpec);
+	if (!clock) {
+		logError() << "Invalid clock:" << clockSpec << "- expected system, monotonic or simulated[:<rate > 0>]";
+		return 1;
+	}
+	Clock::setInstance(clock);
+
+	if (resourceIntervalSecs) {
+		ProcessSupervisor::instance()->setResourceInterval(*resourceIntervalSecs * 1000);
+	}
+
+	if (!replayPath.empty()) {
+		// Both the MAVLink connection and the detector pulses come from the capture
+		if (replayOutputPath.empty()) {
+			replayOutputPath = replayPath + ".tunnel.txt";
+		}
+		auto replayClock = dynamic_cast<SimulatedClock*>(clock);
+		if (!replayClock) {
+			logError() << "Replay needs the simulated clock, not" << clockSpec;
+			return 1;
+		}
+		if (!ReplayPlayer::instance()->open(replayPath, replayOutputPath, replayFast, replayClock)) {
+			return 1;
+		}
+		connectionUrl		= "replay:";
+		pulseTransportUrl	= "replay:";
+	} else if (!capturePath.empty()) {
+		if (!ReplayCapture::instance()->open(capturePath)) {
+			return 1;
+		}
+	}
+
     logInfo() << "Connecting to" << connectionUrl;
 
 	auto mavlink 			= new MavlinkSystem(connectionUrl);
-    auto commandHandler 	= CommandHandler { mavlink };
-    auto telemetryCache     = new TelemetryCache(mavlink);
-    auto udpPulseReceiver   = UDPPulseReceiver { std::string("127.0.0.1"), 50000, mavlink, telemetryCache };
+    auto detectorHealth     = new DetectorHealth(mavlink);
+    auto commandHandler 	= CommandHandler { mavlink, detectorHealth };
+    auto telemetryCache     = new TelemetryCache(mavlink, TELEMETRY_SHM_NAME);
+    auto udpPulseReceiver   = UDPPulseReceiver { pulseTransportUrl, mavlink, telemetryCache, detectorHealth };
+
+    if (replayFast) {
+        mavlink->outgoingMessageQueue().setPacing(false);
+    }
+    commandHandler.setDetectorPool(detectorPool);
+    if (simulateLoad || !replayPath.empty()) {
+        // The load generator or the capture stands in for the detectors, so there is no radio hardware to start either
+        logInfo() << "Simulating detection processes";
+        commandHandler.setSimulateProcesses(true);
+    }
+    for (int role=0; role<CommandHandler::SchedulingRoleCount; role++) {
+        if (schedulingProfiles[role]) {
+            commandHandler.setSchedulingProfile(static_cast<CommandHandler::SchedulingRole>(role), *schedulingProfiles[role]);
+        }
+    }
+    if (ingestSchedulingProfile) {
+        udpPulseReceiver.setIngestSchedulingProfile(*ingestSchedulingProfile);
+    }
 
     udpPulseReceiver.start();
+    ReplayPlayer::instance()->start();
 
 	if (!mavlink->start()) {
 		logError() << "Mavlink start failed";
@@ -55,15 +257,19 @@ int main(int argc, char** argv)
 
 	logInfo() << "Waiting for autopilot heartbeat...";
 	while (!mavlink->connected()) {
-		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		sleepForMSecs(100);
 	}
 
 	PulseSimulator* pulseSimulator = nullptr;
 	if (simulatePulse) {
 		pulseSimulator = new PulseSimulator(mavlink, antennaOffset);
+	} else if (simulateLoad) {
+		loadConfig.pulseTransportUrl = pulseTransportUrl;
+		pulseSimulator = new PulseSimulator(mavlink, loadConfig, &udpPulseReceiver);
 	}
 
 	bool tunnelHeartbeatsStarted = false;
+	uint64_t replayIdleMSecs = 0;
 	while (true) {
 		if (!tunnelHeartbeatsStarted && mavlink->gcsSystemId().has_value()) {
 			tunnelHeartbeatsStarted = true;
@@ -71,8 +277,18 @@ int main(int argc, char** argv)
 		    mavlink->sendStatusText("MavlinkTagController Ready");
 		}
 
+		// A replay is done once the capture has been delivered and the outgoing queue has stayed empty for a while
+		if (ReplayPlayer::instance()->finished()) {
+			replayIdleMSecs = mavlink->outgoingMessageQueue().empty() ? replayIdleMSecs + 100 : 0;
+			if (replayIdleMSecs >= 2000) {
+				ReplayPlayer::instance()->close();
+				logInfo() << "Replay complete";
+				break;
+			}
+		}
+
 		// Do nothing -- message subscription callbacks are asynchronous and run in the connection receiver thread
-		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		sleepForMSecs(100);
 	}
 
 	delete pulseSimulator;
@@ -1,13 +1,27 @@
 #include "timeHelpers.h"
-
-#include <chrono>
+#include "Clock.h"
 
 uint64_t msecsSinceEpoch()
 {
-    return uint64_t(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count());
+    return Clock::instance()->realtimeNSecs() / 1000000;
 }
 
 double secondsSinceEpoch()
 {
     return (double)msecsSinceEpoch() / 1000.0;
 }
+
+uint64_t nsecsSinceEpoch()
+{
+    return Clock::instance()->realtimeNSecs();
+}
+
+uint64_t nsecsMonotonic()
+{
+    return Clock::instance()->monotonicNSecs();
+}
+
+void sleepForMSecs(uint64_t msecs)
+{
+    Clock::instance()->sleepForNSecs(msecs * 1000000);
+}
@@ -2,5 +2,9 @@
 
 #include <cstdint>
 
+// All times come from Clock::instance() (see Clock.h), so they follow a simulated clock when one is in use
 uint64_t    msecsSinceEpoch();
-double      secondsSinceEpoch();
\ No newline at end of file
+double      secondsSinceEpoch();
+uint64_t    nsecsSinceEpoch();
+uint64_t    nsecsMonotonic();
+void        sleepForMSecs(uint64_t msecs);
@@ -0,0 +1,569 @@
+// Stands in for the autopilot and the GCS so the controller can be exercised end to end without SITL or QGC.
+//
+// Autopilot: heartbeat, GLOBAL_POSITION_INT and ATTITUDE at the configured rates. Once detection starts the
+// vehicle does the configured number of scripted 360 degree yaw rotations.
+// GCS: heartbeat from sysid 255, uploads tags, sends START_DETECTION and waits for the controller to report
+// HEARTBEAT_STATUS_DETECTING, collects pulses for --detect-secs, sends STOP_DETECTION and then prints command ack and
+// pulse latencies. Exits with 1 if detection doesn't start. Pulse latency is measured from the pulse start time, so
+// it covers detector -> controller -> GCS. Pair it with the controller's --simulate-load, which drives pulses and
+// starts stand-ins for the SDR and detector processes, to run without radio hardware:
+//
+//	MavlinkTagController2 --simulate-load:tags=10,ip=500
+//	FakeVehicle --tags:10 --ip:500 --detect-secs:60
+//
+// Usage: FakeVehicle [--controller:<ip>:<port>] [--position-hz:<rate>] [--attitude-hz:<rate>]
+//			[--rotations:<count>] [--rotation-secs:<secs>]
+//			[--tags:<count>] [--tag-id:<first id>] [--ip:<msecs>] [--k:<k>] [--sdr:mini|hf] [--detect-secs:<secs>]
+//			[--autopilot-only]
+
+#include "MessageParser.h"
+#include "TunnelProtocol.h"
+#include "ControllerTunnelProtocol.h"
+#include "LatencyHistogram.h"
+#include "Clock.h"
+#include "timeHelpers.h"
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+using namespace TunnelProtocol;
+
+static const uint8_t autopilotSystemId		= 1;
+static const uint8_t autopilotComponentId	= MAV_COMP_ID_AUTOPILOT1;
+static const uint8_t gcsSystemId			= 255;
+static const uint8_t gcsComponentId			= MAV_COMP_ID_MISSIONPLANNER;
+
+// PX4 SITL default home
+static const double homeLatitude	= 47.397742;
+static const double homeLongitude	= 8.545594;
+static const double homeAltitude	= 488.0;
+static const double flightAltitude	= 50.0;
+
+static const uint32_t detectingTimeoutMSecs = 75000;
+
+class FakeVehicle
+{
+public:
+	FakeVehicle(const std::string& controllerIp, int controllerPort)
+	{
+		_socketFd = socket(AF_INET, SOCK_DGRAM, 0);
+
+		_controllerAddress.sin_family = AF_INET;
+		_controllerAddress.sin_port   = htons(controllerPort);
+		inet_pton(AF_INET, controllerIp.c_str(), &_controllerAddress.sin_addr);
+	}
+
+	void start(bool sendGcsHeartbeat, double positionHz, double attitudeHz)
+	{
+		_sendGcsHeartbeat = sendGcsHeartbeat;
+		std::thread(&FakeVehicle::_receiveThread, this).detach();
+		std::thread(&FakeVehicle::_autopilotThread, this, positionHz, attitudeHz).detach();
+	}
+
+	void startRotations(uint32_t rotations, double rotationSecs)
+	{
+		_rotationSecs		= rotationSecs;
+		_rotationsEndNSecs	= nsecsMonotonic() + uint64_t(rotations * rotationSecs * 1e9);
+		_rotationsStartNSecs	= nsecsMonotonic();
+	}
+
+	bool waitForController(uint32_t timeoutMSecs)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		return _condition.wait_for(lock, std::chrono::milliseconds(timeoutMSecs), [this] { return _controllerReady; });
+	}
+
+	// Waits for the controller's tunnel heartbeat to report detection running. Returns false if it reports a failed
+	// start instead or the timeout passes first.
+	bool waitForDetecting(uint32_t timeoutMSecs)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+
+		_startFailed = false;
+		_condition.wait_for(lock, std::chrono::milliseconds(timeoutMSecs), [this] {
+			return _controllerStatus == HEARTBEAT_STATUS_DETECTING || _startFailed;
+		});
+
+		return _controllerStatus == HEARTBEAT_STATUS_DETECTING;
+	}
+
+	// Sends the tunnel command and waits for its ack. Returns the ack latency in usecs. The timeout is generous since
+	// acks queue behind any pulses waiting in the controller's outgoing queue.
+	std::optional<uint64_t> sendCommand(const void* payload, size_t payloadSize, uint32_t timeoutMSecs = 30000)
+	{
+		uint32_t command = static_cast<const HeaderInfo_t*>(payload)->command;
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_ackResult.reset();
+			_ackCommand = command;
+		}
+
+		mavlink_tunnel_t	tunnel;
+		mavlink_message_t	message;
+
+		memset(&tunnel, 0, sizeof(tunnel));
+		tunnel.target_system	= autopilotSystemId;
+		tunnel.target_component	= MAV_COMP_ID_ONBOARD_COMPUTER;
+		tunnel.payload_type		= MAV_TUNNEL_PAYLOAD_TYPE_UNKNOWN;
+		tunnel.payload_length	= payloadSize;
+		memcpy(tunnel.payload, payload, payloadSize);
+		mavlink_msg_tunnel_encode(gcsSystemId, gcsComponentId, &message, &tunnel);
+
+		uint64_t sentNSecs = nsecsMonotonic();
+		_send(message);
+
+		std::unique_lock<std::mutex> lock(_mutex);
+		if (!_condition.wait_for(lock, std::chrono::milliseconds(timeoutMSecs), [this] { return _ackResult.has_value(); })) {
+			fprintf(stderr, "No ack for command %u\n", command);
+			return std::nullopt;
+		}
+		if (_ackResult.value() != COMMAND_RESULT_SUCCESS) {
+			fprintf(stderr, "Command %u failed: %s\n", command, _ackMessage.c_str());
+			return std::nullopt;
+		}
+
+		return (_ackNSecs - sentNSecs) / 1000;
+	}
+
+	// Pulses and messages are only counted between resetPulses and stopCounting, so the load generator's pulses
+	// before detection is running don't show up
+	void resetPulses(void)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_counting = true;
+		_pulseLatency.reset();
+		_pulsesByTag.clear();
+		_healthMessages = 0;
+		_restartMessages = 0;
+		_resourceMessages = 0;
+		_cgroupMessages = 0;
+	}
+
+	void stopCounting(void)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_counting = false;
+	}
+
+	void printPulses(void)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		printf("Pulses: %s\n", _pulseLatency.summary().c_str());
+		for (const auto& [tagId, count]: _pulsesByTag) {
+			printf("\ttag %u: %llu\n", tagId, (unsigned long long)count);
+		}
+		printf("Detector health messages: %u\n", _healthMessages);
+		printf("Process restart messages: %u\n", _restartMessages);
+		printf("Process resource messages: %u\n", _resourceMessages);
+		printf("Cgroup stats messages: %u\n", _cgroupMessages);
+	}
+
+private:
+	void _send(const mavlink_message_t& message)
+	{
+		uint8_t		buffer[MAVLINK_MAX_PACKET_LEN];
+		uint16_t	bufferLen = mavlink_msg_to_send_buffer(buffer, &message);
+
+		sendto(_socketFd, buffer, bufferLen, 0, reinterpret_cast<const sockaddr*>(&_controllerAddress), sizeof(_controllerAddress));
+	}
+
+	void _sendHeartbeats(void)
+	{
+		mavlink_heartbeat_t	heartbeat;
+		mavlink_message_t	message;
+
+		memset(&heartbeat, 0, sizeof(heartbeat));
+		heartbeat.type				= MAV_TYPE_QUADROTOR;
+		heartbeat.autopilot			= MAV_AUTOPILOT_PX4;
+		heartbeat.system_status		= MAV_STATE_ACTIVE;
+		heartbeat.mavlink_version	= 3;
+		mavlink_msg_heartbeat_encode(autopilotSystemId, autopilotComponentId, &message, &heartbeat);
+		_send(message);
+
+		if (_sendGcsHeartbeat) {
+			heartbeat.type		= MAV_TYPE_GCS;
+			heartbeat.autopilot	= MAV_AUTOPILOT_INVALID;
+			mavlink_msg_heartbeat_encode(gcsSystemId, gcsComponentId, &message, &heartbeat);
+			_send(message);
+		}
+	}
+
+	double _yawDegrees(void)
+	{
+		uint64_t nowNSecs = nsecsMonotonic();
+
+		if (_rotationsStartNSecs == 0 || nowNSecs >= _rotationsEndNSecs) {
+			return 0;
+		}
+
+		return fmod((nowNSecs - _rotationsStartNSecs) / 1e9 / _rotationSecs * 360.0, 360.0);
+	}
+
+	void _sendPosition(uint32_t timeBootMSecs)
+	{
+		mavlink_global_position_int_t	position;
+		mavlink_message_t				message;
+
+		memset(&position, 0, sizeof(position));
+		position.time_boot_ms	= timeBootMSecs;
+		position.lat			= homeLatitude * 1e7;
+		position.lon			= homeLongitude * 1e7;
+		position.alt			= (homeAltitude + flightAltitude) * 1000;
+		position.relative_alt	= flightAltitude * 1000;
+		position.hdg			= _yawDegrees() * 100;
+		mavlink_msg_global_position_int_encode(autopilotSystemId, autopilotComponentId, &message, &position);
+		_send(message);
+	}
+
+	void _sendAttitude(uint32_t timeBootMSecs)
+	{
+		mavlink_attitude_t	attitude;
+		mavlink_message_t	message;
+		double				yawDegrees = _yawDegrees();
+
+		memset(&attitude, 0, sizeof(attitude));
+		attitude.time_boot_ms	= timeBootMSecs;
+		attitude.yaw			= (yawDegrees > 180 ? yawDegrees - 360 : yawDegrees) * M_PI / 180.0;
+		attitude.yawspeed		= _rotationsStartNSecs && yawDegrees != 0 ? 2 * M_PI / _rotationSecs : 0;
+		mavlink_msg_attitude_encode(autopilotSystemId, autopilotComponentId, &message, &attitude);
+		_send(message);
+	}
+
+	void _autopilotThread(double positionHz, double attitudeHz)
+	{
+		const uint64_t	bootNSecs			= nsecsMonotonic();
+		const uint64_t	heartbeatNSecs		= 1000000000ull;
+		const uint64_t	positionNSecs		= 1e9 / positionHz;
+		const uint64_t	attitudeNSecs		= 1e9 / attitudeHz;
+		uint64_t		nextHeartbeatNSecs	= bootNSecs;
+		uint64_t		nextPositionNSecs	= bootNSecs;
+		uint64_t		nextAttitudeNSecs	= bootNSecs;
+
+		while (true) {
+			uint64_t nowNSecs		= nsecsMonotonic();
+			uint32_t timeBootMSecs	= (nowNSecs - bootNSecs) / 1000000;
+
+			if (nowNSecs >= nextHeartbeatNSecs) {
+				_sendHeartbeats();
+				nextHeartbeatNSecs += heartbeatNSecs;
+			}
+			if (nowNSecs >= nextPositionNSecs) {
+				_sendPosition(timeBootMSecs);
+				nextPositionNSecs += positionNSecs;
+			}
+			if (nowNSecs >= nextAttitudeNSecs) {
+				_sendAttitude(timeBootMSecs);
+				nextAttitudeNSecs += attitudeNSecs;
+			}
+
+			Clock::instance()->sleepUntilMonotonicNSecs(std::min({ nextHeartbeatNSecs, nextPositionNSecs, nextAttitudeNSecs }));
+		}
+	}
+
+	void _handleTunnel(const mavlink_tunnel_t& tunnel, uint64_t receivedNSecs)
+	{
+		HeaderInfo_t header;
+
+		if (tunnel.target_system != gcsSystemId || tunnel.payload_length < sizeof(header)) {
+			return;
+		}
+		memcpy(&header, tunnel.payload, sizeof(header));
+
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		switch (header.command) {
+		case COMMAND_ID_ACK:
+		{
+			AckInfo_t ackInfo;
+
+			memcpy(&ackInfo, tunnel.payload, sizeof(ackInfo));
+			if (ackInfo.command == _ackCommand) {
+				_ackResult	= ackInfo.result;
+				_ackMessage	= ackInfo.message;
+				_ackNSecs	= receivedNSecs;
+				_condition.notify_all();
+			}
+		}
+			break;
+		case COMMAND_ID_PULSE:
+		{
+			PulseInfo_t pulseInfo;
+
+			memcpy(&pulseInfo, tunnel.payload, sizeof(pulseInfo));
+			if (pulseInfo.frequency_hz != 0 && _counting) {
+				double latencySecs = secondsSinceEpoch() - pulseInfo.start_time_seconds;
+
+				_pulseLatency.record(latencySecs > 0 ? latencySecs * 1e6 : 0);
+				_pulsesByTag[pulseInfo.tag_id]++;
+			}
+		}
+			break;
+		case COMMAND_ID_HEARTBEAT:
+		{
+			Heartbeat_t heartbeat;
+
+			// Tunnel heartbeats only start once the controller has discovered the GCS
+			memcpy(&heartbeat, tunnel.payload, sizeof(heartbeat));
+			_controllerReady	= true;
+			_controllerStatus	= heartbeat.status;
+			_condition.notify_all();
+		}
+			break;
+		case COMMAND_ID_DETECTOR_HEALTH:
+			_healthMessages += _counting;
+			break;
+		case COMMAND_ID_PROCESS_RESTARTS:
+			_restartMessages += _counting;
+			break;
+		case COMMAND_ID_PROCESS_RESOURCES:
+			_resourceMessages += _counting;
+			break;
+		case COMMAND_ID_CGROUP_STATS:
+			_cgroupMessages += _counting;
+			break;
+		}
+	}
+
+	void _receiveThread(void)
+	{
+		uint8_t buffer[2048];
+
+		while (true) {
+			ssize_t cBytes = recv(_socketFd, buffer, sizeof(buffer), 0);
+			if (cBytes <= 0) {
+				continue;
+			}
+
+			uint64_t			receivedNSecs = nsecsMonotonic();
+			MessageParser		parser(buffer, cBytes);
+			mavlink_message_t	message;
+
+			while (parser.parse(&message)) {
+				if (message.compid != MAV_COMP_ID_ONBOARD_COMPUTER) {
+					continue;
+				}
+
+				switch (message.msgid) {
+				case MAVLINK_MSG_ID_TUNNEL:
+				{
+					mavlink_tunnel_t tunnel;
+
+					mavlink_msg_tunnel_decode(&message, &tunnel);
+					_handleTunnel(tunnel, receivedNSecs);
+				}
+					break;
+				case MAVLINK_MSG_ID_STATUSTEXT:
+				{
+					mavlink_statustext_t statusText;
+					char text[sizeof(statusText.text) + 1] {};
+
+					mavlink_msg_statustext_decode(&message, &statusText);
+					memcpy(text, statusText.text, sizeof(statusText.text));
+					printf("Status: %s\n", text);
+
+					if (strcmp(text, "#Detector start failed") == 0) {
+						std::lock_guard<std::mutex> lock(_mutex);
+						_startFailed = true;
+						_condition.notify_all();
+					}
+				}
+					break;
+				}
+			}
+		}
+	}
+
+	int						_socketFd				= -1;
+	struct sockaddr_in		_controllerAddress		{};
+	bool					_sendGcsHeartbeat		= true;
+
+	std::atomic<uint64_t>	_rotationsStartNSecs	{ 0 };
+	std::atomic<uint64_t>	_rotationsEndNSecs		{ 0 };
+	std::atomic<double>		_rotationSecs			{ 1 };
+
+	std::mutex				_mutex;
+	std::condition_variable	_condition;
+	bool					_controllerReady		= false;
+	uint16_t				_controllerStatus		= HEARTBEAT_STATUS_IDLE;
+	bool					_startFailed			= false;
+	bool					_counting				= false;
+	uint32_t				_ackCommand				= 0;
+	std::optional<uint32_t>	_ackResult;
+	std::string				_ackMessage;
+	uint64_t				_ackNSecs				= 0;
+	LatencyHistogram		_pulseLatency;
+	std::map<uint32_t, uint64_t> _pulsesByTag;
+	uint32_t				_healthMessages			= 0;
+	uint32_t				_restartMessages		= 0;
+	uint32_t				_resourceMessages		= 0;
+	uint32_t				_cgroupMessages			= 0;
+};
+
+static bool reportCommand(const char* name, std::optional<uint64_t> ackUSecs)
+{
+	if (!ackUSecs.has_value()) {
+		fprintf(stderr, "%s failed\n", name);
+		return false;
+	}
+	printf("%-16s ack %.3f ms\n", name, ackUSecs.value() / 1000.0);
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	std::string	controllerIp	= "127.0.0.1";
+	int			controllerPort	= 14540;
+	double		positionHz		= 10;
+	double		attitudeHz		= 20;
+	uint32_t	rotations		= 1;
+	double		rotationSecs	= 20;
+	uint32_t	tagCount		= 1;
+	uint32_t	firstTagId		= 2;
+	uint32_t	intraPulseMSecs	= 2000;
+	uint32_t	k				= 3;
+	uint32_t	sdrType			= SDR_TYPE_AIRSPY_MINI;
+	uint32_t	detectSecs		= 30;
+	bool		autopilotOnly	= false;
+
+	for (int i = 1; i < argc; i++) {
+		std::string strArg	= argv[i];
+		auto		colon	= strArg.find(':');
+		std::string name	= strArg.substr(0, colon);
+		std::string value	= colon == std::string::npos ? "" : strArg.substr(colon + 1);
+
+		if (name == "--controller") {
+			controllerIp	= value.substr(0, value.find(':'));
+			controllerPort	= atoi(value.substr(value.find(':') + 1).c_str());
+		} else if (name == "--position-hz") {
+			positionHz = atof(value.c_str());
+		} else if (name == "--attitude-hz") {
+			attitudeHz = atof(value.c_str());
+		} else if (name == "--rotations") {
+			rotations = atoi(value.c_str());
+		} else if (name == "--rotation-secs") {
+			rotationSecs = atof(value.c_str());
+		} else if (name == "--tags") {
+			tagCount = atoi(value.c_str());
+		} else if (name == "--tag-id") {
+			firstTagId = atoi(value.c_str());
+		} else if (name == "--ip") {
+			intraPulseMSecs = atoi(value.c_str());
+		} else if (name == "--k") {
+			k = atoi(value.c_str());
+		} else if (name == "--sdr") {
+			sdrType = value == "hf" ? SDR_TYPE_AIRSPY_HF : SDR_TYPE_AIRSPY_MINI;
+		} else if (name == "--detect-secs") {
+			detectSecs = atoi(value.c_str());
+		} else if (name == "--autopilot-only") {
+			autopilotOnly = true;
+		} else {
+			fprintf(stderr, "Unknown option %s\n", strArg.c_str());
+			return 1;
+		}
+	}
+
+	if (positionHz <= 0 || attitudeHz <= 0 || rotationSecs <= 0) {
+		fprintf(stderr, "Rates and rotation time must be greater than zero\n");
+		return 1;
+	}
+
+	// Line buffered so progress shows up when piped to a log
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	FakeVehicle vehicle(controllerIp, controllerPort);
+
+	vehicle.start(!autopilotOnly, positionHz, attitudeHz);
+
+	if (autopilotOnly) {
+		vehicle.startRotations(rotations, rotationSecs);
+		while (true) {
+			sleepForMSecs(1000);
+		}
+	}
+
+	if (!vehicle.waitForController(10000)) {
+		fprintf(stderr, "No response from controller at %s:%d\n", controllerIp.c_str(), controllerPort);
+		return 1;
+	}
+
+	// Tag ids and frequencies line up with the controller's --simulate-load tags
+	StartTagsInfo_t startTags;
+
+	memset(&startTags, 0, sizeof(startTags));
+	startTags.header.command	= COMMAND_ID_START_TAGS;
+	startTags.sdr_type			= sdrType;
+	if (!reportCommand("START_TAGS", vehicle.sendCommand(&startTags, sizeof(startTags)))) {
+		return 1;
+	}
+
+	for (uint32_t i=0; i<tagCount; i++) {
+		TagInfo_t tagInfo;
+
+		memset(&tagInfo, 0, sizeof(tagInfo));
+		tagInfo.header.command					= COMMAND_ID_TAG;
+		tagInfo.id								= firstTagId + (i * 2);
+		tagInfo.frequency_hz					= 146000000 + (tagInfo.id * 1000);
+		tagInfo.pulse_width_msecs				= 15;
+		tagInfo.intra_pulse1_msecs				= intraPulseMSecs;
+		tagInfo.intra_pulse_uncertainty_msecs	= 60;
+		tagInfo.intra_pulse_jitter_msecs		= 20;
+		tagInfo.k								= k;
+		tagInfo.false_alarm_probability			= 0.01;
+		if (!reportCommand("TAG", vehicle.sendCommand(&tagInfo, sizeof(tagInfo)))) {
+			return 1;
+		}
+	}
+
+	HeaderInfo_t endTags { COMMAND_ID_END_TAGS };
+	if (!reportCommand("END_TAGS", vehicle.sendCommand(&endTags, sizeof(endTags)))) {
+		return 1;
+	}
+
+	StartDetectionInfo_t startDetection;
+
+	memset(&startDetection, 0, sizeof(startDetection));
+	startDetection.header.command				= COMMAND_ID_START_DETECTION;
+	startDetection.radio_center_frequency_hz	= 146000000;
+	startDetection.sdr_type						= sdrType;
+
+	if (!reportCommand("START_DETECTION", vehicle.sendCommand(&startDetection, sizeof(startDetection)))) {
+		return 1;
+	}
+
+	// The ack only means startup has begun. Each startup stage has its own timeout, the detectors' is the longest.
+	uint64_t startNSecs = nsecsMonotonic();
+	if (!vehicle.waitForDetecting(detectingTimeoutMSecs)) {
+		fprintf(stderr, "Detection did not start\n");
+		return 1;
+	}
+	printf("%-16s %.3f ms\n", "DETECTING", (nsecsMonotonic() - startNSecs) / 1e6);
+
+	vehicle.resetPulses();
+	vehicle.startRotations(rotations, rotationSecs);
+
+	sleepForMSecs(detectSecs * 1000);
+
+	HeaderInfo_t stopDetection { COMMAND_ID_STOP_DETECTION };
+	vehicle.stopCounting();
+	bool stopped = reportCommand("STOP_DETECTION", vehicle.sendCommand(&stopDetection, sizeof(stopDetection)));
+
+	vehicle.printPulses();
+
+	return stopped ? 0 : 1;
+}
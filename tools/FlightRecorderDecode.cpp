@@ -0,0 +1,177 @@
+// Exports a flight_recorder.bin session recording to CSV files:
+//	<outputDir>/pulses.csv
+//	<outputDir>/position.csv
+//	<outputDir>/attitude.csv
+//	<outputDir>/commands.csv
+//
+// Usage: FlightRecorderDecode <flight_recorder.bin> [outputDir] [--from:<seconds since epoch>]
+// outputDir defaults to the directory holding the recording.
+
+#include "FlightRecorderFormat.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static FILE* openCsv(const std::string& outputDir, const char* name, const char* columns)
+{
+	std::string path = outputDir + "/" + name;
+	FILE* file = fopen(path.c_str(), "w");
+
+	if (!file) {
+		fprintf(stderr, "Unable to create %s: %s\n", path.c_str(), strerror(errno));
+		exit(1);
+	}
+	fprintf(file, "%s\n", columns);
+
+	return file;
+}
+
+int main(int argc, char** argv)
+{
+	std::string inputPath;
+	std::string outputDir;
+	double		fromSeconds = 0;
+	std::string fromPrefix	= "--from:";
+
+	for (int i = 1; i < argc; i++) {
+		std::string strArg = argv[i];
+
+		if (strArg.starts_with(fromPrefix)) {
+			fromSeconds = atof(strArg.substr(fromPrefix.length()).c_str());
+		} else if (inputPath.empty()) {
+			inputPath = strArg;
+		} else {
+			outputDir = strArg;
+		}
+	}
+
+	if (inputPath.empty()) {
+		fprintf(stderr, "usage: %s <flight_recorder.bin> [outputDir] [--from:<seconds since epoch>]\n", argv[0]);
+		return 1;
+	}
+	if (outputDir.empty()) {
+		auto slash = inputPath.rfind('/');
+		outputDir = slash == std::string::npos ? "." : inputPath.substr(0, slash);
+	}
+
+	if (mkdir(outputDir.c_str(), 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "Unable to create %s: %s\n", outputDir.c_str(), strerror(errno));
+		return 1;
+	}
+
+	int fd = open(inputPath.c_str(), O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Unable to open %s: %s\n", inputPath.c_str(), strerror(errno));
+		return 1;
+	}
+
+	struct stat fileStat;
+	fstat(fd, &fileStat);
+	if ((size_t)fileStat.st_size < sizeof(FlightRecorderHeader_t)) {
+		fprintf(stderr, "%s is too small to be a flight recording\n", inputPath.c_str());
+		return 1;
+	}
+
+	void* mapping = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		fprintf(stderr, "mmap failed: %s\n", strerror(errno));
+		return 1;
+	}
+
+	auto header = static_cast<const FlightRecorderHeader_t*>(mapping);
+	auto fields = &header->fields;
+
+	if (fields->magic != FLIGHT_RECORDER_MAGIC || fields->version != FLIGHT_RECORDER_VERSION || fields->recordSize != sizeof(FlightRecord_t)) {
+		fprintf(stderr, "%s is not a supported flight recording (magic %08x version %u)\n", inputPath.c_str(), fields->magic, fields->version);
+		return 1;
+	}
+
+	// The controller may not have been able to truncate and fix up the count if it died, so trust the file size too
+	uint64_t recordCount	= fields->recordCount < fields->capacity ? fields->recordCount : fields->capacity;
+	uint64_t recordsInFile	= (fileStat.st_size - fields->headerSize) / fields->recordSize;
+	if (recordsInFile < recordCount) {
+		recordCount = recordsInFile;
+	}
+
+	auto records		= reinterpret_cast<const FlightRecord_t*>(static_cast<const uint8_t*>(mapping) + fields->headerSize);
+	uint64_t firstIndex	= fromSeconds > 0 ? flightRecorderFirstRecordForTime(header, fromSeconds) : 0;
+
+	FILE* pulses	= openCsv(outputDir, "pulses.csv",
+								"time,tag_id,frequency_hz,start_time_seconds,predict_next_start_seconds,snr,stft_score,group_snr,noise_psd,"
+								"group_seq_counter,group_ind,detection_status,confirmed_status,latitude,longitude,relative_altitude,roll,pitch,yaw");
+	FILE* position	= openCsv(outputDir, "position.csv", "time,time_boot_ms,latitude,longitude,relative_altitude");
+	FILE* attitude	= openCsv(outputDir, "attitude.csv", "time,time_boot_ms,roll,pitch,yaw");
+	FILE* commands	= openCsv(outputDir, "commands.csv", "time,command,result,payload_length,payload_hex");
+
+	uint64_t counts[FLIGHT_RECORD_COMMAND + 1] = {};
+
+	for (uint64_t recordIndex=firstIndex; recordIndex<recordCount; recordIndex++) {
+		const FlightRecord_t& record = records[recordIndex];
+
+		if (record.type == FLIGHT_RECORD_NONE || record.type > FLIGHT_RECORD_COMMAND || record.timeSeconds < fromSeconds) {
+			counts[FLIGHT_RECORD_NONE]++;
+			continue;
+		}
+		counts[record.type]++;
+
+		switch (record.type) {
+		case FLIGHT_RECORD_PULSE:
+		{
+			const FlightPulseRecord_t& pulse = record.u.pulse;
+			fprintf(pulses, "%.6f,%u,%u,%.6f,%.6f,%g,%g,%g,%g,%u,%u,%u,%u,%.7f,%.7f,%.2f,%.1f,%.1f,%.1f\n",
+					record.timeSeconds, pulse.tagId, pulse.frequencyHz, pulse.startTimeSeconds, pulse.predictNextStartSeconds,
+					pulse.snr, pulse.stftScore, pulse.groupSnr, pulse.noisePsd,
+					pulse.groupSeqCounter, pulse.groupInd, pulse.detectionStatus, pulse.confirmedStatus,
+					pulse.latitude, pulse.longitude, pulse.relativeAltitude,
+					pulse.rollDegrees, pulse.pitchDegrees, pulse.yawDegrees);
+		}
+			break;
+		case FLIGHT_RECORD_POSITION:
+			fprintf(position, "%.6f,%u,%.7f,%.7f,%.2f\n",
+					record.timeSeconds, record.u.position.timeBootMs,
+					record.u.position.latitude, record.u.position.longitude, record.u.position.relativeAltitude);
+			break;
+		case FLIGHT_RECORD_ATTITUDE:
+			fprintf(attitude, "%.6f,%u,%.1f,%.1f,%.1f\n",
+					record.timeSeconds, record.u.attitude.timeBootMs,
+					record.u.attitude.rollDegrees, record.u.attitude.pitchDegrees, record.u.attitude.yawDegrees);
+			break;
+		case FLIGHT_RECORD_COMMAND:
+		{
+			const FlightCommandRecord_t& command = record.u.command;
+			fprintf(commands, "%.6f,%u,%u,%u,", record.timeSeconds, command.command, command.result, command.payloadLength);
+			for (uint32_t i=0; i<command.payloadLength && i<sizeof(command.payload); i++) {
+				fprintf(commands, "%02x", command.payload[i]);
+			}
+			fprintf(commands, "\n");
+		}
+			break;
+		}
+	}
+
+	fclose(pulses);
+	fclose(position);
+	fclose(attitude);
+	fclose(commands);
+	munmap(mapping, fileStat.st_size);
+
+	printf("%s: %llu records, pulses %llu position %llu attitude %llu commands %llu skipped %llu\n",
+			inputPath.c_str(),
+			(unsigned long long)recordCount,
+			(unsigned long long)counts[FLIGHT_RECORD_PULSE],
+			(unsigned long long)counts[FLIGHT_RECORD_POSITION],
+			(unsigned long long)counts[FLIGHT_RECORD_ATTITUDE],
+			(unsigned long long)counts[FLIGHT_RECORD_COMMAND],
+			(unsigned long long)counts[FLIGHT_RECORD_NONE]);
+
+	return 0;
+}
@@ -0,0 +1,227 @@
+// Expands a binary MavLinkController.bin session log written with --log-format:binary to text on stdout:
+//	2026-10-19 14:03:12.345|I] Starting detectors (CommandHandler.cpp:123)
+//
+// Usage: LogDecode <MavLinkController.bin> [--level:debug|info|warn|error]
+
+#include "LogFormat.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+typedef struct {
+	bool		defined;
+	int			level;
+	uint64_t	line;
+	std::string	filename;
+	std::vector<std::string> strings;	// Last string per argument position, for LOG_ARG_REPEAT
+} Site_t;
+
+static const char* levelTags[] = { "|D] ", "|I] ", "|W] ", "|E] " };
+
+static bool parseLevel(const std::string& name, int& level)
+{
+	const char* names[] = { "debug", "info", "warn", "error" };
+
+	for (int i=0; i<4; i++) {
+		if (name == names[i]) {
+			level = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int main(int argc, char** argv)
+{
+	std::string inputPath;
+	int			minLevel	= LOG_LEVEL_DEBUG;
+	std::string levelPrefix	= "--level:";
+
+	for (int i = 1; i < argc; i++) {
+		std::string strArg = argv[i];
+
+		if (strArg.starts_with(levelPrefix)) {
+			if (!parseLevel(strArg.substr(levelPrefix.length()), minLevel)) {
+				fprintf(stderr, "Invalid level: %s - expected debug, info, warn or error\n", strArg.c_str());
+				return 1;
+			}
+		} else {
+			inputPath = strArg;
+		}
+	}
+
+	if (inputPath.empty()) {
+		fprintf(stderr, "usage: %s <MavLinkController.bin> [--level:debug|info|warn|error]\n", argv[0]);
+		return 1;
+	}
+
+	FILE* file = fopen(inputPath.c_str(), "rb");
+	if (!file) {
+		fprintf(stderr, "Unable to open %s: %s\n", inputPath.c_str(), strerror(errno));
+		return 1;
+	}
+
+	std::vector<uint8_t>	data;
+	uint8_t					readBuffer[65536];
+	size_t					cRead;
+
+	while ((cRead = fread(readBuffer, 1, sizeof(readBuffer), file)) > 0) {
+		data.insert(data.end(), readBuffer, readBuffer + cRead);
+	}
+	fclose(file);
+
+	const uint8_t*	p			= data.data();
+	const uint8_t*	end			= p + data.size();
+	uint64_t		timeUSecs	= 0;
+	uint64_t		cRecords	= 0;
+	bool			truncated	= false;
+	std::vector<Site_t> sites;
+	std::string		text;
+
+	// The controller writes a new header each time it reopens the file in the same session
+	while (p < end) {
+		uint64_t	siteId;
+		uint32_t	cBytes;
+
+		if (p[0] != LOG_ENTRY_SITE && p[0] != LOG_ENTRY_RECORD) {
+			LogFileHeader_t header;
+
+			if ((size_t)(end - p) < sizeof(header)) {
+				truncated = true;
+				break;
+			}
+			memcpy(&header, p, sizeof(header));
+			if (header.magic != LOG_FILE_MAGIC || header.version != LOG_FILE_VERSION) {
+				fprintf(stderr, "%s: not a version %u binary log at offset %zu\n", inputPath.c_str(), LOG_FILE_VERSION, (size_t)(p - data.data()));
+				return 1;
+			}
+			timeUSecs = header.startTimeUSecs;
+			sites.clear();
+			p += sizeof(header);
+			continue;
+		}
+
+		uint8_t entryType = *p++;
+
+		if (!(cBytes = logVarintRead(p, end, &siteId))) {
+			truncated = true;
+			break;
+		}
+		p += cBytes;
+		if (siteId >= sites.size()) {
+			sites.resize(siteId + 1);
+		}
+		Site_t& site = sites[siteId];
+
+		if (entryType == LOG_ENTRY_SITE) {
+			uint64_t filenameLength;
+
+			if (p >= end) {
+				truncated = true;
+				break;
+			}
+			site.level = *p++;
+			if (!(cBytes = logVarintRead(p, end, &site.line))) {
+				truncated = true;
+				break;
+			}
+			p += cBytes;
+			if (!(cBytes = logVarintRead(p, end, &filenameLength)) || filenameLength > (uint64_t)(end - p - cBytes)) {
+				truncated = true;
+				break;
+			}
+			p += cBytes;
+			site.filename.assign((const char*)p, filenameLength);
+			site.strings.clear();
+			site.defined = true;
+			p += filenameLength;
+			continue;
+		}
+
+		uint64_t timeDelta;
+		uint64_t argsLength;
+
+		if (!(cBytes = logVarintRead(p, end, &timeDelta))) {
+			truncated = true;
+			break;
+		}
+		p += cBytes;
+		if (!(cBytes = logVarintRead(p, end, &argsLength)) || argsLength > (uint64_t)(end - p - cBytes)) {
+			truncated = true;
+			break;
+		}
+		p += cBytes;
+
+		const uint8_t*	args		= p;
+		const uint8_t*	argsEnd		= p + argsLength;
+		size_t			position	= 0;
+		LogArg_t		arg {};
+		char			number[32];
+
+		p			= argsEnd;
+		timeUSecs	+= logZigzagDecode(timeDelta);
+
+		if (!site.defined) {
+			fprintf(stderr, "%s: record for undefined call site %llu\n", inputPath.c_str(), (unsigned long long)siteId);
+			return 1;
+		}
+
+		// Arguments are always decoded so repeated strings stay in step, even for records which aren't printed
+		text.clear();
+		while ((cBytes = logArgRead(args, argsEnd, &arg))) {
+			if (position >= site.strings.size()) {
+				site.strings.resize(position + 1);
+			}
+			switch (arg.type) {
+			case LOG_ARG_INT:
+				snprintf(number, sizeof(number), "%lld", (long long)arg.intValue);
+				text += number;
+				break;
+			case LOG_ARG_UINT:
+				snprintf(number, sizeof(number), "%llu", (unsigned long long)arg.uintValue);
+				text += number;
+				break;
+			case LOG_ARG_DOUBLE:
+				snprintf(number, sizeof(number), "%g", arg.doubleValue);
+				text += number;
+				break;
+			case LOG_ARG_STRING:
+				site.strings[position].assign(arg.string, arg.stringLength);
+				text += site.strings[position];
+				break;
+			case LOG_ARG_REPEAT:
+				text += site.strings[position];
+				break;
+			}
+			text += " ";
+			args += cBytes;
+			position++;
+		}
+
+		if (site.level < minLevel || site.level > LOG_LEVEL_ERROR) {
+			continue;
+		}
+
+		time_t		seconds = timeUSecs / 1000000;
+		struct tm	timeinfo;
+		char		timeStr[32];
+
+		localtime_r(&seconds, &timeinfo);
+		strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", &timeinfo);
+
+		printf("%s.%03u%s%s(%s:%llu)\n", timeStr, (unsigned)(timeUSecs % 1000000 / 1000), levelTags[site.level], text.c_str(), site.filename.c_str(), (unsigned long long)site.line);
+		cRecords++;
+	}
+
+	if (truncated) {
+		fprintf(stderr, "%s: ignored a truncated entry at the end of the log\n", inputPath.c_str());
+	}
+	fprintf(stderr, "%llu records\n", (unsigned long long)cRecords);
+
+	return 0;
+}